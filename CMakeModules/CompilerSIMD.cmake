@@ -105,6 +105,57 @@ __m128 Y = _mm_movehdup_ps(X);
 SET(CMAKE_REQUIRED_FLAGS "")
 ENDMACRO(CHECK_SSE3)
 
+
+MACRO(CHECK_SSSE3)
+IF(CMAKE_COMPILER_IS_GNUCC)
+  SET(SSSE3_FLAGS "-mmmx -msse -msse2 -msse3 -mssse3")
+ENDIF(CMAKE_COMPILER_IS_GNUCC)
+
+SET(CMAKE_REQUIRED_FLAGS "${SSSE3_FLAGS}")
+CHECK_C_SOURCE_COMPILES(
+"#include <tmmintrin.h>
+int main() {
+__m128i X = _mm_setzero_si128();
+__m128i Y = _mm_shuffle_epi8(X, X);
+}
+" HAVE_SSSE3)
+SET(CMAKE_REQUIRED_FLAGS "")
+ENDMACRO(CHECK_SSSE3)
+
+
+MACRO(CHECK_AVX2)
+IF(CMAKE_COMPILER_IS_GNUCC)
+  SET(AVX2_FLAGS "-mmmx -msse -msse2 -msse3 -mavx -mavx2")
+ENDIF(CMAKE_COMPILER_IS_GNUCC)
+
+SET(CMAKE_REQUIRED_FLAGS "${AVX2_FLAGS}")
+CHECK_C_SOURCE_COMPILES(
+"#include <immintrin.h>
+int main() {
+__m256i X = _mm256_setzero_si256();
+__m256i Y = _mm256_unpackhi_epi16(X, X);
+}
+" HAVE_AVX2)
+SET(CMAKE_REQUIRED_FLAGS "")
+ENDMACRO(CHECK_AVX2)
+
+
+MACRO(CHECK_FMA)
+IF(CMAKE_COMPILER_IS_GNUCC)
+  SET(FMA_FLAGS "-mmmx -msse -msse2 -msse3 -mavx -mavx2 -mfma")
+ENDIF(CMAKE_COMPILER_IS_GNUCC)
+
+SET(CMAKE_REQUIRED_FLAGS "${FMA_FLAGS}")
+CHECK_C_SOURCE_COMPILES(
+"#include <immintrin.h>
+int main() {
+__m256 X = _mm256_setzero_ps();
+__m256 Y = _mm256_fmadd_ps(X, X, X);
+}
+" HAVE_FMA)
+SET(CMAKE_REQUIRED_FLAGS "")
+ENDMACRO(CHECK_FMA)
+
 MACRO(CHECK_ALTIVEC)
 IF(CMAKE_COMPILER_IS_GNUCC)
   SET(ALTIVEC_FLAGS "-maltivec")
@@ -37,6 +37,7 @@
 #include "aften.h"
 #include "pcm.h"
 #include "opts.h"
+#include "segment.h"
 
 static const int acmod_to_ch[8] = { 2, 1, 2, 3, 3, 4, 4, 5 };
 
@@ -55,31 +56,6 @@ print_intro(FILE *out)
                  vers);
 }
 
-static void
-print_simd_in_use(FILE *out, AftenSimdInstructions *simd_instructions)
-{
-    fprintf(out, "SIMD usage:");
-    if (simd_instructions->mmx)
-        fprintf(out, " MMX");
-    if (simd_instructions->sse)
-        fprintf(out, " SSE");
-    if (simd_instructions->sse2)
-        fprintf(out, " SSE2");
-    if (simd_instructions->sse3)
-        fprintf(out, " SSE3");
-    if (simd_instructions->ssse3)
-        fprintf(out, " SSSE3");
-    if (simd_instructions->amd_3dnow)
-        fprintf(out, " 3DNOW");
-    if (simd_instructions->amd_3dnowext)
-        fprintf(out, " 3DNOWEXT");
-    if (simd_instructions->amd_sse_mmx)
-        fprintf(out, " SSE-MMX");
-    if (simd_instructions->altivec)
-        fprintf(out, " Altivec");
-    fprintf(out, "\n");
-}
-
 int
 main(int argc, char **argv)
 {
@@ -92,6 +68,7 @@ main(int argc, char **argv)
     CommandOptions opts;
     AftenContext s;
     uint32_t samplecount, bytecount, t0, t1, percent;
+    uint32_t ba_lookups, ba_hits, ba_bap_hits;
     FLOAT kbps, qual, bw;
     int last_frame;
     int frame_cnt;
@@ -215,14 +192,22 @@ main(int argc, char **argv)
     // set some encoding parameters using wav info
     s.channels = pf.channels;
     s.samplerate = pf.sample_rate;
+    if(opts.chmap == 0)
+        s.channel_order = AFTEN_CH_ORDER_WAV;
+    else if(opts.chmap == 2)
+        s.channel_order = AFTEN_CH_ORDER_MPEG;
 #ifdef CONFIG_DOUBLE
     s.sample_format = A52_SAMPLE_FMT_DBL;
 #else
     s.sample_format = A52_SAMPLE_FMT_FLT;
 #endif
 
-    // initialize encoder
-    if(aften_encode_init(&s)) {
+    if(opts.segments > 1 && !segments_supported(&opts, &pf)) {
+        fprintf(stderr, "segments: encoding in one pass\n");
+        opts.segments = 0;
+    }
+    // segment mode sets up one context per segment from the parameters in s
+    if(opts.segments <= 1 && aften_encode_init(&s)) {
         fprintf(stderr, "error initializing encoder\n");
         aften_encode_close(&s);
         return 1;
@@ -252,6 +237,15 @@ main(int argc, char **argv)
         fprintf(stderr, "\n\n");
     }
 
+    if(opts.segments > 1) {
+        // encode parts of the file in parallel
+        err = encode_segments(&opts, &s, &pf, ofp, read_format);
+        pcmfile_close(&pf);
+        fclose(ifp);
+        fclose(ofp);
+        return err;
+    }
+
     /* print SIMD instructions used */
     print_simd_in_use(stderr, &s.system.wanted_simd_instructions);
 
@@ -268,6 +262,7 @@ main(int argc, char **argv)
 
     samplecount = bytecount = t0 = t1 = percent = 0;
     qual = bw = 0.0;
+    ba_lookups = ba_hits = ba_bap_hits = 0;
     last_frame = 0;
     frame_cnt = 0;
     done = 0;
@@ -279,13 +274,6 @@ main(int argc, char **argv)
     if(!opts.pad_start) {
         FLOAT *sptr = &fwav[1280*s.channels];
         nr = pcmfile_read_samples(&pf, sptr, 256);
-        if(opts.chmap == 0) {
-            aften_remap_wav_to_a52(sptr, nr, s.channels, s.sample_format,
-                                   s.acmod);
-        } else if(opts.chmap == 2) {
-            aften_remap_mpeg_to_a52(sptr, nr, s.channels, s.sample_format,
-                                    s.acmod);
-        }
         fs = aften_encode_frame(&s, frame, fwav);
         if(fs < 0) {
             fprintf(stderr, "Error encoding initial frame\n");
@@ -295,14 +283,6 @@ main(int argc, char **argv)
 
     nr = pcmfile_read_samples(&pf, fwav, A52_SAMPLES_PER_FRAME);
     while(nr > 0 || fs > 0) {
-        if(opts.chmap == 0) {
-            aften_remap_wav_to_a52(fwav, nr, s.channels, s.sample_format,
-                                   s.acmod);
-        } else if(opts.chmap == 2) {
-            aften_remap_mpeg_to_a52(fwav, nr, s.channels, s.sample_format,
-                                    s.acmod);
-        }
-
         // append extra silent frame if final frame is > 1280 samples
         if(nr == 0) {
             if(last_frame <= 1280) {
@@ -330,6 +310,9 @@ main(int argc, char **argv)
                     bytecount += fs;
                     qual += s.status.quality;
                     bw += s.status.bwcode;
+                    ba_lookups += s.status.ba_cache_lookups;
+                    ba_hits += s.status.ba_cache_hits;
+                    ba_bap_hits += s.status.ba_cache_bap_hits;
                 }
                 current_clock = clock();
                 /* make sure we write out when finished, i.e. when fs == 0 */
@@ -352,9 +335,9 @@ main(int argc, char **argv)
                         }
                         t0 = t1;
                     } else if(s.verbose == 2) {
-                        fprintf(stderr, "frame: %7d | q: %4d | bw: %2d | bitrate: %3d kbps\n",
+                        fprintf(stderr, "frame: %7d | q: %4d | bw: %2d | bitrate: %3d kbps | ba: %2d\n",
                                 frame_cnt, s.status.quality, s.status.bwcode,
-                                s.status.bit_rate);
+                                s.status.bit_rate, s.status.bit_alloc_evals);
                     }
                     last_update_clock = current_clock;
                 }
@@ -377,7 +360,13 @@ main(int argc, char **argv)
         fprintf(stderr, "\n");
         fprintf(stderr, "average quality:   %4.1f\n", (qual / frame_cnt));
         fprintf(stderr, "average bandwidth: %2.1f\n", (bw / frame_cnt));
-        fprintf(stderr, "average bitrate:   %4.1f kbps\n\n", kbps);
+        fprintf(stderr, "average bitrate:   %4.1f kbps\n", kbps);
+        if(ba_lookups > 0) {
+            fprintf(stderr, "bit alloc cache:   %4.1f%% hits, %4.1f%% with bap\n",
+                    (ba_hits * FCONST(100.0)) / ba_lookups,
+                    (ba_bap_hits * FCONST(100.0)) / ba_lookups);
+        }
+        fprintf(stderr, "\n");
     }
 end:
     free(fwav);
@@ -27,7 +27,7 @@
 
 static const char *usage_heading = "usage: aften [options] <input.wav> <output.ac3>\n";
 
-#define HELP_OPTIONS_COUNT 41
+#define HELP_OPTIONS_COUNT 44
 
 static const char *help_options[HELP_OPTIONS_COUNT] = {
 "    [-h]           Print out list of commandline options\n",
@@ -44,8 +44,17 @@ static const char *help_options[HELP_OPTIONS_COUNT] = {
 "    [-threads #]   Number of parallel threads to use\n"
 "                       0 = detect number of CPUs (default)\n",
 
+"    [-threadmode #] How the threads share the work\n"
+"                       0 = one frame per thread (default)\n"
+"                       1 = split each frame by channel and block\n"
+"                       2 = one frame per thread, rate control in order\n",
+
+"    [-segments #]  Encode # parts of the input file in parallel\n"
+"                       0 = encode in one pass (default)\n",
+
 "    [-nosimd X]    Comma-separated list of SIMD instruction sets not to use\n"
-"                       Available sets are mmx, sse, sse2, sse3 and altivec.\n"
+"                       Available sets are mmx, sse, sse2, sse3, ssse3, avx2,\n"
+"                       fma and altivec.\n"
 "                       No spaces are allowed between the sets and the commas.\n",
 
 "    [-b #]         CBR bitrate in kbps (default: about 96kbps per channel)\n",
@@ -54,11 +63,15 @@ static const char *help_options[HELP_OPTIONS_COUNT] = {
 
 "    [-fba #]       Fast bit allocation (default: 0)\n"
 "                       0 = more accurate encoding\n"
-"                       1 = faster encoding\n",
+"                       1 = faster encoding\n"
+"                       2 = bisection search\n",
+
+"    [-bacache #]   Reuse bit allocation of repeated exponents (default: 0)\n",
 
 "    [-fes #]       Fast exponent strategy decision (default: 0)\n"
 "                       0 = higher quality encoding\n"
-"                       1 = faster encoding\n",
+"                       1 = faster encoding\n"
+"                       2 = search all strategies\n",
 
 "    [-pad #]       Start-of-stream padding\n"
 "                       0 = no padding\n"
@@ -212,7 +225,7 @@ static const char *console_options[CONSOLE_OPTIONS_COUNT] = {
 "                       2 - Shows the statistics for each frame.\n"
 };
 
-#define ENCODING_OPTIONS_COUNT 12
+#define ENCODING_OPTIONS_COUNT 15
 
 static const char encoding_heading[18] = "ENCODING OPTIONS\n";
 static const char *encoding_options[ENCODING_OPTIONS_COUNT] = {
@@ -223,11 +236,36 @@ static const char *encoding_options[ENCODING_OPTIONS_COUNT] = {
 "                       value of 0 is the default and indicates that Aften\n"
 "                       should try to detect the number of CPUs.\n",
 
+"    [-threadmode #] Threading mode\n"
+"                       By default, each thread encodes a separate frame, which\n"
+"                       delays the output by one frame per thread.  Mode 1\n"
+"                       makes all threads work on the same frame, split up by\n"
+"                       channel and block.  It scales less well, but adds no\n"
+"                       latency, which is useful for live encoding.  Mode 2\n"
+"                       is like mode 0, but the CBR rate control runs on one\n"
+"                       frame at a time, in order, so the quality follows one\n"
+"                       smooth path instead of one per thread.  Its output is\n"
+"                       the same as with -threads 1.\n"
+"                       0 = one frame per thread (default)\n"
+"                       1 = split each frame by channel and block\n"
+"                       2 = one frame per thread, rate control in order\n",
+
+"    [-segments #]  Segment-parallel encoding\n"
+"                       For long input files, Aften can split the input into\n"
+"                       # parts and encode them at the same time, each in a\n"
+"                       single thread, then join the results.  The input must\n"
+"                       be a seekable file of known length.  Each part starts\n"
+"                       with a few extra frames to prime the encoder, so the\n"
+"                       joins are seamless.  In CBR mode at 44.1 kHz the\n"
+"                       frame padding pattern restarts in each part.\n"
+"                       0 = encode in one pass (default)\n",
+
 "    [-nosimd X]    Comma-separated list of SIMD instruction sets not to use\n"
 "                       Aften will auto-detect available SIMD instruction sets\n"
 "                       for your CPU, so you shouldn't need to disable sets\n"
 "                       explicitly - unless for speed or debugging reasons.\n"
-"                       Available sets are mmx, sse, sse2, sse3 and altivec.\n"
+"                       Available sets are mmx, sse, sse2, sse3, ssse3, avx2,\n"
+"                       fma and altivec.\n"
 "                       No spaces are allowed between the sets and the commas.\n"
 "                       Example: -nosimd sse2,sse3\n",
 
@@ -253,7 +291,24 @@ static const char *encoding_options[ENCODING_OPTIONS_COUNT] = {
 "                       value to within 16 of the optimal value.  The result"
 "                       is lower overall quality, but faster encoding.  This\n"
 "                       may not give the same results each time when using\n"
-"                       parallel encoding.\n",
+"                       parallel encoding.\n"
+"                       0 = more accurate encoding (default)\n"
+"                       1 = faster encoding\n"
+"                       2 = bisection search.  This steps out from the SNR\n"
+"                           value of the previous frame until the optimal\n"
+"                           value is bracketed, then halves the range.  It\n"
+"                           usually finds the same value as mode 0 with\n"
+"                           fewer bit allocation passes.\n",
+
+"    [-bacache #]   Bit allocation cache\n"
+"                       When a channel's exponents are exactly the same as in\n"
+"                       the last block of the previous frame, the psd, masking\n"
+"                       curve and bit allocation pointers are copied instead\n"
+"                       of computed again.  This speeds up steady or tonal\n"
+"                       material and does not change the output.  With -v 2\n"
+"                       the hit rate is shown.\n"
+"                       0 = off (default)\n"
+"                       1 = on\n",
 
 "    [-fes #]      Fast exponent strategy decision\n"
 "                       By default, the exponent strategy for each channel\n"
@@ -262,7 +317,14 @@ static const char *encoding_options[ENCODING_OPTIONS_COUNT] = {
 "                       option is turned on, the same set is always used\n"
 "                       for every channel in every frame, which leads to\n"
 "                       generally lower quality but gives a significant speed\n"
-"                       increase.\n",
+"                       increase.\n"
+"                       0 = pick the best pre-defined set (default)\n"
+"                       1 = always use the same set\n"
+"                       2 = search the sequences of strategies and reuse\n"
+"                           for each channel, weighing exponent accuracy\n"
+"                           against the bits spent on exponents.  Only D15\n"
+"                           exponents are reused, D25 and D45 are only\n"
+"                           tried for single blocks.\n",
 
 "    [-pad #]      Start-of-stream padding\n"
 "                       The AC-3 format uses an overlap/add cycle for encoding\n"
@@ -69,6 +69,35 @@ print_help(FILE *out)
     fprintf(out, "\n");
 }
 
+void
+print_simd_in_use(FILE *out, AftenSimdInstructions *simd_instructions)
+{
+    fprintf(out, "SIMD usage:");
+    if (simd_instructions->mmx)
+        fprintf(out, " MMX");
+    if (simd_instructions->sse)
+        fprintf(out, " SSE");
+    if (simd_instructions->sse2)
+        fprintf(out, " SSE2");
+    if (simd_instructions->sse3)
+        fprintf(out, " SSE3");
+    if (simd_instructions->ssse3)
+        fprintf(out, " SSSE3");
+    if (simd_instructions->avx2)
+        fprintf(out, " AVX2");
+    if (simd_instructions->fma)
+        fprintf(out, " FMA");
+    if (simd_instructions->amd_3dnow)
+        fprintf(out, " 3DNOW");
+    if (simd_instructions->amd_3dnowext)
+        fprintf(out, " 3DNOWEXT");
+    if (simd_instructions->amd_sse_mmx)
+        fprintf(out, " SSE-MMX");
+    if (simd_instructions->altivec)
+        fprintf(out, " Altivec");
+    fprintf(out, "\n");
+}
+
 static int
 deactivate_simd(char *simd, AftenSimdInstructions *wanted_simd_instructions)
 {
@@ -92,10 +121,16 @@ deactivate_simd(char *simd, AftenSimdInstructions *wanted_simd_instructions)
             wanted_simd_instructions->sse2 = 0;
         else if (!strcmp(&simd[i], "sse3"))
             wanted_simd_instructions->sse3 = 0;
+        else if (!strcmp(&simd[i], "ssse3"))
+            wanted_simd_instructions->ssse3 = 0;
+        else if (!strcmp(&simd[i], "avx2"))
+            wanted_simd_instructions->avx2 = 0;
+        else if (!strcmp(&simd[i], "fma"))
+            wanted_simd_instructions->fma = 0;
         else if (!strcmp(&simd[i], "altivec"))
             wanted_simd_instructions->altivec = 0;
         else {
-            fprintf(stderr, "invalid simd instruction set: %s. must be mmx, sse, sse2, sse3 or altivec.\n", &simd[i]);
+            fprintf(stderr, "invalid simd instruction set: %s. must be mmx, sse, sse2, sse3, ssse3, avx2, fma or altivec.\n", &simd[i]);
             return 1;
         }
         if (last)
@@ -125,6 +160,7 @@ parse_commandline(int argc, char **argv, CommandOptions *opts)
     opts->raw_order = PCM_BYTE_ORDER_LE;
     opts->raw_sr = 48000;
     opts->raw_ch = 2;
+    opts->segments = 0;
 
     for(i=1; i<argc; i++) {
         if(argv[i][0] == '-' && argv[i][1] != '\0') {
@@ -317,17 +353,26 @@ parse_commandline(int argc, char **argv, CommandOptions *opts)
                     i++;
                     if(i >= argc) return 1;
                     opts->s->params.bitalloc_fast = atoi(argv[i]);
-                    if(opts->s->params.bitalloc_fast < 0 || opts->s->params.bitalloc_fast > 1) {
-                        fprintf(stderr, "invalid fba: %d. must be 0 or 1.\n",
+                    if(opts->s->params.bitalloc_fast < 0 || opts->s->params.bitalloc_fast > 2) {
+                        fprintf(stderr, "invalid fba: %d. must be 0 to 2.\n",
                                 opts->s->params.bitalloc_fast);
                         return 1;
                     }
+                } else if(!strncmp(&argv[i][1], "bacache", 8)) {
+                    i++;
+                    if(i >= argc) return 1;
+                    opts->s->params.bitalloc_cache = atoi(argv[i]);
+                    if(opts->s->params.bitalloc_cache < 0 || opts->s->params.bitalloc_cache > 1) {
+                        fprintf(stderr, "invalid bacache: %d. must be 0 or 1.\n",
+                                opts->s->params.bitalloc_cache);
+                        return 1;
+                    }
                 }  else if(!strncmp(&argv[i][1], "fes", 4)) {
                     i++;
                     if(i >= argc) return 1;
                     opts->s->params.expstr_fast = atoi(argv[i]);
-                    if(opts->s->params.expstr_fast < 0 || opts->s->params.expstr_fast > 1) {
-                        fprintf(stderr, "invalid fes: %d. must be 0 or 1.\n",
+                    if(opts->s->params.expstr_fast < 0 || opts->s->params.expstr_fast > 2) {
+                        fprintf(stderr, "invalid fes: %d. must be 0 to 2.\n",
                                 opts->s->params.expstr_fast);
                         return 1;
                     }
@@ -364,6 +409,16 @@ parse_commandline(int argc, char **argv, CommandOptions *opts)
                                 opts->read_to_eof);
                         return 1;
                     }
+                } else if(!strncmp(&argv[i][1], "segments", 9)) {
+                    i++;
+                    if(i >= argc) return 1;
+                    opts->segments = atoi(argv[i]);
+                    if(opts->segments < 0 ||
+                            opts->segments > MAX_NUM_THREADS) {
+                        fprintf(stderr, "invalid segments: %d. must be 0 to %d.\n",
+                                opts->segments, MAX_NUM_THREADS);
+                        return 1;
+                    }
                 } else if(!strncmp(&argv[i][1], "threads", 8)) {
                     i++;
                     if(i >= argc) return 1;
@@ -374,6 +429,16 @@ parse_commandline(int argc, char **argv, CommandOptions *opts)
                                 opts->s->system.n_threads, MAX_NUM_THREADS);
                         return 1;
                     }
+                } else if(!strncmp(&argv[i][1], "threadmode", 11)) {
+                    i++;
+                    if(i >= argc) return 1;
+                    opts->s->system.thread_mode = atoi(argv[i]);
+                    if(opts->s->system.thread_mode < 0 ||
+                            opts->s->system.thread_mode > 2) {
+                        fprintf(stderr, "invalid threadmode: %d. must be 0 to 2.\n",
+                                opts->s->system.thread_mode);
+                        return 1;
+                    }
                 } else if(!strncmp(&argv[i][1], "wmin", 5)) {
                     i++;
                     if(i >= argc) return 1;
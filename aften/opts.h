@@ -41,6 +41,7 @@ typedef struct {
     int raw_order;
     int raw_sr;
     int raw_ch;
+    int segments;
 } CommandOptions;
 
 extern void print_usage(FILE *out);
@@ -49,6 +50,9 @@ extern void print_long_help(FILE *out);
 
 extern void print_help(FILE *out);
 
+extern void print_simd_in_use(FILE *out,
+                              AftenSimdInstructions *simd_instructions);
+
 extern int parse_commandline(int argc, char **argv, CommandOptions *opts);
 
 #endif /* OPTS_H */
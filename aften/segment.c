@@ -0,0 +1,326 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file segment.c
+ * Segment-parallel encoding of seekable input files
+ *
+ * The input is cut into runs of whole frames.  Each run is encoded by its own
+ * context in its own thread, starting a few frames early so that the overlap
+ * buffer and the input filters are in the same state as they would be in a
+ * single pass.  The output of these pre-roll frames is dropped.  A/52 frames
+ * don't depend on each other, so the segment outputs are simply joined.
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "threading.h"
+#include "segment.h"
+
+/** number of frames encoded and dropped before the start of a segment */
+#define SEGMENT_PREROLL_FRAMES 16
+
+/** segments shorter than this are not worth a thread of their own */
+#define SEGMENT_MIN_FRAMES (4 * SEGMENT_PREROLL_FRAMES)
+
+typedef struct {
+    CommandOptions *opts;
+    AftenContext s;
+    PcmFile pf;
+    FILE *ifp;
+    FILE *ofp;              ///< temporary file for the encoded frames
+    uint64_t start_frame;   ///< first frame which is output
+    uint64_t n_frames;      ///< number of frames output, unless last is set
+    int preroll;            ///< number of frames dropped before start_frame
+    int last;               ///< segment runs to the end of the input
+#ifndef NO_THREADS
+    THREAD thread;
+#endif
+
+    // statistics
+    uint32_t bytecount;
+    uint32_t frame_cnt;
+    FLOAT qual;
+    FLOAT bw;
+    int err;
+} Segment;
+
+int
+segments_supported(CommandOptions *opts, PcmFile *pf)
+{
+    if(!strncmp(opts->infile, "-", 2)) {
+        fprintf(stderr, "segments: input is not a file\n");
+        return 0;
+    }
+    if(!pf->seekable || opts->read_to_eof || pf->samples == 0) {
+        fprintf(stderr, "segments: input is not seekable or has unknown length\n");
+        return 0;
+    }
+    if(!opts->pad_start) {
+        fprintf(stderr, "segments: cannot be used with -pad 0\n");
+        return 0;
+    }
+    return 1;
+}
+
+static int
+segment_open(Segment *seg, int read_format)
+{
+    CommandOptions *opts = seg->opts;
+
+    seg->ifp = fopen(opts->infile, "rb");
+    if(!seg->ifp) {
+        fprintf(stderr, "error opening input file: %s\n", opts->infile);
+        return -1;
+    }
+    if(pcmfile_init(&seg->pf, seg->ifp, read_format,
+                    opts->raw_input ? PCM_FORMAT_RAW : PCM_FORMAT_UNKNOWN)) {
+        fprintf(stderr, "invalid input file: %s\n", opts->infile);
+        return -1;
+    }
+    if(opts->raw_input) {
+        seg->pf.sample_rate = opts->raw_sr;
+        seg->pf.channels = opts->raw_ch;
+        pcmfile_set_source(&seg->pf, opts->raw_fmt, opts->raw_order);
+    }
+
+    seg->ofp = tmpfile();
+    if(!seg->ofp) {
+        fprintf(stderr, "error creating temporary file\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void
+segment_close(Segment *seg)
+{
+    aften_encode_close(&seg->s);
+    if(seg->ifp) {
+        pcmfile_close(&seg->pf);
+        fclose(seg->ifp);
+    }
+    if(seg->ofp)
+        fclose(seg->ofp);
+}
+
+/**
+ * Encodes one segment the same way as the main loop in aften.c.  The context
+ * has already been initialized.
+ */
+static int
+encode_segment(Segment *seg)
+{
+    AftenContext *s = &seg->s;
+    uint8_t *frame;
+    FLOAT *fwav;
+    uint64_t cnt;
+    int nr, fs, i;
+    int last_frame = 0;
+
+    frame = calloc(A52_MAX_CODED_FRAME_SIZE, 1);
+    fwav = calloc(A52_SAMPLES_PER_FRAME * s->channels, sizeof(FLOAT));
+    if(frame == NULL || fwav == NULL)
+        goto error;
+
+    if(pcmfile_seek_samples(&seg->pf, (int64_t)(seg->start_frame - seg->preroll) *
+                            A52_SAMPLES_PER_FRAME, PCM_SEEK_SET)) {
+        fprintf(stderr, "error seeking in input file\n");
+        goto error;
+    }
+    for(cnt=0; seg->last || cnt < seg->preroll + seg->n_frames; cnt++) {
+        nr = pcmfile_read_samples(&seg->pf, fwav, A52_SAMPLES_PER_FRAME);
+        if(nr < 0)
+            goto error;
+        // append extra silent frame if final frame is > 1280 samples
+        if(nr == 0 && (!seg->last || last_frame <= 1280))
+            break;
+
+        // zero leftover samples at end of last frame
+        for(i=nr*s->channels; i<A52_SAMPLES_PER_FRAME*s->channels; i++) {
+            fwav[i] = 0.0;
+        }
+
+        fs = aften_encode_frame(s, frame, fwav);
+        if(fs < 0) {
+            fprintf(stderr, "Error encoding frame %d\n",
+                    (int)(seg->start_frame - seg->preroll + cnt));
+            goto error;
+        }
+        if(cnt >= (uint64_t)seg->preroll) {
+            if(fwrite(frame, 1, fs, seg->ofp) != (size_t)fs)
+                goto error;
+            seg->bytecount += fs;
+            seg->frame_cnt++;
+            seg->qual += s->status.quality;
+            seg->bw += s->status.bwcode;
+        }
+        last_frame = nr;
+    }
+
+    free(fwav);
+    free(frame);
+    return 0;
+
+error:
+    free(fwav);
+    free(frame);
+    return -1;
+}
+
+#ifndef NO_THREADS
+static int
+segment_thread(void *vseg)
+{
+    Segment *seg;
+
+#ifdef MINGW_ALIGN_STACK_HACK
+    asm volatile (
+        "movl %%esp, %%ecx\n"
+        "andl $15, %%ecx\n"
+        "subl %%ecx, %%esp\n"
+        "pushl %%ecx\n"
+        "pushl %%ecx\n"
+        "pushl %%ecx\n"
+        "pushl %%ecx\n"
+        : : : "%esp","%ecx");
+#endif
+
+    seg = vseg;
+    seg->err = encode_segment(seg);
+
+#ifdef MINGW_ALIGN_STACK_HACK
+    asm volatile (
+        "popl %%ecx\n"
+        "popl %%ecx\n"
+        "popl %%ecx\n"
+        "popl %%ecx\n"
+        "addl %%ecx, %%esp\n"
+        : : : "%esp", "%ecx");
+#endif
+
+    return 0;
+}
+#endif
+
+/* appends the encoded frames of a segment to the output */
+static int
+copy_segment(Segment *seg, FILE *ofp)
+{
+    uint8_t buf[4096];
+    size_t n;
+
+    rewind(seg->ofp);
+    while((n = fread(buf, 1, sizeof(buf), seg->ofp)) > 0) {
+        if(fwrite(buf, 1, n, ofp) != n)
+            return -1;
+    }
+    return ferror(seg->ofp) ? -1 : 0;
+}
+
+int
+encode_segments(CommandOptions *opts, AftenContext *s, PcmFile *pf,
+                FILE *ofp, int read_format)
+{
+    Segment *segs;
+    uint64_t total_frames, seg_frames;
+    uint32_t bytecount, frame_cnt;
+    FLOAT qual, bw;
+    int i, n_segs, err;
+
+    total_frames = (pf->samples + A52_SAMPLES_PER_FRAME - 1) / A52_SAMPLES_PER_FRAME;
+    n_segs = MAX(opts->segments, 1);
+    n_segs = (int)MIN((uint64_t)n_segs, MAX(total_frames / SEGMENT_MIN_FRAMES, 1));
+    seg_frames = (total_frames + n_segs - 1) / n_segs;
+
+    segs = calloc(n_segs, sizeof(Segment));
+    if(!segs)
+        return 1;
+
+    err = 0;
+    for(i=0; i<n_segs; i++) {
+        Segment *seg = &segs[i];
+        seg->opts = opts;
+        seg->s = *s;
+        // segments are the unit of parallelism
+        seg->s.system.n_threads = 1;
+        seg->start_frame = i * seg_frames;
+        seg->n_frames = MIN(seg_frames, total_frames - seg->start_frame);
+        seg->preroll = (int)MIN(seg->start_frame, SEGMENT_PREROLL_FRAMES);
+        seg->last = (i == n_segs-1);
+        if(segment_open(seg, read_format)) {
+            err = 1;
+            break;
+        }
+        // the library sets up global tables here, so not in the threads
+        if(aften_encode_init(&seg->s)) {
+            fprintf(stderr, "error initializing encoder\n");
+            err = 1;
+            break;
+        }
+    }
+
+    if(!err) {
+        /* print SIMD instructions used */
+        print_simd_in_use(stderr, &segs[0].s.system.wanted_simd_instructions);
+
+        if(s->verbose > 0) {
+            fprintf(stderr, "encoding %d segments of %u frames\n", n_segs,
+                    (uint32_t)seg_frames);
+        }
+#ifndef NO_THREADS
+        for(i=0; i<n_segs; i++)
+            thread_create(&segs[i].thread, segment_thread, &segs[i]);
+        for(i=0; i<n_segs; i++)
+            thread_join(segs[i].thread);
+#else
+        for(i=0; i<n_segs; i++)
+            segs[i].err = encode_segment(&segs[i]);
+#endif
+    }
+
+    bytecount = frame_cnt = 0;
+    qual = bw = 0.0;
+    for(i=0; i<n_segs && !err; i++) {
+        if(segs[i].err || copy_segment(&segs[i], ofp)) {
+            fprintf(stderr, "error encoding segment %d\n", i);
+            err = 1;
+        }
+        bytecount += segs[i].bytecount;
+        frame_cnt += segs[i].frame_cnt;
+        qual += segs[i].qual;
+        bw += segs[i].bw;
+    }
+    for(i=0; i<n_segs; i++)
+        segment_close(&segs[i]);
+    free(segs);
+
+    if(!err && s->verbose > 0 && frame_cnt > 0) {
+        FLOAT kbps = (bytecount * FCONST(8.0) * pf->sample_rate) /
+                     (FCONST(1000.0) * frame_cnt * A52_SAMPLES_PER_FRAME);
+        fprintf(stderr, "\n");
+        fprintf(stderr, "average quality:   %4.1f\n", (qual / frame_cnt));
+        fprintf(stderr, "average bandwidth: %2.1f\n", (bw / frame_cnt));
+        fprintf(stderr, "average bitrate:   %4.1f kbps\n\n", kbps);
+    }
+    return err;
+}
@@ -0,0 +1,48 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file segment.h
+ * Segment-parallel encoding of seekable input files
+ */
+
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdio.h>
+
+#include "aften.h"
+#include "pcm.h"
+#include "opts.h"
+
+/**
+ * Checks whether the input can be split into segments.
+ * Returns 1 if it can, 0 otherwise.
+ */
+extern int segments_supported(CommandOptions *opts, PcmFile *pf);
+
+/**
+ * Splits the input file into opts->segments parts, encodes them at the same
+ * time in separate encoding contexts and writes the joined stream to ofp.
+ * Each context is set up from the parameters in @p s, which must not have
+ * been initialized.  Returns non-zero value if an error occurs.
+ */
+extern int encode_segments(CommandOptions *opts, AftenContext *s, PcmFile *pf,
+                           FILE *ofp, int read_format);
+
+#endif /* SEGMENT_H */
@@ -43,6 +43,42 @@ int FrameEncoder::Encode(unsigned char *frameBuffer, const void *samples)
     return aften_encode_frame(&m_context, frameBuffer, samples);
 }
 
+/// Encodes planar PCM samples to an A/52 frame
+int FrameEncoder::EncodePlanar(unsigned char *frameBuffer, const void *const *planes)
+{
+    return aften_encode_frame_planar(&m_context, frameBuffer, planes);
+}
+
+/// Encodes several frames of PCM samples
+int FrameEncoder::EncodeFrames(unsigned char *frameBuffer, int *frameSizes, const void *samples, int frameCount)
+{
+    return aften_encode_frames(&m_context, frameBuffer, frameSizes, samples, frameCount);
+}
+
+/// Queues PCM samples for encoding
+int FrameEncoder::Submit(const void *samples)
+{
+    return aften_encode_submit(&m_context, samples);
+}
+
+/// Queues PCM samples for encoding straight into frameBuffer
+int FrameEncoder::SubmitTo(const void *samples, unsigned char *frameBuffer)
+{
+    return aften_encode_submit_to(&m_context, samples, frameBuffer);
+}
+
+/// Retrieves the oldest queued frame
+int FrameEncoder::Receive(unsigned char *frameBuffer, bool wait)
+{
+    return aften_encode_receive(&m_context, frameBuffer, wait ? 1 : 0);
+}
+
+/// Gets the number of frames submitted but not yet received
+int FrameEncoder::GetPending()
+{
+    return aften_encode_pending(&m_context);
+}
+
 /// Gets a context with default values
 AftenContext FrameEncoder::GetDefaultsContext()
 {
@@ -49,6 +49,24 @@ public:
     /// Encodes PCM samples to an A/52 frame; returns encoded frame size
     int Encode(unsigned char *frameBuffer, const void *samples);
 
+    /// Encodes planar PCM samples (one buffer per channel) to an A/52 frame; returns encoded frame size
+    int EncodePlanar(unsigned char *frameBuffer, const void *const *planes);
+
+    /// Encodes several frames of PCM samples; returns number of encoded frames
+    int EncodeFrames(unsigned char *frameBuffer, int *frameSizes, const void *samples, int frameCount);
+
+    /// Queues PCM samples for encoding; returns 0 on success, 1 if the queue is full
+    int Submit(const void *samples);
+
+    /// Queues PCM samples for encoding straight into frameBuffer, which must stay valid until received
+    int SubmitTo(const void *samples, unsigned char *frameBuffer);
+
+    /// Retrieves the oldest queued frame; returns encoded frame size or 0 if none is ready
+    int Receive(unsigned char *frameBuffer, bool wait = true);
+
+    /// Gets the number of frames submitted but not yet received
+    int GetPending();
+
     /// Gets a context with default values
     static AftenContext GetDefaultsContext();
 };
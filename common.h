@@ -94,11 +94,14 @@ typedef unsigned __int64 uint64_t;
 
 #if __GNUC__ && !__INTEL_COMPILER
 #define ALIGN16(x) x __attribute__((aligned(16)))
+#define ALIGN32(x) x __attribute__((aligned(32)))
 #else
 #if defined(_MSC_VER) || defined(__INTEL_COMPILER)
 #define ALIGN16(x) __declspec(align(16)) x
+#define ALIGN32(x) __declspec(align(32)) x
 #else
 #define ALIGN16(x) x
+#define ALIGN32(x) x
 #endif
 #endif
 
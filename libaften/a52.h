@@ -34,6 +34,7 @@
 #include "filter.h"
 #include "mdct.h"
 #include "threading.h"
+#include "threadpool.h"
 
 #define AFTEN_VERSION "0.0.8"
 
@@ -71,6 +72,25 @@ log2i(uint32_t v)
     return n;
 }
 
+/**
+ * Exponent of an MDCT coefficient, read from the exponent field of its
+ * floating-point representation.  This is 23 - log2i(|c| * 2^24), or 24 for
+ * coefficients which are 0 at 24-bit precision.
+ */
+static inline int
+coef_exponent(FLOAT c)
+{
+#ifdef CONFIG_DOUBLE
+    union { double f; uint64_t i; } u;
+    u.f = c;
+    return CLIP(1022 - (int)((u.i >> 52) & 0x7FF), 0, 24);
+#else
+    union { float f; uint32_t i; } u;
+    u.f = c;
+    return CLIP(126 - (int)((u.i >> 23) & 0xFF), 0, 24);
+#endif
+}
+
 typedef struct A52Block {
     FLOAT *input_samples[A52_MAX_CHANNELS]; /* 512 per ch */
     FLOAT *mdct_coef[A52_MAX_CHANNELS]; /* 256 per ch */
@@ -82,6 +102,12 @@ typedef struct A52Block {
     uint8_t exp[A52_MAX_CHANNELS][256];
     int16_t psd[A52_MAX_CHANNELS][256];
     int16_t mask[A52_MAX_CHANNELS][50];
+    // exponents of each band as (exponent, number of bins) pairs, used to
+    // count mantissa bits without computing the bap values
+    uint8_t band_exp[A52_MAX_CHANNELS][256];
+    uint8_t band_exp_cnt[A52_MAX_CHANNELS][256];
+    uint8_t band_exp_start[A52_MAX_CHANNELS][51];
+    uint8_t ba_cached[A52_MAX_CHANNELS]; // psd, mask and lists came from the cache
     uint8_t exp_strategy[A52_MAX_CHANNELS];
     uint8_t nexpgrps[A52_MAX_CHANNELS];
     uint8_t grp_exp[A52_MAX_CHANNELS][85];
@@ -105,10 +131,16 @@ typedef struct A52Frame {
     int bwcode;
 
     FLOAT input_audio[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME];
+    FLOAT *input_ptr[A52_MAX_CHANNELS]; // input of each channel; not written to
     A52Block blocks[A52_NUM_BLOCKS];
     int frame_bits;
     int exp_bits;
     int mant_bits;
+    int bit_alloc_evals;         // number of snroffset trials
+    int bap_snroffst;            // snroffset of the current bap values
+    int ba_cache_lookups;        // exponent sets looked up in the cache
+    int ba_cache_hits;           // exponent sets found in the cache
+    int ba_cache_bap_hits;       // of those, the ones with reused bap values
     unsigned int frame_size_min; // minimum frame size
     unsigned int frame_size;     // current frame size in words
     unsigned int frmsizecod;
@@ -123,10 +155,31 @@ typedef struct A52Frame {
     int expstr_set[A52_MAX_CHANNELS];
 } A52Frame;
 
+/**
+ * Bit allocation of the last exponent set of a channel in the previous
+ * frame.  An exponent set which is the same gets the same psd and masking
+ * curve, and also the same bap values if the snroffset is unchanged.
+ */
+typedef struct A52BitAllocCache {
+    int valid;
+    uint32_t hash;
+    int end;
+    int snroffst;
+    A52BitAllocParams params;
+    uint8_t exp[256];
+    int16_t psd[256];
+    int16_t mask[50];
+    uint8_t band_exp[256];
+    uint8_t band_exp_cnt[256];
+    uint8_t band_exp_start[51];
+    uint8_t bap[256];
+} A52BitAllocCache;
+
 typedef struct A52ThreadContext {
     struct A52Context *ctx;
 #ifndef NO_THREADS
     A52ThreadSync ts;
+    ThreadPoolJob job;
 #endif
     ThreadState state;
     int thread_num;
@@ -135,12 +188,13 @@ typedef struct A52ThreadContext {
     AftenStatus status;
     A52Frame frame;
     BitWriter bw;
-    uint8_t frame_buffer[A52_MAX_CODED_FRAME_SIZE];
+    uint8_t *frame_buffer;  // own output buffer, allocated on first use
+    uint8_t *out_buffer;    // where the frame being encoded is written
 
-    uint32_t bit_cnt;
-    uint32_t sample_cnt;
+    int frame_pad;          // CBR frame is one word longer than the minimum
 
     int last_quality;
+    A52BitAllocCache ba_cache[A52_MAX_CHANNELS];
 
     MDCTThreadContext mdct_tctx_512;
     MDCTThreadContext mdct_tctx_256;
@@ -148,17 +202,51 @@ typedef struct A52ThreadContext {
 
 typedef struct A52Context {
     A52ThreadContext *tctx;
-#ifndef NO_THREADS
-    A52GlobalThreadSync ts;
-#endif
     AftenEncParams params;
     AftenMetadata meta;
     void (*fmt_convert_from_src)(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
-          const void *vsrc, int nch, int n);
+          const void *vsrc, const int *chmap, int nch, int n);
+    int chmap[A52_MAX_CHANNELS];    // input channel of each A/52 channel
+    int sample_size;            // size of one input sample in bytes
+    int float_input;            // input samples are FLOAT, so planes can be used in place
     void (*apply_a52_window)(FLOAT *samples);
-    void (*process_exponents)(A52ThreadContext *tctx);
+    void (*process_exponents)(A52ThreadContext *tctx, int ch);
+    // exponent grouping alone, for regrouping at a lower bandwidth
+    void (*group_exponents)(A52ThreadContext *tctx, int ch);
+    // psd and masking curves of all channels of a block
+    void (*bit_alloc_prepare_block)(A52BitAllocParams *s, uint8_t exp[][256],
+                                    int16_t psd[][256], int16_t mask[][50],
+                                    const int *end, int n_channels);
+    // bap values from psd and per-bin masking threshold
+    void (*compute_bap)(uint8_t *bap, const int16_t *psd, const int16_t *thr,
+                        int n);
+    // mantissa bits of bap 5 and up, counts of bap 1 to 4 added to mant_cnt
+    int (*compute_mantissa_size)(int mant_cnt[5], const uint8_t *bap, int n);
 
     int n_threads;
+    int n_channel_threads;
+    AftenThreadPool *pool;      // shared workers, or NULL to use own threads
+    AftenThreadMode thread_mode;
+
+    // rate control state carried between frames in pipeline mode
+    volatile int rc_thread_num; // thread whose frame is next in rate control
+    int last_quality;
+
+    // CBR frame padding counters, advanced in submission order
+    uint32_t bit_cnt;
+    uint32_t sample_cnt;
+
+    // current stage of the frame being encoded in channel threading mode
+    void (*stage_func)(A52ThreadContext *tctx, A52ThreadContext *wctx, int item);
+    int stage_items;            // number of work items in the stage
+    volatile int stage_next;    // next work item to be taken
+
+    // frame queue for aften_encode_submit/aften_encode_receive
+    int queue_depth;    // maximum number of frames in flight
+    int queue_count;    // frames submitted but not yet received
+    int queue_head;     // thread context taking the next submitted frame
+    int queue_tail;     // thread context holding the oldest frame
+
     int n_channels;
     int n_all_channels;
     int acmod;
@@ -35,6 +35,7 @@
 
 #include "a52.h"
 #include "bitalloc.h"
+#include "convert.h"
 #include "crc.h"
 #include "mdct.h"
 #include "window.h"
@@ -78,6 +79,8 @@ const uint16_t a52_bitratetab[19] = {
 
 #ifndef NO_THREADS
 static int threaded_encode(void* vtctx);
+static void pooled_encode(void *vtctx);
+static void pooled_encode_done(void *vtctx);
 #endif
 
 const char *
@@ -111,11 +114,17 @@ set_available_simd_instructions(AftenSimdInstructions *simd_instructions)
 #ifdef HAVE_SSE3
     simd_instructions->sse3 = cpu_caps_have_sse3();
 #endif
-/* Following SIMD code doesn't exist yet, so don't set it available */
-#if 0
 #ifdef HAVE_SSSE3
     simd_instructions->ssse3 = cpu_caps_have_ssse3();
 #endif
+#ifdef HAVE_AVX2
+    simd_instructions->avx2 = cpu_caps_have_avx2();
+#endif
+#ifdef HAVE_FMA
+    simd_instructions->fma = cpu_caps_have_fma();
+#endif
+/* Following SIMD code doesn't exist yet, so don't set it available */
+#if 0
 #ifdef HAVE_HAVE_3DNOW
     simd_instructions->amd_3dnow = cpu_caps_have_3dnow();
 #endif
@@ -134,6 +143,8 @@ set_available_simd_instructions(AftenSimdInstructions *simd_instructions)
 void
 aften_set_defaults(AftenContext *s)
 {
+    int i;
+
     if(s == NULL) {
         fprintf(stderr, "NULL parameter passed to aften_set_defaults\n");
         return;
@@ -149,6 +160,9 @@ aften_set_defaults(AftenContext *s)
     set_available_simd_instructions(&s->system.available_simd_instructions);
     s->system.wanted_simd_instructions = s->system.available_simd_instructions;
     s->system.n_threads = 0;
+    s->system.queue_depth = 0;
+    s->system.thread_mode = AFTEN_THREAD_MODE_FRAME;
+    s->system.thread_pool = NULL;
 
     s->verbose = 1;
     s->channels = -1;
@@ -157,6 +171,9 @@ aften_set_defaults(AftenContext *s)
     s->lfe = -1;
 
     s->sample_format = A52_SAMPLE_FMT_S16;
+    s->channel_order = AFTEN_CH_ORDER_A52;
+    for(i=0; i<6; i++)
+        s->channel_map[i] = i;
     s->private_context = NULL;
     s->params.encoding_mode = AFTEN_ENC_MODE_CBR;
     s->params.bitrate = 0;
@@ -168,6 +185,7 @@ aften_set_defaults(AftenContext *s)
     s->params.use_dc_filter = 0;
     s->params.use_lfe_filter = 0;
     s->params.bitalloc_fast = 0;
+    s->params.bitalloc_cache = 0;
     s->params.expstr_fast = 0;
     s->params.dynrng_profile = DYNRNG_PROFILE_NONE;
     s->params.min_bwcode = 0;
@@ -191,124 +209,22 @@ aften_set_defaults(AftenContext *s)
     s->status.quality = 0;
     s->status.bit_rate = 0;
     s->status.bwcode = 0;
-}
-
-static void
-fmt_convert_from_u8(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
-                    const void *vsrc, int nch, int n)
-{
-    int i, j, ch;
-    const uint8_t *src = vsrc;
-
-    for(ch=0; ch<nch; ch++) {
-        FLOAT *dest_ch = dest[ch];
-        const uint8_t *src_ch = src + ch;
-        for(i=0, j=0; i<n; i++, j+=nch) {
-            dest_ch[i] = (src_ch[j]-FCONST(128.0)) / FCONST(128.0);
-        }
-    }
-}
-
-static void
-fmt_convert_from_s16(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
-                     const void *vsrc, int nch, int n)
-{
-    int i, j, ch;
-    const int16_t *src = vsrc;
-
-    for(ch=0; ch<nch; ch++) {
-        FLOAT *dest_ch = dest[ch];
-        const int16_t *src_ch = src + ch;
-        for(i=0, j=0; i<n; i++, j+=nch) {
-            dest_ch[i] = src_ch[j] / FCONST(32768.0);
-        }
-    }
-}
-
-static void
-fmt_convert_from_s20(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
-                     const void *vsrc, int nch, int n)
-{
-    int i, j, ch;
-    const int32_t *src = vsrc;
-
-    for(ch=0; ch<nch; ch++) {
-        FLOAT *dest_ch = dest[ch];
-        const int32_t *src_ch = src + ch;
-        for(i=0, j=0; i<n; i++, j+=nch) {
-            dest_ch[i] = src_ch[j] / FCONST(524288.0);
-        }
-    }
-}
-
-static void
-fmt_convert_from_s24(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
-                     const void *vsrc, int nch, int n)
-{
-    int i, j, ch;
-    const int32_t *src = vsrc;
-
-    for(ch=0; ch<nch; ch++) {
-        FLOAT *dest_ch = dest[ch];
-        const int32_t *src_ch = src + ch;
-        for(i=0, j=0; i<n; i++, j+=nch) {
-            dest_ch[i] = src_ch[j] / FCONST(8388608.0);
-        }
-    }
-}
-
-static void
-fmt_convert_from_s32(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
-                     const void *vsrc, int nch, int n)
-{
-    int i, j, ch;
-    const int32_t *src = vsrc;
-
-    for(ch=0; ch<nch; ch++) {
-        FLOAT *dest_ch = dest[ch];
-        const int32_t *src_ch = src + ch;
-        for(i=0, j=0; i<n; i++, j+=nch) {
-            dest_ch[i] = src_ch[j] / FCONST(2147483648.0);
-        }
-    }
-}
-
-static void
-fmt_convert_from_float(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
-                       const void *vsrc, int nch, int n)
-{
-    int i, j, ch;
-    const float *src = vsrc;
-
-    for(ch=0; ch<nch; ch++) {
-        FLOAT *dest_ch = dest[ch];
-        const float *src_ch = src + ch;
-        for(i=0, j=0; i<n; i++, j+=nch) {
-            dest_ch[i] = src_ch[j];
-        }
-    }
-}
-
-static void
-fmt_convert_from_double(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
-                        const void *vsrc, int nch, int n)
-{
-    int i, j, ch;
-    const double *src = vsrc;
-
-    for(ch=0; ch<nch; ch++) {
-        FLOAT *dest_ch = dest[ch];
-        const double *src_ch = src + ch;
-        for(i=0, j=0; i<n; i++, j+=nch) {
-            dest_ch[i] = (FLOAT)src_ch[j];
-        }
-    }
+    s->status.bit_alloc_evals = 0;
+    s->status.ba_cache_lookups = 0;
+    s->status.ba_cache_hits = 0;
+    s->status.ba_cache_bap_hits = 0;
 }
 
 static void
 select_mdct(A52Context *ctx)
 {
 #ifndef CONFIG_DOUBLE
+#ifdef HAVE_FMA
+    if (cpu_caps_have_avx2() && cpu_caps_have_fma()) {
+        avx2_mdct_init(ctx);
+        return;
+    }
+#endif
 #ifdef HAVE_SSE3
     if (cpu_caps_have_sse3()) {
         sse3_mdct_init(ctx);
@@ -327,6 +243,19 @@ select_mdct(A52Context *ctx)
         return;
     }
 #endif
+#else
+#ifdef HAVE_FMA
+    if (cpu_caps_have_avx2() && cpu_caps_have_fma()) {
+        avx2_mdct_init(ctx);
+        return;
+    }
+#endif
+#ifdef HAVE_SSE2
+    if (cpu_caps_have_sse2()) {
+        sse2_mdct_init(ctx);
+        return;
+    }
+#endif
 #endif /* CONFIG_DOUBLE */
     mdct_init(ctx);
 }
@@ -335,6 +264,12 @@ static void
 select_mdct_thread(A52ThreadContext *tctx)
 {
 #ifndef CONFIG_DOUBLE
+#ifdef HAVE_FMA
+    if (cpu_caps_have_avx2() && cpu_caps_have_fma()) {
+        avx2_mdct_thread_init(tctx);
+        return;
+    }
+#endif
 #ifdef HAVE_SSE3
     if (cpu_caps_have_sse3()) {
         sse3_mdct_thread_init(tctx);
@@ -380,24 +315,6 @@ aften_encode_init(AftenContext *s)
     select_mdct(ctx);
     s->private_context = ctx;
 
-    switch(s->sample_format) {
-        case A52_SAMPLE_FMT_U8:  ctx->fmt_convert_from_src = fmt_convert_from_u8;
-                                 break;
-        case A52_SAMPLE_FMT_S16: ctx->fmt_convert_from_src = fmt_convert_from_s16;
-                                 break;
-        case A52_SAMPLE_FMT_S20: ctx->fmt_convert_from_src = fmt_convert_from_s20;
-                                 break;
-        case A52_SAMPLE_FMT_S24: ctx->fmt_convert_from_src = fmt_convert_from_s24;
-                                 break;
-        case A52_SAMPLE_FMT_S32: ctx->fmt_convert_from_src = fmt_convert_from_s32;
-                                 break;
-        case A52_SAMPLE_FMT_FLT: ctx->fmt_convert_from_src = fmt_convert_from_float;
-                                 break;
-        case A52_SAMPLE_FMT_DBL: ctx->fmt_convert_from_src = fmt_convert_from_double;
-                                 break;
-        default: break;
-    }
-
     // channel configuration
     if(s->channels < 1 || s->channels > 6) {
         fprintf(stderr, "invalid number of channels\n");
@@ -421,6 +338,10 @@ aften_encode_init(AftenContext *s)
     ctx->n_channels = s->channels - s->lfe;
     ctx->lfe_channel = s->lfe ? (s->channels - 1) : -1;
 
+    // sample format and channel order
+    if(fmt_convert_init(ctx, s))
+        return -1;
+
     ctx->params = s->params;
     ctx->meta = s->meta;
 
@@ -483,7 +404,7 @@ aften_encode_init(AftenContext *s)
     ctx->frmsizecod = i*2;
     ctx->target_bitrate = a52_bitratetab[i] >> ctx->halfratecod;
 
-    bitalloc_init();
+    bitalloc_init(ctx);
     crc_init();
     a52_window_init(ctx);
     exponent_init(ctx);
@@ -502,54 +423,75 @@ aften_encode_init(AftenContext *s)
     }
 
     // Initialize thread specific contexts
-    ctx->n_threads = (s->system.n_threads > 0) ? s->system.n_threads : get_ncpus();
+    ctx->pool = NULL;
+#ifndef NO_THREADS
+    ctx->pool = s->system.thread_pool;
+#endif
+    if (s->system.n_threads > 0)
+        ctx->n_threads = s->system.n_threads;
+    else
+        ctx->n_threads = ctx->pool ? ctx->pool->n_threads : get_ncpus();
     ctx->n_threads = MIN(ctx->n_threads, MAX_NUM_THREADS);
     s->system.n_threads = ctx->n_threads;
-    tctx = calloc(sizeof(A52ThreadContext), ctx->n_threads);
+    ctx->thread_mode = s->system.thread_mode;
+    ctx->last_quality = last_quality;
+    ctx->bit_cnt = 0;
+    ctx->sample_cnt = 0;
+    ctx->rc_thread_num = 0;
+    ctx->n_channel_threads = 1;
+#ifndef NO_THREADS
+    // in channel mode all threads work on one frame at a time
+    if (s->system.thread_mode == AFTEN_THREAD_MODE_CHANNEL && !ctx->pool) {
+        ctx->n_channel_threads = ctx->n_threads;
+        ctx->n_threads = 1;
+    }
+#endif
+    ctx->queue_depth = ctx->n_threads;
+    if (s->system.queue_depth > 0)
+        ctx->queue_depth = MIN(s->system.queue_depth, ctx->n_threads);
+    s->system.queue_depth = ctx->queue_depth;
+    tctx = calloc(sizeof(A52ThreadContext),
+                  MAX(ctx->n_threads, ctx->n_channel_threads));
     ctx->tctx = tctx;
 
-    for (j=0; j<ctx->n_threads; ++j) {
+    for (j=0; j<MAX(ctx->n_threads, ctx->n_channel_threads); ++j) {
         A52ThreadContext *cur_tctx = &ctx->tctx[j];
         cur_tctx->ctx = ctx;
         cur_tctx->thread_num = j;
 
         select_mdct_thread(cur_tctx);
 
-        cur_tctx->bit_cnt = 0;
-        cur_tctx->sample_cnt = 0;
-
         cur_tctx->last_quality = last_quality;
 
+#ifndef NO_THREADS
         if (ctx->n_threads > 1) {
             cur_tctx->state = START;
 
-            posix_cond_init(&cur_tctx->ts.enter_cond);
-            posix_cond_init(&cur_tctx->ts.confirm_cond);
-            posix_cond_init(&cur_tctx->ts.samples_cond);
+            thread_event_init(&cur_tctx->ts.enter_event);
+            thread_event_init(&cur_tctx->ts.ready_event);
+            thread_event_init(&cur_tctx->ts.rc_event);
+            cur_tctx->ts.next_rc_event =
+                &ctx->tctx[(j + 1) % ctx->n_threads].ts.rc_event;
 
-            posix_mutex_init(&cur_tctx->ts.enter_mutex);
-            posix_mutex_init(&cur_tctx->ts.confirm_mutex);
+            if (ctx->pool) {
+                cur_tctx->job.func = pooled_encode;
+                cur_tctx->job.done = pooled_encode_done;
+                cur_tctx->job.arg = cur_tctx;
+            } else {
+                thread_create(&cur_tctx->ts.thread, threaded_encode, cur_tctx);
+            }
+        } else if (j > 0) {
+            // helper thread for channel mode
+            cur_tctx->state = START;
 
-            windows_event_init(&cur_tctx->ts.ready_event);
-            windows_event_init(&cur_tctx->ts.enter_event);
-            windows_event_init(&cur_tctx->ts.samples_event);
+            thread_event_init(&cur_tctx->ts.enter_event);
+            thread_event_init(&cur_tctx->ts.ready_event);
+            thread_event_init(&cur_tctx->ts.rc_event);
 
-            posix_mutex_lock(&cur_tctx->ts.enter_mutex);
             thread_create(&cur_tctx->ts.thread, threaded_encode, cur_tctx);
-            posix_cond_wait(&cur_tctx->ts.enter_cond, &cur_tctx->ts.enter_mutex);
-            posix_mutex_unlock(&cur_tctx->ts.enter_mutex);
         }
-    }
-    for (j=0; j<ctx->n_threads; ++j) {
-#ifdef HAVE_POSIX_THREADS
-        ctx->tctx[j].ts.next_samples_cond = &ctx->tctx[(j + 1) % ctx->n_threads].ts.samples_cond;
-#endif
-#ifdef HAVE_WINDOWS_THREADS
-        ctx->tctx[j].ts.next_samples_event = &ctx->tctx[(j + 1) % ctx->n_threads].ts.samples_event;
 #endif
     }
-    posix_mutex_init(&ctx->ts.samples_mutex);
-    windows_cs_init(&ctx->ts.samples_cs);
 
     if(s->params.bwcode < -2 || s->params.bwcode > 60) {
         fprintf(stderr, "invalid bandwidth code\n");
@@ -681,6 +623,11 @@ frame_init(A52ThreadContext *tctx)
         }
     }
 
+    frame->bit_alloc_evals = 0;
+    frame->ba_cache_lookups = 0;
+    frame->ba_cache_hits = 0;
+    frame->ba_cache_bap_hits = 0;
+
     if(ctx->params.encoding_mode == AFTEN_ENC_MODE_CBR) {
         frame->bit_rate = ctx->target_bitrate;
         frame->frmsizecod = ctx->frmsizecod;
@@ -868,25 +815,27 @@ quant_mant_ch(FLOAT *mdct_coef, uint8_t *exp, uint8_t *bap, uint16_t *qmant,
     }
 }
 
+/**
+ * Quantizes the mantissas of all channels in a block.  Grouped mantissas can
+ * span channels, so a block is the smallest independent unit.
+ */
 static void
-quantize_mantissas(A52ThreadContext *tctx)
+quantize_mantissas(A52ThreadContext *tctx, A52ThreadContext *wctx, int blk)
 {
     A52Context *ctx = tctx->ctx;
     A52Frame *frame = &tctx->frame;
-    A52Block *block;
+    A52Block *block = &frame->blocks[blk];
     uint16_t *qmant_ptr[3];
-    int blk, ch;
+    int ch;
     int mant_cnt[3];
 
-    for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-        block = &frame->blocks[blk];
-        mant_cnt[0] = mant_cnt[1] = mant_cnt[2] = 0;
-        qmant_ptr[0] = qmant_ptr[1] = qmant_ptr[2] = NULL;
-        for(ch=0; ch<ctx->n_all_channels; ch++) {
-            quant_mant_ch(block->mdct_coef[ch], block->exp[ch], block->bap[ch],
-                          block->qmant[ch], frame->ncoefs[ch], qmant_ptr,
-                          mant_cnt);
-        }
+    (void)wctx;
+    mant_cnt[0] = mant_cnt[1] = mant_cnt[2] = 0;
+    qmant_ptr[0] = qmant_ptr[1] = qmant_ptr[2] = NULL;
+    for(ch=0; ch<ctx->n_all_channels; ch++) {
+        quant_mant_ch(block->mdct_coef[ch], block->exp[ch], block->bap[ch],
+                      block->qmant[ch], frame->ncoefs[ch], qmant_ptr,
+                      mant_cnt);
     }
 }
 
@@ -1060,98 +1009,76 @@ output_frame_end(A52ThreadContext *tctx)
     return (fs << 1);
 }
 
+/**
+ * Runs the input filters on one channel and splits the filtered samples into
+ * overlapping blocks.  The filters and the overlap carry state from one frame
+ * to the next, so frames must pass through here in order.
+ */
 static void
-copy_samples(A52ThreadContext *tctx)
+copy_samples(A52ThreadContext *tctx, A52ThreadContext *wctx, int ch)
 {
     A52Context *ctx = tctx->ctx;
     A52Frame *frame = &tctx->frame;
     FLOAT buffer[A52_SAMPLES_PER_FRAME];
     FLOAT *in_audio;
     FLOAT *out_audio;
-    FLOAT *temp;
-    int ch, blk;
-#define SWAP_BUFFERS temp=in_audio;in_audio=out_audio;out_audio=temp;
-
-#ifndef NO_THREADS
-    if (ctx->n_threads > 1) {
-        posix_mutex_lock(&ctx->ts.samples_mutex);
-
-        windows_cs_enter(&ctx->ts.samples_cs);
-
-        while (ctx->ts.samples_thread_num != tctx->thread_num) {
-            posix_cond_wait(&tctx->ts.samples_cond, &ctx->ts.samples_mutex);
-
-            windows_cs_leave(&ctx->ts.samples_cs);
-            windows_event_wait(&tctx->ts.samples_event);
-            windows_cs_enter(&ctx->ts.samples_cs);
-        }
-        windows_event_reset(&tctx->ts.samples_event);
-    }
-#endif
-    for(ch=0; ch<ctx->n_all_channels; ch++) {
-        out_audio = buffer;
-        in_audio = frame->input_audio[ch];
-        // DC-removal high-pass filter
-        if(ctx->params.use_dc_filter) {
-            filter_run(&ctx->dc_filter[ch], out_audio, in_audio,
+    int blk;
+    /* the filter output becomes the next input; the source may be the
+       caller's memory, so it is never used as an output */
+#define SWAP_BUFFERS in_audio=out_audio;\
+        out_audio=(out_audio==buffer)?frame->input_audio[ch]:buffer;
+
+    (void)wctx;
+    out_audio = buffer;
+    in_audio = frame->input_ptr[ch];
+    // DC-removal high-pass filter
+    if(ctx->params.use_dc_filter) {
+        filter_run(&ctx->dc_filter[ch], out_audio, in_audio,
+                   A52_SAMPLES_PER_FRAME);
+        SWAP_BUFFERS
+    }
+    if (ch < ctx->n_channels) {
+        // channel bandwidth filter
+        if(ctx->params.use_bw_filter) {
+            filter_run(&ctx->bw_filter[ch], out_audio, in_audio,
                        A52_SAMPLES_PER_FRAME);
             SWAP_BUFFERS
         }
-        if (ch < ctx->n_channels) {
-            // channel bandwidth filter
-            if(ctx->params.use_bw_filter) {
-                filter_run(&ctx->bw_filter[ch], out_audio, in_audio,
-                           A52_SAMPLES_PER_FRAME);
-                SWAP_BUFFERS
-            }
-            // block-switching high-pass filter
-            if(ctx->params.use_block_switching) {
-                filter_run(&ctx->bs_filter[ch], out_audio, in_audio,
-                           A52_SAMPLES_PER_FRAME);
-                memcpy(frame->blocks[0].transient_samples[ch],
-                       ctx->last_transient_samples[ch], 256 * sizeof(FLOAT));
-                memcpy(&frame->blocks[0].transient_samples[ch][256], out_audio,
-                       256 * sizeof(FLOAT));
-                for(blk=1; blk<A52_NUM_BLOCKS; blk++) {
-                    memcpy(frame->blocks[blk].transient_samples[ch],
-                           &out_audio[256*(blk-1)], 512 * sizeof(FLOAT));
-                }
-                memcpy(ctx->last_transient_samples[ch],
-                       &out_audio[256*5], 256 * sizeof(FLOAT));
-            }
-        } else {
-            // LFE bandwidth low-pass filter
-            if(ctx->params.use_lfe_filter) {
-                assert(ch == ctx->lfe_channel);
-                filter_run(&ctx->lfe_filter, out_audio, in_audio,
-                           A52_SAMPLES_PER_FRAME);
-                SWAP_BUFFERS
+        // block-switching high-pass filter
+        if(ctx->params.use_block_switching) {
+            filter_run(&ctx->bs_filter[ch], out_audio, in_audio,
+                       A52_SAMPLES_PER_FRAME);
+            memcpy(frame->blocks[0].transient_samples[ch],
+                   ctx->last_transient_samples[ch], 256 * sizeof(FLOAT));
+            memcpy(&frame->blocks[0].transient_samples[ch][256], out_audio,
+                   256 * sizeof(FLOAT));
+            for(blk=1; blk<A52_NUM_BLOCKS; blk++) {
+                memcpy(frame->blocks[blk].transient_samples[ch],
+                       &out_audio[256*(blk-1)], 512 * sizeof(FLOAT));
             }
+            memcpy(ctx->last_transient_samples[ch],
+                   &out_audio[256*5], 256 * sizeof(FLOAT));
         }
-
-        memcpy(frame->blocks[0].input_samples[ch], ctx->last_samples[ch],
-               256 * sizeof(FLOAT));
-        memcpy(&frame->blocks[0].input_samples[ch][256], in_audio,
-               256 * sizeof(FLOAT));
-        for(blk=1; blk<A52_NUM_BLOCKS; blk++) {
-            memcpy(frame->blocks[blk].input_samples[ch], &in_audio[256*(blk-1)],
-                   512 * sizeof(FLOAT));
+    } else {
+        // LFE bandwidth low-pass filter
+        if(ctx->params.use_lfe_filter) {
+            assert(ch == ctx->lfe_channel);
+            filter_run(&ctx->lfe_filter, out_audio, in_audio,
+                       A52_SAMPLES_PER_FRAME);
+            SWAP_BUFFERS
         }
-        memcpy(ctx->last_samples[ch],
-               &in_audio[256*5], 256 * sizeof(FLOAT));
     }
-#ifndef NO_THREADS
-    if (ctx->n_threads > 1) {
-        ++ctx->ts.samples_thread_num;
-        ctx->ts.samples_thread_num %= ctx->n_threads;
 
-        posix_cond_signal(tctx->ts.next_samples_cond);
-        posix_mutex_unlock(&ctx->ts.samples_mutex);
-
-        windows_event_set(tctx->ts.next_samples_event);
-        windows_cs_leave(&ctx->ts.samples_cs);
+    memcpy(frame->blocks[0].input_samples[ch], ctx->last_samples[ch],
+           256 * sizeof(FLOAT));
+    memcpy(&frame->blocks[0].input_samples[ch][256], in_audio,
+           256 * sizeof(FLOAT));
+    for(blk=1; blk<A52_NUM_BLOCKS; blk++) {
+        memcpy(frame->blocks[blk].input_samples[ch], &in_audio[256*(blk-1)],
+               512 * sizeof(FLOAT));
     }
-#endif
+    memcpy(ctx->last_samples[ch],
+           &in_audio[256*5], 256 * sizeof(FLOAT));
 #undef SWAP_BUFFERS
 }
 
@@ -1208,34 +1135,76 @@ detect_transient(FLOAT *in)
     return 0;
 }
 
+/**
+ * Number of work items of generate_coefs.  With a batched MDCT, the
+ * (channel, block) pairs are split evenly into items of up to MDCT_BATCH_MAX
+ * pairs, and the long blocks of an item are transformed together if there are
+ * at least MDCT_BATCH_MIN of them.
+ */
+static int
+coef_groups(A52Context *ctx)
+{
+    int pairs = ctx->n_all_channels * A52_NUM_BLOCKS;
+
+    if(!ctx->mdct_ctx_512.mdct_batch)
+        return pairs;
+    return (pairs + MDCT_BATCH_MAX - 1) / MDCT_BATCH_MAX;
+}
+
+/**
+ * Runs transient detection, windowing and the MDCT for the pairs of group
+ * item, see coef_groups().  Pair k of the frame is channel k / A52_NUM_BLOCKS
+ * and block k % A52_NUM_BLOCKS.  The MDCT uses the scratch buffers of wctx,
+ * and also gives the exponents of the coefficients.
+ */
 static void
-generate_coefs(A52ThreadContext *tctx)
+generate_coefs(A52ThreadContext *tctx, A52ThreadContext *wctx, int item)
 {
     A52Context *ctx = tctx->ctx;
+    A52Frame *frame = &tctx->frame;
+    FLOAT *in[MDCT_BATCH_MAX], *out[MDCT_BATCH_MAX];
+    uint8_t *exp[MDCT_BATCH_MAX];
+    int pairs = ctx->n_all_channels * A52_NUM_BLOCKS;
+    int groups = coef_groups(ctx);
+    int first = item * pairs / groups;
+    int last = (item + 1) * pairs / groups;
+    int count = 0;
+    int ch, i, k;
     A52Block *block;
-    void (*mdct_256)(struct A52ThreadContext *tctx, FLOAT *out, FLOAT *in) =
-        ctx->mdct_ctx_256.mdct;
-    void (*mdct_512)(struct A52ThreadContext *tctx, FLOAT *out, FLOAT *in) =
-        ctx->mdct_ctx_512.mdct;
-    int blk, ch, i;
 
-    for(ch=0; ch<ctx->n_all_channels; ch++) {
-        for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-            block = &tctx->frame.blocks[blk];
-            if(ctx->params.use_block_switching) {
-                block->blksw[ch] = detect_transient(block->transient_samples[ch]);
-            } else {
-                block->blksw[ch] = 0;
-            }
-            ctx->apply_a52_window(block->input_samples[ch]);
-            if(block->blksw[ch]) {
-                mdct_256(tctx, block->mdct_coef[ch], block->input_samples[ch]);
-            } else {
-                mdct_512(tctx, block->mdct_coef[ch], block->input_samples[ch]);
-            }
-            for(i=tctx->frame.ncoefs[ch]; i<256; i++) {
-                block->mdct_coef[ch][i] = 0.0;
-            }
+    for(k=first; k<last; k++) {
+        ch = k / A52_NUM_BLOCKS;
+        block = &frame->blocks[k % A52_NUM_BLOCKS];
+
+        if(ctx->params.use_block_switching) {
+            block->blksw[ch] = detect_transient(block->transient_samples[ch]);
+        } else {
+            block->blksw[ch] = 0;
+        }
+        ctx->apply_a52_window(block->input_samples[ch]);
+        if(block->blksw[ch]) {
+            ctx->mdct_ctx_256.mdct(wctx, block->mdct_coef[ch], block->exp[ch],
+                                   block->input_samples[ch]);
+        } else {
+            in[count] = block->input_samples[ch];
+            out[count] = block->mdct_coef[ch];
+            exp[count] = block->exp[ch];
+            count++;
+        }
+    }
+    if(count >= MDCT_BATCH_MIN) {
+        ctx->mdct_ctx_512.mdct_batch(wctx, out, exp, in, count);
+    } else {
+        for(k=0; k<count; k++)
+            ctx->mdct_ctx_512.mdct(wctx, out[k], exp[k], in[k]);
+    }
+
+    for(k=first; k<last; k++) {
+        ch = k / A52_NUM_BLOCKS;
+        block = &frame->blocks[k % A52_NUM_BLOCKS];
+        for(i=frame->ncoefs[ch]; i<256; i++) {
+            block->mdct_coef[ch][i] = 0.0;
+            block->exp[ch][i] = 24;
         }
     }
 }
@@ -1288,6 +1257,8 @@ calc_rematrixing(A52ThreadContext *tctx)
                     ctmp2 = block->mdct_coef[1][i] * FCONST(0.5);
                     block->mdct_coef[0][i] = ctmp1 + ctmp2;
                     block->mdct_coef[1][i] = ctmp1 - ctmp2;
+                    block->exp[0][i] = coef_exponent(block->mdct_coef[0][i]);
+                    block->exp[1][i] = coef_exponent(block->mdct_coef[1][i]);
                 }
             }
             if(blk != 0 && block->rematstr == 0 &&
@@ -1298,22 +1269,28 @@ calc_rematrixing(A52ThreadContext *tctx)
     }
 }
 
-/** Adjust for fractional frame sizes in CBR mode */
+/**
+ * Adjust for fractional frame sizes in CBR mode.  Which frames are padded
+ * only depends on the frames before, so this is decided in submission order
+ * and every threading mode pads the same frames as a single thread does.
+ */
 static void
 adjust_frame_size(A52ThreadContext *tctx)
 {
     A52Context *ctx = tctx->ctx;
-    A52Frame *f = &tctx->frame;
-    uint32_t kbps = f->bit_rate * 1000;
+    uint32_t kbps = ctx->target_bitrate * 1000;
     uint32_t srate = ctx->sample_rate;
-    int add;
+    int frame_size_min = ctx->target_bitrate * 96000 / srate;
 
-    while(tctx->bit_cnt >= kbps && tctx->sample_cnt >= srate) {
-        tctx->bit_cnt -= kbps;
-        tctx->sample_cnt -= srate;
+    while(ctx->bit_cnt >= kbps && ctx->sample_cnt >= srate) {
+        ctx->bit_cnt -= kbps;
+        ctx->sample_cnt -= srate;
     }
-    add = !!(tctx->bit_cnt * srate < tctx->sample_cnt * kbps);
-    f->frame_size = f->frame_size_min + add;
+    tctx->frame_pad = !!(ctx->bit_cnt * srate < ctx->sample_cnt * kbps);
+
+    // increment counters
+    ctx->bit_cnt += (frame_size_min + tctx->frame_pad) * 16;
+    ctx->sample_cnt += A52_SAMPLES_PER_FRAME;
 }
 
 static void
@@ -1357,6 +1334,152 @@ calculate_dynrng(A52ThreadContext *tctx)
     }
 }
 
+static void
+process_exponents(A52ThreadContext *tctx, A52ThreadContext *wctx, int ch)
+{
+    (void)wctx;
+    tctx->ctx->process_exponents(tctx, ch);
+}
+
+static void
+regroup_exponents(A52ThreadContext *tctx, A52ThreadContext *wctx, int ch)
+{
+    (void)wctx;
+    regroup_exponents_ch(tctx, ch);
+}
+
+/* all channels of a block are prepared together */
+static void
+bit_alloc_prepare(A52ThreadContext *tctx, A52ThreadContext *wctx, int blk)
+{
+    (void)wctx;
+    bit_alloc_prepare_blk(tctx, blk);
+}
+
+#ifndef NO_THREADS
+/* runs the items of the current stage which no other thread has taken yet */
+static void
+run_stage_items(A52ThreadContext *tctx, A52ThreadContext *wctx)
+{
+    A52Context *ctx = tctx->ctx;
+    int item;
+
+    while((item = thread_atomic_inc(&ctx->stage_next)) < ctx->stage_items)
+        ctx->stage_func(tctx, wctx, item);
+}
+#endif
+
+/**
+ * Runs func for each of n_items independent work items of a frame.  In
+ * channel threading mode the items are shared out to all threads, and the
+ * call returns when all of them are done.
+ */
+static void
+run_stage(A52ThreadContext *tctx,
+          void (*func)(A52ThreadContext *tctx, A52ThreadContext *wctx, int item),
+          int n_items)
+{
+    A52Context *ctx = tctx->ctx;
+    int i;
+
+#ifndef NO_THREADS
+    if (ctx->n_channel_threads > 1) {
+        ctx->stage_func = func;
+        ctx->stage_items = n_items;
+        ctx->stage_next = 0;
+        for (i=1; i<ctx->n_channel_threads; i++) {
+            A52ThreadContext *wctx = &ctx->tctx[i];
+            thread_event_post(&wctx->ts.enter_event, &wctx->ts.head, !wctx->ts.head);
+        }
+        run_stage_items(tctx, tctx);
+        for (i=1; i<ctx->n_channel_threads; i++) {
+            A52ThreadContext *wctx = &ctx->tctx[i];
+            thread_event_wait(&wctx->ts.ready_event, &wctx->ts.tail, wctx->ts.head);
+        }
+        return;
+    }
+#endif
+    for (i=0; i<n_items; i++)
+        func(tctx, tctx, i);
+}
+
+/**
+ * In pipeline mode, waits until all earlier frames have been through rate
+ * control, then takes over the rate control state they left behind.  This
+ * makes the output identical to single-threaded encoding.
+ */
+static void
+rate_control_enter(A52ThreadContext *tctx)
+{
+#ifndef NO_THREADS
+    A52Context *ctx = tctx->ctx;
+
+    if (ctx->thread_mode == AFTEN_THREAD_MODE_PIPELINE && ctx->n_threads > 1) {
+        thread_event_wait(&tctx->ts.rc_event, &ctx->rc_thread_num,
+                          tctx->thread_num);
+        tctx->last_quality = ctx->last_quality;
+    }
+#endif
+}
+
+/** hands the rate control state on to the next frame */
+static void
+rate_control_leave(A52ThreadContext *tctx)
+{
+#ifndef NO_THREADS
+    A52Context *ctx = tctx->ctx;
+
+    if (ctx->thread_mode == AFTEN_THREAD_MODE_PIPELINE && ctx->n_threads > 1) {
+        ctx->last_quality = tctx->last_quality;
+        thread_event_post(tctx->ts.next_rc_event, &ctx->rc_thread_num,
+                          (tctx->thread_num + 1) % ctx->n_threads);
+    }
+#endif
+}
+
+/**
+ * Takes one frame of input for tctx, either interleaved in samples or one
+ * plane per channel in planes.  This runs in the calling thread, in
+ * submission order, so the encoding threads never wait for each other's
+ * input.  In channel threading mode the channels are filtered in parallel.
+ */
+static void
+prepare_input(A52ThreadContext *tctx, const void *samples,
+              const void *const *planes)
+{
+    A52Context *ctx = tctx->ctx;
+    A52Frame *frame = &tctx->frame;
+    int ch;
+
+    if(ctx->params.encoding_mode == AFTEN_ENC_MODE_CBR) {
+        adjust_frame_size(tctx);
+    }
+
+    if (planes) {
+        static const int plane_chmap[1] = { 0 };
+
+        for (ch=0; ch<ctx->n_all_channels; ch++) {
+            const void *plane = planes[ctx->chmap[ch]];
+            if (ctx->float_input) {
+                // only read by copy_samples, before the call returns
+                frame->input_ptr[ch] = (FLOAT *)plane;
+            } else {
+                ctx->fmt_convert_from_src(&frame->input_audio[ch], plane,
+                                          plane_chmap, 1, A52_SAMPLES_PER_FRAME);
+                frame->input_ptr[ch] = frame->input_audio[ch];
+            }
+        }
+    } else {
+        // convert sample format, de-interleave and reorder channels
+        ctx->fmt_convert_from_src(frame->input_audio, samples, ctx->chmap,
+                                  ctx->n_all_channels, A52_SAMPLES_PER_FRAME);
+        for (ch=0; ch<ctx->n_all_channels; ch++)
+            frame->input_ptr[ch] = frame->input_audio[ch];
+    }
+
+    run_stage(tctx, copy_samples, ctx->n_all_channels);
+}
+
 static int
 encode_frame(A52ThreadContext *tctx, uint8_t *frame_buffer)
 {
@@ -1368,11 +1491,9 @@ encode_frame(A52ThreadContext *tctx, uint8_t *frame_buffer)
         return -1;
     }
 
-    copy_samples(tctx);
-
     calculate_dynrng(tctx);
 
-    generate_coefs(tctx);
+    run_stage(tctx, generate_coefs, coef_groups(ctx));
 
     compute_dither_strategy(tctx);
 
@@ -1380,36 +1501,47 @@ encode_frame(A52ThreadContext *tctx, uint8_t *frame_buffer)
         calc_rematrixing(tctx);
     }
 
+    // with variable bandwidth, this is done at full bandwidth
+    run_stage(tctx, process_exponents, ctx->n_all_channels);
+
     // variable bandwidth
     if(ctx->params.bwcode == -2) {
-        // process exponents at full bandwidth
-        ctx->process_exponents(tctx);
         // run bit allocation at q=240 to calculate bandwidth
         vbw_bit_allocation(tctx);
+        // keep the exponents and strategies, only the groups are cut
+        run_stage(tctx, regroup_exponents, ctx->n_channels);
     }
+    compute_exponent_bits(tctx);
 
-    ctx->process_exponents(tctx);
+    start_bit_allocation(tctx);
+    run_stage(tctx, bit_alloc_prepare, A52_NUM_BLOCKS);
+
+    // everything which depends on earlier frames
+    rate_control_enter(tctx);
 
     if(ctx->params.encoding_mode == AFTEN_ENC_MODE_CBR) {
-        adjust_frame_size(tctx);
+        frame->frame_size = frame->frame_size_min + tctx->frame_pad;
     }
 
     if(compute_bit_allocation(tctx)) {
+        rate_control_leave(tctx);
         fprintf(stderr, "Error in bit allocation\n");
         tctx->framesize = 0;
         return -1;
     }
 
-    quantize_mantissas(tctx);
+    rate_control_leave(tctx);
 
-    // increment counters
-    tctx->bit_cnt += frame->frame_size * 16;
-    tctx->sample_cnt += A52_SAMPLES_PER_FRAME;
+    run_stage(tctx, quantize_mantissas, A52_NUM_BLOCKS);
 
     // update encoding status
     tctx->status.quality = frame->quality;
     tctx->status.bit_rate = frame->bit_rate;
     tctx->status.bwcode = frame->bwcode;
+    tctx->status.bit_alloc_evals = frame->bit_alloc_evals;
+    tctx->status.ba_cache_lookups = frame->ba_cache_lookups;
+    tctx->status.ba_cache_hits = frame->ba_cache_hits;
+    tctx->status.ba_cache_bap_hits = frame->ba_cache_bap_hits;
 
     output_frame_header(tctx, frame_buffer);
     output_audio_blocks(tctx);
@@ -1438,31 +1570,22 @@ threaded_encode(void* vtctx)
 
     tctx = vtctx;
 
-    posix_mutex_lock(&tctx->ts.enter_mutex);
-    posix_cond_signal(&tctx->ts.enter_cond);
     while(1) {
-        posix_cond_wait(&tctx->ts.enter_cond, &tctx->ts.enter_mutex);
-        posix_mutex_lock(&tctx->ts.confirm_mutex);
-        posix_cond_signal(&tctx->ts.confirm_cond);
-        posix_mutex_unlock(&tctx->ts.confirm_mutex);
-
-        windows_event_set(&tctx->ts.ready_event);
-        windows_event_wait(&tctx->ts.enter_event);
+        // wait until the slot holds a new frame
+        thread_event_wait(&tctx->ts.enter_event, &tctx->ts.head, !tctx->ts.tail);
         /* end thread if nothing to encode */
-        if (tctx->state == END) {
-            tctx->framesize = 0;
+        if (tctx->state == END)
             break;
-        }
-        if (tctx->state == ABORT) {
+        if (tctx->ctx->n_channel_threads > 1) {
+            // help with a stage of the frame in tctx[0]
+            run_stage_items(tctx->ctx->tctx, tctx);
+        } else if (encode_frame(tctx, tctx->out_buffer)) {
             tctx->framesize = -1;
-            break;
         }
-        if (encode_frame(tctx, tctx->frame_buffer))
-            tctx->state = ABORT;
+        thread_event_post(&tctx->ts.ready_event, &tctx->ts.tail, !tctx->ts.tail);
     }
-    posix_mutex_unlock(&tctx->ts.enter_mutex);
-
-    windows_event_set(&tctx->ts.ready_event);
+    tctx->framesize = 0;
+    thread_event_post(&tctx->ts.ready_event, &tctx->ts.tail, !tctx->ts.tail);
 
 #ifdef MINGW_ALIGN_STACK_HACK
     asm volatile (
@@ -1477,133 +1600,338 @@ threaded_encode(void* vtctx)
     return 0;
 }
 
+/* frame job run by a worker of the shared thread pool */
+static void
+pooled_encode(void *vtctx)
+{
+    A52ThreadContext *tctx = vtctx;
+
+    if (encode_frame(tctx, tctx->out_buffer))
+        tctx->framesize = -1;
+}
+
+/* hands the frame back once the pool has let go of the job */
+static void
+pooled_encode_done(void *vtctx)
+{
+    A52ThreadContext *tctx = vtctx;
+
+    thread_event_post(&tctx->ts.ready_event, &tctx->ts.tail, !tctx->ts.tail);
+}
+#endif
+
 static int
-encode_frame_parallel(AftenContext *s, uint8_t *frame_buffer, const void *samples)
+submit_frame(AftenContext *s, const void *samples, const void *const *planes,
+             uint8_t *frame_buffer)
 {
-    A52Context *ctx = s->private_context;
-    int framesize = 0;
+    A52Context *ctx;
+    A52ThreadContext *tctx;
 
-    do {
-        A52ThreadContext *tctx = &ctx->tctx[ctx->ts.current_thread_num];
+    ctx = s->private_context;
+    if(ctx->queue_count >= ctx->queue_depth)
+        return 1;
 
-        posix_mutex_lock(&tctx->ts.enter_mutex);
+    tctx = &ctx->tctx[ctx->queue_head];
 
-        windows_event_wait(&tctx->ts.ready_event);
+    if(!frame_buffer) {
+        if(!tctx->frame_buffer) {
+            tctx->frame_buffer = malloc(A52_MAX_CODED_FRAME_SIZE);
+            if(!tctx->frame_buffer) {
+                fprintf(stderr, "error allocating memory for frame buffer\n");
+                return -1;
+            }
+        }
+        frame_buffer = tctx->frame_buffer;
+    }
+    tctx->out_buffer = frame_buffer;
 
-        if (tctx->state == ABORT || ctx->ts.threads_to_abort) {
-            tctx->state = ABORT;
-            framesize = -1;
-            if (!ctx->ts.threads_to_abort)
-                ctx->ts.threads_to_abort = ctx->n_threads;
-            --ctx->ts.threads_to_abort;
+    prepare_input(tctx, samples, planes);
+#ifndef NO_THREADS
+    if (ctx->n_threads > 1) {
+        tctx->state = WORK;
+        if (ctx->pool) {
+            tctx->ts.head = !tctx->ts.head;
+            thread_pool_submit(ctx->pool, &tctx->job);
         } else {
-            if (tctx->state == START)
-                tctx->state = WORK;
-            else {
-                if(tctx->framesize > 0) {
-                    framesize = tctx->framesize;
-                    memcpy(frame_buffer, tctx->frame_buffer, framesize);
-                   // update encoding status
-                    s->status.quality   = tctx->status.quality;
-                    s->status.bit_rate  = tctx->status.bit_rate;
-                    s->status.bwcode    = tctx->status.bwcode;
-                } else {
-                    posix_mutex_unlock(&tctx->ts.enter_mutex);
-                    goto end;
-                }
-            }
-            if(!samples)
-                tctx->state = END;
-            else
-                // convert sample format and de-interleave channels
-                ctx->fmt_convert_from_src(tctx->frame.input_audio, samples,
-                                          ctx->n_all_channels,
-                                          A52_SAMPLES_PER_FRAME);
+            thread_event_post(&tctx->ts.enter_event, &tctx->ts.head, !tctx->ts.head);
         }
-        posix_mutex_lock(&tctx->ts.confirm_mutex);
-        posix_cond_signal(&tctx->ts.enter_cond);
-        posix_mutex_unlock(&tctx->ts.enter_mutex);
-        posix_cond_wait(&tctx->ts.confirm_cond, &tctx->ts.confirm_mutex);
-        posix_mutex_unlock(&tctx->ts.confirm_mutex);
-
-        windows_event_set(&tctx->ts.enter_event);
-end:
-        ++ctx->ts.current_thread_num;
-        ctx->ts.current_thread_num %= ctx->n_threads;
-    } while(ctx->ts.threads_to_abort);
-
-    return framesize;
-}
+    } else
 #endif
+    if (encode_frame(tctx, tctx->out_buffer))
+        tctx->framesize = -1;
+
+    ctx->queue_head = (ctx->queue_head + 1) % ctx->n_threads;
+    ctx->queue_count++;
+
+    return 0;
+}
 
 int
-aften_encode_frame(AftenContext *s, uint8_t *frame_buffer, const void *samples)
+aften_encode_submit(AftenContext *s, const void *samples)
+{
+    if(s == NULL || samples == NULL) {
+        fprintf(stderr, "One or more NULL parameters passed to aften_encode_submit\n");
+        return -1;
+    }
+    return submit_frame(s, samples, NULL, NULL);
+}
+
+int
+aften_encode_submit_to(AftenContext *s, const void *samples,
+                       uint8_t *frame_buffer)
+{
+    if(s == NULL || samples == NULL || frame_buffer == NULL) {
+        fprintf(stderr, "One or more NULL parameters passed to aften_encode_submit_to\n");
+        return -1;
+    }
+    return submit_frame(s, samples, NULL, frame_buffer);
+}
+
+int
+aften_encode_submit_planar(AftenContext *s, const void *const *planes)
+{
+    if(s == NULL || planes == NULL) {
+        fprintf(stderr, "One or more NULL parameters passed to aften_encode_submit_planar\n");
+        return -1;
+    }
+    return submit_frame(s, NULL, planes, NULL);
+}
+
+int
+aften_encode_receive(AftenContext *s, uint8_t *frame_buffer, int wait)
 {
     A52Context *ctx;
     A52ThreadContext *tctx;
-    A52Frame *frame;
 
-    if(s == NULL || frame_buffer == NULL) {
-        fprintf(stderr, "One or more NULL parameters passed to aften_encode_frame\n");
+    if(s == NULL) {
+        fprintf(stderr, "NULL parameter passed to aften_encode_receive\n");
         return -1;
     }
     ctx = s->private_context;
+    if(!ctx->queue_count)
+        return 0;
+
+    tctx = &ctx->tctx[ctx->queue_tail];
 #ifndef NO_THREADS
-    if (ctx->n_threads > 1)
-        return encode_frame_parallel(s, frame_buffer, samples);
+    if (ctx->n_threads > 1) {
+        if (!wait && tctx->ts.tail != tctx->ts.head)
+            return 0;
+        thread_event_wait(&tctx->ts.ready_event, &tctx->ts.tail, tctx->ts.head);
+    }
+#endif
+    ctx->queue_tail = (ctx->queue_tail + 1) % ctx->n_threads;
+    ctx->queue_count--;
+
+    if (tctx->framesize < 0)
+        return -1;
+
+    // nothing to copy if the frame was encoded into the caller's buffer
+    if (frame_buffer && frame_buffer != tctx->out_buffer)
+        memcpy(frame_buffer, tctx->out_buffer, tctx->framesize);
+    // update encoding status
+    s->status.quality   = tctx->status.quality;
+    s->status.bit_rate  = tctx->status.bit_rate;
+    s->status.bwcode    = tctx->status.bwcode;
+    s->status.bit_alloc_evals = tctx->status.bit_alloc_evals;
+    s->status.ba_cache_lookups = tctx->status.ba_cache_lookups;
+    s->status.ba_cache_hits = tctx->status.ba_cache_hits;
+    s->status.ba_cache_bap_hits = tctx->status.ba_cache_bap_hits;
+
+    return tctx->framesize;
+}
+
+int
+aften_encode_pending(AftenContext *s)
+{
+    A52Context *ctx;
+
+    if(s == NULL || s->private_context == NULL) {
+        fprintf(stderr, "NULL parameter passed to aften_encode_pending\n");
+        return -1;
+    }
+    ctx = s->private_context;
+
+    return ctx->queue_count;
+}
+
+int
+aften_encode_latency(AftenContext *s)
+{
+    A52Context *ctx;
+
+    if(s == NULL || s->private_context == NULL) {
+        fprintf(stderr, "NULL parameter passed to aften_encode_latency\n");
+        return -1;
+    }
+    ctx = s->private_context;
+
+    // each frame also carries the last 256 samples of the previous one
+    return ctx->queue_count * A52_SAMPLES_PER_FRAME + 256;
+}
+
+static int
+encode_one_frame(AftenContext *s, uint8_t *frame_buffer, const void *samples,
+                 const void *const *planes)
+{
+    A52Context *ctx = s->private_context;
+    A52ThreadContext *tctx;
+    int have_input = (samples || planes);
+
+#ifndef NO_THREADS
+    if (ctx->n_threads > 1) {
+        int framesize = 0;
+
+        /* output lags input by the queue depth, so only take a frame back
+           once the queue is full or when flushing */
+        if (!have_input || ctx->queue_count >= ctx->queue_depth)
+            framesize = aften_encode_receive(s, frame_buffer, 1);
+        if (have_input && submit_frame(s, samples, planes, NULL))
+            return -1;
+        return framesize;
+    }
 #endif
-    if (!samples)
+    if (!have_input)
         return 0;
 
     tctx = ctx->tctx;
-    frame = &tctx->frame;
 
-    ctx->fmt_convert_from_src(frame->input_audio, samples, ctx->n_all_channels,
-                              A52_SAMPLES_PER_FRAME);
+    prepare_input(tctx, samples, planes);
 
-    encode_frame(tctx, frame_buffer);
+    if (encode_frame(tctx, frame_buffer))
+        return -1;
 
     s->status.quality   = tctx->status.quality;
     s->status.bit_rate  = tctx->status.bit_rate;
     s->status.bwcode    = tctx->status.bwcode;
+    s->status.bit_alloc_evals = tctx->status.bit_alloc_evals;
+    s->status.ba_cache_lookups = tctx->status.ba_cache_lookups;
+    s->status.ba_cache_hits = tctx->status.ba_cache_hits;
+    s->status.ba_cache_bap_hits = tctx->status.ba_cache_bap_hits;
 
     return tctx->framesize;
 }
 
+int
+aften_encode_frame(AftenContext *s, uint8_t *frame_buffer, const void *samples)
+{
+    if(s == NULL || frame_buffer == NULL) {
+        fprintf(stderr, "One or more NULL parameters passed to aften_encode_frame\n");
+        return -1;
+    }
+    return encode_one_frame(s, frame_buffer, samples, NULL);
+}
+
+int
+aften_encode_frame_planar(AftenContext *s, uint8_t *frame_buffer,
+                          const void *const *planes)
+{
+    if(s == NULL || frame_buffer == NULL) {
+        fprintf(stderr, "One or more NULL parameters passed to aften_encode_frame_planar\n");
+        return -1;
+    }
+    return encode_one_frame(s, frame_buffer, NULL, planes);
+}
+
+int
+aften_encode_frames(AftenContext *s, uint8_t *frame_buffer, int *frame_sizes,
+                    const void *samples, int nframes)
+{
+    A52Context *ctx;
+    const uint8_t *src = samples;
+    int stride, n_out, fs, ret, i;
+
+    if(s == NULL || frame_buffer == NULL || frame_sizes == NULL) {
+        fprintf(stderr, "One or more NULL parameters passed to aften_encode_frames\n");
+        return -1;
+    }
+    ctx = s->private_context;
+    stride = A52_SAMPLES_PER_FRAME * ctx->n_all_channels * ctx->sample_size;
+    n_out = 0;
+
+    if(!samples) {
+        // flush
+        while(ctx->queue_count) {
+            fs = aften_encode_receive(s, frame_buffer, 1);
+            if(fs < 0)
+                return -1;
+            frame_sizes[n_out++] = fs;
+            frame_buffer += fs;
+        }
+        return n_out;
+    }
+
+    for(i=0; i<nframes; i++, src+=stride) {
+        // a full queue only frees up one frame at a time
+        while((ret = aften_encode_submit(s, src)) == 1) {
+            fs = aften_encode_receive(s, frame_buffer, 1);
+            if(fs < 0)
+                return -1;
+            frame_sizes[n_out++] = fs;
+            frame_buffer += fs;
+        }
+        if(ret < 0)
+            return -1;
+    }
+    // without threads the last frame is done already
+    if(ctx->n_threads == 1 && ctx->queue_count) {
+        fs = aften_encode_receive(s, frame_buffer, 1);
+        if(fs < 0)
+            return -1;
+        frame_sizes[n_out++] = fs;
+    }
+
+    return n_out;
+}
+
 void
 aften_encode_close(AftenContext *s)
 {
     if(s != NULL && s->private_context != NULL) {
         A52Context *ctx = s->private_context;
-        /* mdct_close deinits both mdcts */
-        ctx->mdct_ctx_512.mdct_close(ctx);
 
-        posix_mutex_destroy(&ctx->ts.samples_mutex);
-
-        windows_cs_destroy(&ctx->ts.samples_cs);
         if (ctx->tctx) {
-            if (ctx->n_threads == 1)
-                ctx->tctx[0].mdct_tctx_512.mdct_thread_close(&ctx->tctx[0]);
-            else {
-                int i;
-                for (i=0; i<ctx->n_threads; ++i) {
-                    A52ThreadContext cur_tctx = ctx->tctx[i];
-                    thread_join(cur_tctx.ts.thread);
-                    cur_tctx.mdct_tctx_512.mdct_thread_close(&cur_tctx);
-                    posix_cond_destroy(&cur_tctx.ts.enter_cond);
-                    posix_cond_destroy(&cur_tctx.ts.confirm_cond);
-                    posix_cond_destroy(&cur_tctx.ts.samples_cond);
-
-                    posix_mutex_destroy(&cur_tctx.ts.enter_mutex);
-                    posix_mutex_destroy(&cur_tctx.ts.confirm_mutex);
-
-                    windows_event_destroy(&cur_tctx.ts.ready_event);
-                    windows_event_destroy(&cur_tctx.ts.enter_event);
-                    windows_event_destroy(&cur_tctx.ts.samples_event);
+            int i;
+#ifndef NO_THREADS
+            int first = (ctx->n_threads > 1) ? 0 : 1;
+            int n_workers = MAX(ctx->n_threads, ctx->n_channel_threads);
+
+            // frames which were never received are dropped
+            for (i=first; i<n_workers; ++i) {
+                A52ThreadContext *cur_tctx = &ctx->tctx[i];
+                if (ctx->pool) {
+                    thread_pool_wait(ctx->pool, &cur_tctx->job);
+                    thread_event_wait(&cur_tctx->ts.ready_event,
+                                      &cur_tctx->ts.tail, cur_tctx->ts.head);
+                    continue;
                 }
+                thread_event_wait(&cur_tctx->ts.ready_event,
+                                  &cur_tctx->ts.tail, cur_tctx->ts.head);
+                cur_tctx->state = END;
+                thread_event_post(&cur_tctx->ts.enter_event,
+                                  &cur_tctx->ts.head, !cur_tctx->ts.head);
+            }
+            for (i=first; i<n_workers; ++i) {
+                A52ThreadContext *cur_tctx = &ctx->tctx[i];
+                if (!ctx->pool)
+                    thread_join(cur_tctx->ts.thread);
+                thread_event_destroy(&cur_tctx->ts.enter_event);
+                thread_event_destroy(&cur_tctx->ts.ready_event);
+                thread_event_destroy(&cur_tctx->ts.rc_event);
             }
+            for (i=0; i<n_workers; ++i) {
+                ctx->tctx[i].mdct_tctx_512.mdct_thread_close(&ctx->tctx[i]);
+                free(ctx->tctx[i].frame_buffer);
+            }
+#else
+            for (i=0; i<ctx->n_threads; ++i) {
+                ctx->tctx[i].mdct_tctx_512.mdct_thread_close(&ctx->tctx[i]);
+                free(ctx->tctx[i].frame_buffer);
+            }
+#endif
             free(ctx->tctx);
         }
+        /* mdct_close deinits both mdcts, only after the workers are done */
+        ctx->mdct_ctx_512.mdct_close(ctx);
         free(ctx);
         s->private_context = NULL;
     }
@@ -49,6 +49,15 @@ typedef enum {
     AFTEN_ENC_MODE_VBR
 } AftenEncMode;
 
+/**
+ * Threading Mode
+ */
+typedef enum {
+    AFTEN_THREAD_MODE_FRAME = 0,
+    AFTEN_THREAD_MODE_CHANNEL,
+    AFTEN_THREAD_MODE_PIPELINE
+} AftenThreadMode;
+
 /**
  * Floating-Point Data Types
  */
@@ -70,6 +79,16 @@ typedef enum {
     A52_SAMPLE_FMT_DBL
 } A52SampleFormat;
 
+/**
+ * Channel Order of the Input Samples
+ */
+typedef enum {
+    AFTEN_CH_ORDER_A52 = 0,
+    AFTEN_CH_ORDER_WAV,
+    AFTEN_CH_ORDER_MPEG,
+    AFTEN_CH_ORDER_CUSTOM
+} AftenChannelOrder;
+
 /**
  * Dynamic Range Profiles
  */
@@ -105,12 +124,19 @@ typedef struct {
     int sse2;
     int sse3;
     int ssse3;
+    int avx2;
+    int fma;
     int amd_3dnow;
     int amd_3dnowext;
     int amd_sse_mmx;
     int altivec;
 } AftenSimdInstructions;
 
+/**
+ * Worker thread pool which can be shared by several encoding contexts
+ */
+typedef struct AftenThreadPool AftenThreadPool;
+
 /**
  * Performance related parameters
  */
@@ -123,6 +149,44 @@ typedef struct {
      */
     int n_threads;
 
+    /**
+     * Queue depth
+     * Maximum number of frames in flight with aften_encode_submit and
+     * aften_encode_receive.  It also sets how many frames the output of
+     * aften_encode_frame lags behind its input in threaded mode.
+     * Each frame in flight occupies one thread, so it is limited to n_threads.
+     * Default value is 0, which means one frame per thread.
+     */
+    int queue_depth;
+
+    /**
+     * Threading mode
+     * AFTEN_THREAD_MODE_FRAME   : each thread encodes a whole frame
+     * AFTEN_THREAD_MODE_CHANNEL : all threads share the work within a frame,
+     *                             split by channel and block.  This adds no
+     *                             latency, so it suits live encoding.
+     * AFTEN_THREAD_MODE_PIPELINE: like frame mode, but the CBR rate control
+     *                             of the frames runs one at a time, in
+     *                             order, while the analysis of later frames
+     *                             goes on in parallel.  All frames then
+     *                             follow one quality trajectory, and the
+     *                             output is bit-identical to encoding with
+     *                             one thread, whatever n_threads is.
+     * default is AFTEN_THREAD_MODE_FRAME
+     */
+    AftenThreadMode thread_mode;
+
+    /**
+     * Thread pool
+     * If set, frames are encoded by the workers of this pool instead of
+     * threads owned by the context.  n_threads then sets how many frames of
+     * this context can be encoded at once; 0 means one per pool thread.
+     * The pool must outlive all contexts using it.  Channel threading mode
+     * is not supported with a pool.
+     * default is NULL
+     */
+    AftenThreadPool *thread_pool;
+
     /**
      * Available SIMD instruction sets; shouldn't be modified
      */
@@ -222,15 +286,31 @@ typedef struct {
      * This determines how accurate the bit allocation search method is.
      * Set to 0 for better quality
      * Set to 1 for faster encoding
+     * Set to 2 for a bisection search, which finds the same snroffset as 0
+     *          in fewer steps, as long as more bits never give fewer
+     *          mantissa bits
      * default is 0
      */
     int bitalloc_fast;
 
+    /**
+     * Bit Allocation cache
+     * Set to 1 to reuse the psd, masking curve and bap values of a channel
+     * when its exponents are the same as in the last block of the previous
+     * frame.  This helps with steady or tonal material.  The output is the
+     * same either way.
+     * default is 0
+     */
+    int bitalloc_cache;
+
     /**
      * Exponent Strategy speed/quality
      * This determines whether to use a fixed or adaptive exponent strategy.
      * Set to 0 for adaptive strategy (better quality, slower)
      * Set to 1 for fixed strategy (lower quality, faster)
+     * Set to 2 to search strategy sequences, trading exponent accuracy
+     *          against exponent bits.  D25 and D45 are only tried for
+     *          single blocks, so only D15 exponents are reused.
      */
     int expstr_fast;
 
@@ -322,6 +402,10 @@ typedef struct {
     int quality;
     int bit_rate;
     int bwcode;
+    int bit_alloc_evals;    ///< number of snroffset values tried for the frame
+    int ba_cache_lookups;   ///< exponent sets looked up in the bit allocation cache
+    int ba_cache_hits;      ///< exponent sets whose psd and mask were reused
+    int ba_cache_bap_hits;  ///< exponent sets whose bap values were also reused
 } AftenStatus;
 
 /**
@@ -370,6 +454,25 @@ typedef struct {
      */
     A52SampleFormat sample_format;
 
+    /**
+     * Channel order of the input samples
+     * The input is put into A/52 order while it is converted, so the samples
+     * are never reordered in place.
+     * AFTEN_CH_ORDER_A52:    input is in A/52 order
+     * AFTEN_CH_ORDER_WAV:    input is in WAV order
+     * AFTEN_CH_ORDER_MPEG:   input is in MPEG order (DTS, MP2, AAC)
+     * AFTEN_CH_ORDER_CUSTOM: channel_map gives the order
+     * default: AFTEN_CH_ORDER_A52
+     */
+    AftenChannelOrder channel_order;
+
+    /**
+     * Custom channel map, used with AFTEN_CH_ORDER_CUSTOM
+     * channel_map[i] is the input channel which carries the i-th channel in
+     * A/52 order.  Each input channel must be used exactly once.
+     */
+    int channel_map[6];
+
     /**
      * Used internally by the encoder. The user should leave this alone.
      * It is allocated in aften_encode_init and free'd in aften_encode_close.
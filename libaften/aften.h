@@ -84,6 +84,114 @@ AFTEN_API int aften_encode_init(AftenContext *s);
 AFTEN_API int aften_encode_frame(AftenContext *s, unsigned char *frame_buffer,
                                  const void *samples);
 
+/**
+ * Encodes a single AC-3 frame from planar input.
+ * This works like @c aften_encode_frame, but takes one buffer per channel,
+ * in the channel order set in the context, instead of interleaved samples.
+ * If the sample format matches the encoder's internal float type (see
+ * @c aften_get_float_type), the planes are read in place without a copy.
+ * @param s    The encoding context
+ * @param[out] frame_buffer Pointer to output frame data
+ * @param[in]  planes       Array of pointers to the input samples of each
+ *                          channel, or NULL to flush
+ * @return Returns the number of bytes written to @p frame_buffer, or returns
+ * a negative value on error.
+ */
+AFTEN_API int aften_encode_frame_planar(AftenContext *s,
+                                        unsigned char *frame_buffer,
+                                        const void *const *planes);
+
+/**
+ * Encodes several AC-3 frames in one call.
+ * With more than one thread, output lags input the same way as with
+ * @c aften_encode_frame.  Call it with @p samples set to NULL to get the
+ * remaining frames at the end.
+ * @param s    The encoding context
+ * @param[out] frame_buffer Output frames, packed one after another.  It must
+ *                          have room for @p nframes frames of
+ *                          A52_MAX_CODED_FRAME_SIZE bytes, or for
+ *                          @c aften_encode_pending frames when flushing.
+ * @param[out] frame_sizes  Size of each output frame, in bytes
+ * @param[in]  samples      @p nframes frames of interleaved input samples
+ * @param[in]  nframes      Number of input frames
+ * @return Returns the number of frames written to @p frame_buffer, or a
+ * negative value on error.
+ */
+AFTEN_API int aften_encode_frames(AftenContext *s, unsigned char *frame_buffer,
+                                  int *frame_sizes, const void *samples,
+                                  int nframes);
+
+/**
+ * Queues a single frame of audio for encoding and returns without waiting
+ * for the result.  Frames are retrieved in submission order with
+ * @c aften_encode_receive.  Don't mix this with @c aften_encode_frame on the
+ * same context.
+ * @param s    The encoding context
+ * @param[in]  samples      Pointer to input audio samples
+ * @return Returns 0 if the frame was queued, 1 if the queue is full and a frame
+ * must be received first, or a negative value on error.
+ */
+AFTEN_API int aften_encode_submit(AftenContext *s, const void *samples);
+
+/**
+ * Like @c aften_encode_submit, but takes one buffer per channel, in the
+ * channel order set in the context.  The planes are only read during the
+ * call.
+ * @param s    The encoding context
+ * @param[in]  planes       Array of pointers to the input samples of each
+ *                          channel
+ * @return Returns 0 if the frame was queued, 1 if the queue is full and a frame
+ * must be received first, or a negative value on error.
+ */
+AFTEN_API int aften_encode_submit_planar(AftenContext *s,
+                                         const void *const *planes);
+
+/**
+ * Like @c aften_encode_submit, but the frame is encoded straight into
+ * @p frame_buffer instead of an internal buffer, which saves a copy.  The
+ * buffer must have room for A52_MAX_CODED_FRAME_SIZE bytes and must not be
+ * touched until the frame has been received.
+ * @param s    The encoding context
+ * @param[in]  samples      Pointer to input audio samples
+ * @param[out] frame_buffer Pointer to output frame data
+ * @return Returns 0 if the frame was queued, 1 if the queue is full and a frame
+ * must be received first, or a negative value on error.
+ */
+AFTEN_API int aften_encode_submit_to(AftenContext *s, const void *samples,
+                                     unsigned char *frame_buffer);
+
+/**
+ * Retrieves the oldest frame queued with @c aften_encode_submit or
+ * @c aften_encode_submit_to.
+ * @param s    The encoding context
+ * @param[out] frame_buffer Pointer to output frame data.  It may be NULL or
+ *                          the buffer given to @c aften_encode_submit_to, in
+ *                          which case nothing is copied.
+ * @param[in]  wait         If non-zero, wait until the frame is encoded.
+ *                          Otherwise return right away if it isn't done yet.
+ * @return Returns the number of bytes written to @p frame_buffer, 0 if the
+ * queue is empty or the frame isn't done yet, or a negative value on error.
+ */
+AFTEN_API int aften_encode_receive(AftenContext *s, unsigned char *frame_buffer,
+                                   int wait);
+
+/**
+ * Gets the current pipeline depth.
+ * @param s The encoding context
+ * @return Returns the number of frames submitted but not yet received, or
+ * -1 if the context has not been initialized.
+ */
+AFTEN_API int aften_encode_pending(AftenContext *s);
+
+/**
+ * Gets the current encoding latency.
+ * @param s The encoding context
+ * @return Returns the number of submitted samples which have not been
+ * returned in an encoded frame yet, or -1 if the context has not been
+ * initialized.
+ */
+AFTEN_API int aften_encode_latency(AftenContext *s);
+
 /**
  * Sets the parameters in the context @p s to their default values.
  * @param s The encoding context
@@ -92,6 +200,37 @@ AFTEN_API void aften_encode_close(AftenContext *s);
 
 /** @} end encoding functions */
 
+/**
+ * @defgroup threadpool Thread pool functions
+ * @{
+ */
+
+/**
+ * Creates a pool of worker threads which any number of encoding contexts
+ * can use by setting @c system.thread_pool before @c aften_encode_init.
+ * @param n_threads Number of worker threads, or 0 for one per CPU
+ * @return Returns the new pool, or NULL on failure or if libaften was built
+ * without thread support.
+ */
+AFTEN_API AftenThreadPool *aften_thread_pool_create(int n_threads);
+
+/**
+ * Stops the workers of a pool and frees it.  All contexts using the pool
+ * must have been closed.
+ * @param pool The thread pool
+ */
+AFTEN_API void aften_thread_pool_destroy(AftenThreadPool *pool);
+
+/**
+ * Gets the process-wide thread pool, which is created with one thread per
+ * CPU on first use.  It lives until the process exits and is never
+ * destroyed by @c aften_thread_pool_destroy.
+ * @return Returns the global pool, or NULL if it could not be created.
+ */
+AFTEN_API AftenThreadPool *aften_thread_pool_global(void);
+
+/** @} end thread pool functions */
+
 /**
  * @defgroup utility Utility functions
  * @{
@@ -117,6 +256,8 @@ AFTEN_API int aften_wav_channels_to_acmod(int ch, unsigned int chmask,
  * Takes a channel-interleaved array of audio samples, where the channel order
  * is the default WAV order. The samples are rearranged to the proper A/52
  * channel order based on the @p acmod and @p lfe parameters.
+ * Setting @c channel_order in the context instead does this while the
+ * samples are converted, without a separate pass.
  * @param     samples  array of interleaved audio samples
  * @param[in] n        number of samples in the array
  * @param[in] ch       number of channels
@@ -130,6 +271,8 @@ AFTEN_API void aften_remap_wav_to_a52(void *samples, int n, int ch,
  * Takes a channel-interleaved array of audio samples, where the channels are
  * in MPEG order. The samples are rearranged to the proper A/52 channel order
  * based on the @p acmod parameter.
+ * Setting @c channel_order in the context instead does this while the
+ * samples are converted, without a separate pass.
  * @param     samples  array of interleaved audio samples
  * @param[in] n        number of samples in the array
  * @param[in] ch       number of channels
@@ -36,9 +36,10 @@
 #include "exponent.h"
 #include "a52.h"
 #include "aften.h"
+#include "cpu_caps.h"
 
 /* log addition table */
-static const uint8_t latab[260]= {
+const uint8_t latab[260]= {
     64, 63, 62, 61, 60, 59, 58, 57, 56, 55,
     54, 53, 52, 52, 51, 50, 49, 48, 47, 47,
     46, 45, 44, 44, 43, 42, 41, 41, 40, 39,
@@ -70,7 +71,7 @@ static const uint8_t latab[260]= {
  * each entry has 3 values, 1 for each base sample rate
  * { 48kHz, 44.1kHz, 32kHz }
  */
-static const uint16_t hth[50][3]= {
+const uint16_t hth[50][3]= {
     { 1232, 1264, 1408 },
     { 1232, 1264, 1408 },
     { 1088, 1120, 1200 },
@@ -124,7 +125,7 @@ static const uint16_t hth[50][3]= {
 };
 
 /* bit allocation pointer table */
-static const uint8_t baptab[64]= {
+const uint8_t baptab[64]= {
      0,  1,  1,  1,  1,  1,  2,  2,  3,  3,  3,  4,  4,  5,  5,  6,
      6,  6,  6,  7,  7,  7,  7,  8,  8,  8,  8,  9,  9,  9,  9, 10,
     10, 10, 10, 11, 11, 11, 11, 12, 12, 12, 12, 13, 13, 13, 13, 14,
@@ -172,16 +173,23 @@ static const uint16_t fgaintab[8] = {
 static uint16_t psdtab[25];
 
 /* mask table (maps bin# to band#) */
-static uint8_t masktab[253];
+uint8_t masktab[253];
 
 /* band table (starting bin for each band) */
-static uint8_t bndtab[51];
+uint8_t bndtab[51];
 
 /* frame size table */
 static uint16_t frmsizetab[38][3];
 
+static void bit_alloc_prepare_block(A52BitAllocParams *s, uint8_t exp[][256],
+                                    int16_t psd[][256], int16_t mask[][50],
+                                    const int *end, int n_channels);
+static void compute_bap(uint8_t *bap, const int16_t *psd, const int16_t *thr,
+                        int n);
+static int compute_mantissa_size(int mant_cnt[5], const uint8_t *bap, int n);
+
 void
-bitalloc_init(void)
+bitalloc_init(A52Context *ctx)
 {
     int i, j, k, l, v;
 
@@ -208,6 +216,26 @@ bitalloc_init(void)
             if(j == 1) frmsizetab[i*2+1][j] += 16;
         }
     }
+
+#ifdef HAVE_AVX2
+    if(cpu_caps_have_avx2()) {
+        ctx->bit_alloc_prepare_block = avx2_bit_alloc_prepare_block;
+        ctx->compute_bap = avx2_compute_bap;
+        ctx->compute_mantissa_size = avx2_compute_mantissa_size;
+        return;
+    }
+#endif /* HAVE_AVX2 */
+#ifdef HAVE_SSSE3
+    if(cpu_caps_have_ssse3()) {
+        ctx->bit_alloc_prepare_block = bit_alloc_prepare_block;
+        ctx->compute_bap = ssse3_compute_bap;
+        ctx->compute_mantissa_size = ssse3_compute_mantissa_size;
+        return;
+    }
+#endif /* HAVE_SSSE3 */
+    ctx->bit_alloc_prepare_block = bit_alloc_prepare_block;
+    ctx->compute_bap = compute_bap;
+    ctx->compute_mantissa_size = compute_mantissa_size;
 }
 
 static inline int
@@ -364,11 +392,12 @@ a52_bit_allocation_prepare(A52BitAllocParams *s,
  * calculate each bap value.
  */
 static void
-a52_bit_allocation(uint8_t *bap, int16_t *psd, int16_t *mask,
+a52_bit_allocation(A52Context *ctx, uint8_t *bap, int16_t *psd, int16_t *mask,
                    int start, int end, int snroffset, int floor)
 {
+    ALIGN16(int16_t) thr[256];
     int i, j, endj;
-    int v, address1, address2, offset;
+    int v, offset;
 
     // csnroffst=0 & fsnroffst=0 is a special-case scenario in which all baps
     // are set to zero and the core bit allocation is skipped.
@@ -377,25 +406,27 @@ a52_bit_allocation(uint8_t *bap, int16_t *psd, int16_t *mask,
         return;
     }
 
+    // spread the masking threshold of each band over its bins
     offset = snroffset + floor;
     for (i = start, j = masktab[start]; end > bndtab[j]; ++j) {
         v = (MAX(mask[j] - offset, 0) & 0x1FE0) + floor;
         endj = MIN(bndtab[j] + bndsz[j], end);
-        if ((endj-i) & 1) {
-            address1 = (psd[i] - v) >> 5;
-            address1 = CLIP(address1, 0, 63);
-            bap[i] = baptab[address1];
-            ++i;
-        }
-        while (i < endj) {
-            address1 = (psd[i  ] - v) >> 5;
-            address2 = (psd[i+1] - v) >> 5;
-            address1 = CLIP(address1, 0, 63);
-            address2 = CLIP(address2, 0, 63);
-            bap[i  ] = baptab[address1];
-            bap[i+1] = baptab[address2];
-            i+=2;
-        }
+        for(; i < endj; i++)
+            thr[i] = v;
+    }
+    ctx->compute_bap(&bap[start], &psd[start], &thr[start], end-start);
+}
+
+/** bap value of each bin from its psd and masking threshold */
+static void
+compute_bap(uint8_t *bap, const int16_t *psd, const int16_t *thr, int n)
+{
+    int i, address;
+
+    for(i=0; i<n; i++) {
+        address = (psd[i] - thr[i]) >> 5;
+        address = CLIP(address, 0, 63);
+        bap[i] = baptab[address];
     }
 }
 
@@ -404,7 +435,7 @@ a52_bit_allocation(uint8_t *bap, int16_t *psd, int16_t *mask,
  * This is determined solely by the bit allocation pointers.
  */
 static int
-compute_mantissa_size(int mant_cnt[5], uint8_t *bap, int ncoefs)
+compute_mantissa_size(int mant_cnt[5], const uint8_t *bap, int ncoefs)
 {
     int bits, b, i;
 
@@ -439,29 +470,190 @@ compute_mantissa_size_final(int mant_cnt[5])
     return bits;
 }
 
-/* call to prepare bit allocation */
+/**
+ * Lists the exponents in each band with the number of bins using them.
+ * The psd of a bin only depends on its exponent, so all bins of a band with
+ * the same exponent get the same bap value for any snroffset.
+ */
 static void
-bit_alloc_prepare(A52ThreadContext *tctx)
+band_exp_prepare(A52Block *block, int ch, int end)
+{
+    uint8_t *exp = block->exp[ch];
+    uint8_t *band_exp = block->band_exp[ch];
+    uint8_t *band_exp_cnt = block->band_exp_cnt[ch];
+    int slot[256];
+    int i, j, k, n, endj;
+
+    // slot[e] is the list entry of exponent e, if it is in the current band
+    for(i=0; i<256; i++)
+        slot[i] = -1;
+    n = 0;
+    for(i=0, j=0; i<end; j++) {
+        block->band_exp_start[ch][j] = n;
+        endj = MIN(bndtab[j+1], end);
+        k = n;
+        for(; i<endj; i++) {
+            uint8_t e = exp[i];
+            if(slot[e] < k) {
+                slot[e] = n;
+                band_exp[n] = e;
+                band_exp_cnt[n] = 0;
+                n++;
+            }
+            band_exp_cnt[slot[e]]++;
+        }
+    }
+    block->band_exp_start[ch][j] = n;
+}
+
+/**
+ * Computes the psd and masking curves of the channels of one block.
+ * Channels with an end of 0 are skipped.
+ */
+static void
+bit_alloc_prepare_block(A52BitAllocParams *s, uint8_t exp[][256],
+                        int16_t psd[][256], int16_t mask[][50],
+                        const int *end, int n_channels)
+{
+    int ch;
+
+    for(ch=0; ch<n_channels; ch++) {
+        if(end[ch] > 0) {
+            a52_bit_allocation_prepare(s, exp[ch], psd[ch], mask[ch],
+                                       0, end[ch], 2, 0, NULL, NULL, NULL);
+        }
+    }
+}
+
+/** cheap hash of an exponent set, used to skip most non-matching sets */
+static uint32_t
+exp_hash(const uint8_t *exp, int end)
+{
+    uint32_t h, w;
+    int i;
+
+    h = end;
+    for(i=0; i+4<=end; i+=4) {
+        memcpy(&w, &exp[i], 4);
+        h = (h ^ w) * 0x9E3779B1;
+    }
+    for(; i<end; i++)
+        h = (h ^ exp[i]) * 0x9E3779B1;
+    return h;
+}
+
+/**
+ * Takes the psd, masking curve and exponent lists of a channel from the
+ * cache if the exponents are the same as those of the cached set.
+ * Returns 1 on a hit.
+ */
+static int
+ba_cache_lookup(A52ThreadContext *tctx, A52Block *block, int ch, int end)
+{
+    A52BitAllocCache *c = &tctx->ba_cache[ch];
+
+    if(!c->valid || c->end != end ||
+       memcmp(&c->params, &tctx->frame.bit_alloc, sizeof(c->params)) ||
+       c->hash != exp_hash(block->exp[ch], end) ||
+       memcmp(c->exp, block->exp[ch], end))
+        return 0;
+
+    memcpy(block->psd[ch], c->psd, end * sizeof(c->psd[0]));
+    memcpy(block->mask[ch], c->mask, sizeof(c->mask));
+    memcpy(block->band_exp[ch], c->band_exp, sizeof(c->band_exp));
+    memcpy(block->band_exp_cnt[ch], c->band_exp_cnt, sizeof(c->band_exp_cnt));
+    memcpy(block->band_exp_start[ch], c->band_exp_start,
+           sizeof(c->band_exp_start));
+    return 1;
+}
+
+/**
+ * Stores the last exponent set of each channel with its bit allocation.
+ * Called once the final bap values of the frame are known.
+ */
+static void
+ba_cache_update(A52ThreadContext *tctx)
 {
-    A52Context *ctx = tctx->ctx;
     A52Frame *frame = &tctx->frame;
     A52Block *block;
-    int blk, ch;
-
-    for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
+    A52BitAllocCache *c;
+    int blk, ch, end;
+
+    for(ch=0; ch<tctx->ctx->n_all_channels; ch++) {
+        // block 0 never reuses exponents
+        blk = A52_NUM_BLOCKS - 1;
+        while(frame->blocks[blk].exp_strategy[ch] == EXP_REUSE)
+            blk--;
         block = &frame->blocks[blk];
-        for(ch=0; ch<ctx->n_all_channels; ch++) {
-            // We don't have to run the bit allocation when reusing exponents
-            if(block->exp_strategy[ch] != EXP_REUSE) {
-                a52_bit_allocation_prepare(&frame->bit_alloc,
-                               block->exp[ch], block->psd[ch], block->mask[ch],
-                               0, frame->ncoefs[ch],
-                               2, 0, NULL, NULL, NULL);
-            }
+        c = &tctx->ba_cache[ch];
+        end = frame->ncoefs[ch];
+        if(block->ba_cached[ch]) {
+            // only the bap values can have changed
+            memcpy(c->bap, block->bap[ch], end);
+            c->snroffst = frame->bap_snroffst;
+            continue;
         }
+        c->valid = 1;
+        c->end = end;
+        c->params = frame->bit_alloc;
+        c->hash = exp_hash(block->exp[ch], end);
+        c->snroffst = frame->bap_snroffst;
+        memcpy(c->exp, block->exp[ch], end);
+        memcpy(c->psd, block->psd[ch], end * sizeof(c->psd[0]));
+        memcpy(c->mask, block->mask[ch], sizeof(c->mask));
+        memcpy(c->band_exp, block->band_exp[ch], sizeof(c->band_exp));
+        memcpy(c->band_exp_cnt, block->band_exp_cnt[ch], sizeof(c->band_exp_cnt));
+        memcpy(c->band_exp_start, block->band_exp_start[ch],
+               sizeof(c->band_exp_start));
+        memcpy(c->bap, block->bap[ch], end);
     }
 }
 
+/**
+ * Computes the psd and masking curves of one block.  All blocks must be
+ * prepared before compute_bit_allocation is called.  The cache is only read
+ * here, so blocks can be prepared in parallel.
+ */
+void
+bit_alloc_prepare_blk(A52ThreadContext *tctx, int blk)
+{
+    A52Context *ctx = tctx->ctx;
+    A52Frame *frame = &tctx->frame;
+    A52Block *block = &frame->blocks[blk];
+    int end[A52_MAX_CHANNELS];
+    int ch;
+
+    // We don't have to run the bit allocation when reusing exponents
+    for(ch=0; ch<ctx->n_all_channels; ch++) {
+        end[ch] = 0;
+        block->ba_cached[ch] = 0;
+        if(block->exp_strategy[ch] == EXP_REUSE)
+            continue;
+        if(ctx->params.bitalloc_cache &&
+           ba_cache_lookup(tctx, block, ch, frame->ncoefs[ch])) {
+            block->ba_cached[ch] = 1;
+            continue;
+        }
+        end[ch] = frame->ncoefs[ch];
+    }
+    ctx->bit_alloc_prepare_block(&frame->bit_alloc, block->exp, block->psd,
+                                 block->mask, end, ctx->n_all_channels);
+    for(ch=0; ch<ctx->n_all_channels; ch++) {
+        if(end[ch] > 0)
+            band_exp_prepare(block, ch, end[ch]);
+    }
+}
+
+/* call to prepare bit allocation */
+static void
+bit_alloc_prepare(A52ThreadContext *tctx)
+{
+    int blk;
+
+    for(blk=0; blk<A52_NUM_BLOCKS; blk++)
+        bit_alloc_prepare_blk(tctx, blk);
+}
+
 /**
  * Run the bit allocation routine using the given snroffset values.
  * Returns number of mantissa bits used.
@@ -474,9 +666,11 @@ bit_alloc(A52ThreadContext *tctx, int snroffst)
     A52Block *block;
     int mant_cnt[5];
     int blk, ch;
-    int bits;
+    int bits, bap_hits;
 
     bits = 0;
+    bap_hits = 0;
+    frame->bap_snroffst = snroffst;
     snroffst = (snroffst << 2) - 960;
 
     for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
@@ -494,16 +688,108 @@ bit_alloc(A52ThreadContext *tctx, int snroffst)
             // bit allocation pointers whenever we reuse exponents.
             if(block->exp_strategy[ch] == EXP_REUSE) {
                 memcpy(block->bap[ch], frame->blocks[blk-1].bap[ch], 256);
+            } else if(block->ba_cached[ch] &&
+                      tctx->ba_cache[ch].snroffst == frame->bap_snroffst) {
+                memcpy(block->bap[ch], tctx->ba_cache[ch].bap, frame->ncoefs[ch]);
+                bap_hits++;
             } else {
-                a52_bit_allocation(block->bap[ch], block->psd[ch], block->mask[ch],
-                                   0, frame->ncoefs[ch], snroffst,
-                                   frame->bit_alloc.floor);
+                a52_bit_allocation(ctx, block->bap[ch], block->psd[ch],
+                                   block->mask[ch], 0, frame->ncoefs[ch],
+                                   snroffst, frame->bit_alloc.floor);
             }
-            bits += compute_mantissa_size(mant_cnt, block->bap[ch], frame->ncoefs[ch]);
+            bits += ctx->compute_mantissa_size(mant_cnt, block->bap[ch],
+                                               frame->ncoefs[ch]);
 
         }
         bits += compute_mantissa_size_final(mant_cnt);
     }
+    frame->ba_cache_bap_hits = bap_hits;
+
+    return bits;
+}
+
+/** number of bits of a single mantissa for each bap value above 4 */
+const uint8_t bap_bits[16] = {
+    0, 0, 0, 0, 0, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 16
+};
+
+/**
+ * Counts the mantissa bits for one block and channel using the exponent
+ * lists from band_exp_prepare.  Gives the same result as running
+ * a52_bit_allocation and compute_mantissa_size, but only visits each
+ * distinct exponent of a band once.
+ */
+static int
+count_mantissa_bits_ch(A52Block *block, int ch, int end, int offset,
+                       int floor, int mant_cnt[5])
+{
+    const int16_t *mask = block->mask[ch];
+    const uint8_t *band_exp = block->band_exp[ch];
+    const uint8_t *band_exp_cnt = block->band_exp_cnt[ch];
+    const uint8_t *band_exp_start = block->band_exp_start[ch];
+    int j, k, bits, base, address, b;
+
+    // (psd - v) >> 5 == base - 4 * exp, since psd = 3072 - 128 * exp and
+    // v is floor plus a multiple of 32
+    bits = 0;
+    for(j=0; bndtab[j] < end; j++) {
+        base = ((3072 - floor) >> 5) - ((MAX(mask[j] - offset, 0) & 0x1FE0) >> 5);
+        for(k=band_exp_start[j]; k<band_exp_start[j+1]; k++) {
+            address = CLIP(base - 4 * band_exp[k], 0, 63);
+            b = baptab[address];
+            if(b <= 4)
+                mant_cnt[b] += band_exp_cnt[k];
+            else
+                bits += bap_bits[b] * band_exp_cnt[k];
+        }
+    }
+    return bits;
+}
+
+/**
+ * Counts the mantissa bits which bit_alloc would give for the snroffset,
+ * without generating the bit allocation pointers.
+ */
+static int
+count_mantissa_bits(A52ThreadContext *tctx, int snroffst)
+{
+    A52Context *ctx = tctx->ctx;
+    A52Frame *frame = &tctx->frame;
+    A52Block *block;
+    int mant_cnt[5], ch_cnt[A52_MAX_CHANNELS][5], ch_bits[A52_MAX_CHANNELS];
+    int blk, ch, i;
+    int bits, offset, floor;
+
+    frame->bit_alloc_evals++;
+
+    snroffst = (snroffst << 2) - 960;
+    // all baps are zero in this case, see a52_bit_allocation
+    if(snroffst == SNROFFST(0, 0))
+        return 0;
+    floor = frame->bit_alloc.floor;
+    offset = snroffst + floor;
+
+    bits = 0;
+    for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
+        block = &frame->blocks[blk];
+        // same padding of the grouped mantissas as in bit_alloc
+        mant_cnt[0] = mant_cnt[3] = 0;
+        mant_cnt[1] = mant_cnt[2] = 2;
+        mant_cnt[4] = 1;
+        for(ch=0; ch<ctx->n_all_channels; ch++) {
+            // reused exponents give the same counts as the block before
+            if(block->exp_strategy[ch] != EXP_REUSE) {
+                for(i=0; i<5; i++)
+                    ch_cnt[ch][i] = 0;
+                ch_bits[ch] = count_mantissa_bits_ch(block, ch,
+                                  frame->ncoefs[ch], offset, floor, ch_cnt[ch]);
+            }
+            for(i=1; i<5; i++)
+                mant_cnt[i] += ch_cnt[ch][i];
+            bits += ch_bits[ch];
+        }
+        bits += compute_mantissa_size_final(mant_cnt);
+    }
 
     return bits;
 }
@@ -569,12 +855,111 @@ count_frame_bits(A52ThreadContext *tctx)
     frame->frame_bits = frame_bits;
 }
 
+/**
+ * Finds the highest snroffset which fits in avail_bits.  Each new trial is
+ * placed where the line through the last two results crosses zero leftover
+ * bits, which brackets the answer within a couple of bit allocation runs.
+ * The bracket is then narrowed by interpolation, falling back to bisection
+ * when one side stops moving, so it always ends in about log2 steps.  This
+ * relies on the mantissa bits never going down as snroffset goes up.
+ * On entry, leftover holds the bits left over at snroffst.  On return, it
+ * holds the bits left over at the returned snroffset.
+ */
+static int
+search_bit_allocation(A52ThreadContext *tctx, int avail_bits, int snroffst,
+                      int *leftover)
+{
+    int lo, hi, lo_left, hi_left;
+    int snr, left, prev_snr, prev_left, side, same_side;
+
+    // lo is the highest value known to fit, hi the lowest known not to.
+    // -1 and 1024 stand for not found yet.
+    lo = -1;
+    hi = 1024;
+    lo_left = hi_left = 0;
+    snr = snroffst;
+    left = *leftover;
+    if(left >= 0) {
+        lo = snr;
+        lo_left = left;
+    } else {
+        hi = snr;
+        hi_left = left;
+    }
+
+    // first step: guess the slope from the bits left over
+    prev_snr = snr;
+    prev_left = left;
+    snr += left / (16 * tctx->ctx->n_channels);
+    if(snr == prev_snr)
+        snr += (left >= 0) ? 1 : -1;
+
+    // step outwards until the answer is bracketed
+    while(lo < 0 || hi > 1023) {
+        if((lo < 0 && hi == 0) || (hi > 1023 && lo == 1023))
+            break;
+        snr = CLIP(snr, lo+1, hi-1);
+        left = avail_bits - count_mantissa_bits(tctx, snr);
+        if(left >= 0) {
+            lo = snr;
+            lo_left = left;
+        } else {
+            hi = snr;
+            hi_left = left;
+        }
+        // aim just past the zero crossing of the secant
+        if(left != prev_left && snr != prev_snr) {
+            int64_t d = (int64_t)left * (snr - prev_snr) / (prev_left - left);
+            prev_snr = snr;
+            prev_left = left;
+            snr += (int)CLIP(d, -1024, 1024) + ((left >= 0) ? 1 : 0);
+        } else {
+            int step = 2 * (snr - prev_snr);
+            prev_snr = snr;
+            prev_left = left;
+            snr += step ? step : ((left >= 0) ? 1 : -1);
+        }
+    }
+
+    // narrow the bracket
+    side = same_side = 0;
+    while(lo >= 0 && hi - lo > 1) {
+        if(hi > 1023 || same_side >= 2) {
+            snr = (lo + hi) >> 1;
+        } else {
+            // interpolate the zero crossing, then test just above lo
+            snr = lo + (int)((int64_t)(hi - lo) * lo_left / (lo_left - hi_left));
+            snr = CLIP(snr, lo+1, hi-1);
+        }
+        left = avail_bits - count_mantissa_bits(tctx, snr);
+        if(left >= 0) {
+            lo = snr;
+            lo_left = left;
+            same_side = (side > 0) ? same_side+1 : 1;
+            side = 1;
+        } else {
+            hi = snr;
+            hi_left = left;
+            same_side = (side < 0) ? same_side+1 : 1;
+            side = -1;
+        }
+    }
+
+    if(lo < 0) {
+        // even snroffset 0 does not fit
+        *leftover = hi_left;
+        return 0;
+    }
+    *leftover = lo_left;
+    return lo;
+}
+
 /**
  * Calculates the snroffset values which, when used, keep the size of the
  * encoded data within a fixed frame size.
  */
 static int
-cbr_bit_allocation(A52ThreadContext *tctx, int prepare)
+cbr_bit_allocation(A52ThreadContext *tctx)
 {
     A52Context *ctx = tctx->ctx;
     A52Frame *frame = &tctx->frame;
@@ -585,18 +970,17 @@ cbr_bit_allocation(A52ThreadContext *tctx, int prepare)
     current_bits = frame->frame_bits + frame->exp_bits;
     avail_bits = (16 * frame->frame_size) - current_bits;
 
-    if(prepare)
-        bit_alloc_prepare(tctx);
-
     // starting point
     if(ctx->params.encoding_mode == AFTEN_ENC_MODE_VBR) {
         snroffst = ctx->params.quality;
     } else if(ctx->params.encoding_mode == AFTEN_ENC_MODE_CBR) {
         snroffst = tctx->last_quality;
     }
-    leftover = avail_bits - bit_alloc(tctx, snroffst);
+    leftover = avail_bits - count_mantissa_bits(tctx, snroffst);
 
-    if(ctx->params.bitalloc_fast) {
+    if(ctx->params.bitalloc_fast == 2) {
+        snroffst = search_bit_allocation(tctx, avail_bits, snroffst, &leftover);
+    } else if(ctx->params.bitalloc_fast) {
         // fast bit allocation
         int leftover0, leftover1, snr0, snr1;
         snr0 = snr1 = snroffst;
@@ -607,49 +991,49 @@ cbr_bit_allocation(A52ThreadContext *tctx, int prepare)
                     snr0 = snr1;
                     leftover0 = leftover1;
                     snr1 += 16;
-                    leftover1 = avail_bits - bit_alloc(tctx, snr1);
+                    leftover1 = avail_bits - count_mantissa_bits(tctx, snr1);
                 }
             } else {
                 while(leftover0 < 0 && snr0-16 >= 0) {
                     snr1 = snr0;
                     leftover1 = leftover0;
                     snr0 -= 16;
-                    leftover0 = avail_bits - bit_alloc(tctx, snr0);
+                    leftover0 = avail_bits - count_mantissa_bits(tctx, snr0);
                 }
             }
         }
         if(snr0 != snr1) {
             snroffst = snr0;
-            leftover = avail_bits - bit_alloc(tctx, snroffst);
+            leftover = avail_bits - count_mantissa_bits(tctx, snroffst);
         }
     } else {
         // take up to 3 jumps based on estimated distance from optimal
         if(leftover < -400) {
             snroffst += (leftover / (16 * ctx->n_channels));
-            leftover = avail_bits - bit_alloc(tctx, snroffst);
+            leftover = avail_bits - count_mantissa_bits(tctx, snroffst);
         }
         if(leftover > 400) {
             snroffst += (leftover / (24 * ctx->n_channels));
-            leftover = avail_bits - bit_alloc(tctx, snroffst);
+            leftover = avail_bits - count_mantissa_bits(tctx, snroffst);
         }
         if(leftover < -200) {
             snroffst += (leftover / (40 * ctx->n_channels));
-            leftover = avail_bits - bit_alloc(tctx, snroffst);
+            leftover = avail_bits - count_mantissa_bits(tctx, snroffst);
         }
         // adjust snroffst until leftover <= -100
         while(leftover > -100) {
             snroffst += (10 / ctx->n_channels);
             if(snroffst > 1023) {
                 snroffst = 1023;
-                leftover = avail_bits - bit_alloc(tctx, snroffst);
+                leftover = avail_bits - count_mantissa_bits(tctx, snroffst);
                 break;
             }
-            leftover = avail_bits - bit_alloc(tctx, snroffst);
+            leftover = avail_bits - count_mantissa_bits(tctx, snroffst);
         }
         // adjust snroffst until leftover is positive
         while(leftover < 0 && snroffst > 0) {
             snroffst--;
-            leftover = avail_bits - bit_alloc(tctx, snroffst);
+            leftover = avail_bits - count_mantissa_bits(tctx, snroffst);
         }
     }
 
@@ -659,6 +1043,9 @@ cbr_bit_allocation(A52ThreadContext *tctx, int prepare)
         return -1;
     }
 
+    // generate the bit allocation pointers for the chosen snroffset
+    bit_alloc(tctx, snroffst);
+
     // calculate csnroffst and fsnroffst
     snroffst = (snroffst - 240);
     csnroffst = (snroffst / 16) + 15;
@@ -704,10 +1091,9 @@ vbr_bit_allocation(A52ThreadContext *tctx)
         fsnroffst += 16;
     }
 
-    bit_alloc_prepare(tctx);
     // find an A52 frame size that can hold the data.
     frame_size = 0;
-    frame_bits = current_bits + bit_alloc(tctx, quality);
+    frame_bits = current_bits + count_mantissa_bits(tctx, quality);
     for(i=0; i<=ctx->frmsizecod; i++) {
         frame_size = frmsizetab[i][ctx->fscod];
         if(frame_size >= frame_bits) break;
@@ -722,13 +1108,13 @@ vbr_bit_allocation(A52ThreadContext *tctx)
     // run CBR bit allocation.
     // this will increase snroffst to make optimal use of the frame bits.
     // also it will lower snroffst if vbr frame won't fit in largest frame.
-    return cbr_bit_allocation(tctx, 0);
+    return cbr_bit_allocation(tctx);
 }
 
 /**
  * Loads the bit allocation parameters and counts fixed frame bits.
  */
-static void
+void
 start_bit_allocation(A52ThreadContext *tctx)
 {
     A52Context *ctx = tctx->ctx;
@@ -815,7 +1201,7 @@ vbw_bit_allocation(A52ThreadContext *tctx)
         bw = (nc - 73) / 3;
         bits = 0;
         for(ch=0; ch<ctx->n_channels; ch++) {
-            bits += expstr_set_bits[frame->expstr_set[ch]][nc];
+            bits += exponent_bits_ch(frame, ch, nc);
             for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
                 mant_bits += mant_est_tab[frame->blocks[blk].bap[ch][nc]];
             }
@@ -837,24 +1223,38 @@ vbw_bit_allocation(A52ThreadContext *tctx)
 /**
  * Run the bit allocation encoding routine.
  * Runs the bit allocation in either CBR or VBR mode, depending on the mode
- * selected by the user.
+ * selected by the user.  start_bit_allocation and bit_alloc_prepare_ch must
+ * have been run for the frame beforehand.
  */
 int
 compute_bit_allocation(A52ThreadContext *tctx)
 {
     A52Context *ctx = tctx->ctx;
+    A52Frame *frame = &tctx->frame;
+    int blk, ch;
 
-    start_bit_allocation(tctx);
     if(ctx->params.encoding_mode == AFTEN_ENC_MODE_VBR) {
         if(vbr_bit_allocation(tctx)) {
             return -1;
         }
     } else if(ctx->params.encoding_mode == AFTEN_ENC_MODE_CBR) {
-        if(cbr_bit_allocation(tctx, 1)) {
+        if(cbr_bit_allocation(tctx)) {
             return -1;
         }
     } else {
         return -1;
     }
+
+    if(ctx->params.bitalloc_cache) {
+        for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
+            for(ch=0; ch<ctx->n_all_channels; ch++) {
+                if(frame->blocks[blk].exp_strategy[ch] != EXP_REUSE) {
+                    frame->ba_cache_lookups++;
+                    frame->ba_cache_hits += frame->blocks[blk].ba_cached[ch];
+                }
+            }
+        }
+        ba_cache_update(tctx);
+    }
     return 0;
 }
@@ -30,10 +30,50 @@
 
 #include "a52.h"
 
-extern void bitalloc_init(void);
+/* log addition table */
+extern const uint8_t latab[260];
+
+/* absolute hearing threshold table */
+extern const uint16_t hth[50][3];
+
+/* bit allocation pointer table */
+extern const uint8_t baptab[64];
+
+/* mask table (maps bin# to band#) */
+extern uint8_t masktab[253];
+
+/* band table (starting bin for each band) */
+extern uint8_t bndtab[51];
+
+/* number of bits of a single mantissa for each bap value above 4 */
+extern const uint8_t bap_bits[16];
+
+extern void bitalloc_init(A52Context *ctx);
 
 extern void vbw_bit_allocation(A52ThreadContext *tctx);
 
+extern void start_bit_allocation(A52ThreadContext *tctx);
+
+extern void bit_alloc_prepare_blk(A52ThreadContext *tctx, int blk);
+
 extern int compute_bit_allocation(A52ThreadContext *tctx);
 
+#ifdef HAVE_SSSE3
+extern void ssse3_compute_bap(uint8_t *bap, const int16_t *psd,
+                              const int16_t *thr, int n);
+extern int ssse3_compute_mantissa_size(int mant_cnt[5], const uint8_t *bap,
+                                       int n);
+#endif /* HAVE_SSSE3 */
+#ifdef HAVE_AVX2
+extern void avx2_bit_alloc_prepare_block(A52BitAllocParams *s,
+                                         uint8_t exp[][256],
+                                         int16_t psd[][256],
+                                         int16_t mask[][50],
+                                         const int *end, int n_channels);
+extern void avx2_compute_bap(uint8_t *bap, const int16_t *psd,
+                             const int16_t *thr, int n);
+extern int avx2_compute_mantissa_size(int mant_cnt[5], const uint8_t *bap,
+                                      int n);
+#endif /* HAVE_AVX2 */
+
 #endif /* BITALLOC_H */
@@ -0,0 +1,252 @@
+/**
+ * Aften: A/52 audio encoder
+ * Copyright (c) 2006 Justin Ruggles
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file convert.c
+ * Input sample format conversion
+ *
+ * The input samples are converted to FLOAT, de-interleaved and put into
+ * A/52 channel order in a single pass over the input.
+ */
+
+#include "common.h"
+
+#include <stdio.h>
+
+#include "convert.h"
+#include "cpu_caps.h"
+
+/**
+ * WAV to A/52 channel mapping, the same as used by aften_remap_wav_to_a52()
+ */
+static const int wav_chmap[6] = { 0, 2, 1, 4, 5, 3 };
+
+static void
+fmt_convert_from_u8(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
+                    const void *vsrc, const int *chmap, int nch, int n)
+{
+    int i, j, ch;
+    const uint8_t *src = vsrc;
+
+    for(ch=0; ch<nch; ch++) {
+        FLOAT *dest_ch = dest[ch];
+        const uint8_t *src_ch = src + chmap[ch];
+        for(i=0, j=0; i<n; i++, j+=nch) {
+            dest_ch[i] = (src_ch[j]-FCONST(128.0)) / FCONST(128.0);
+        }
+    }
+}
+
+static void
+fmt_convert_from_s16(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
+                     const void *vsrc, const int *chmap, int nch, int n)
+{
+    int i, j, ch;
+    const int16_t *src = vsrc;
+
+    for(ch=0; ch<nch; ch++) {
+        FLOAT *dest_ch = dest[ch];
+        const int16_t *src_ch = src + chmap[ch];
+        for(i=0, j=0; i<n; i++, j+=nch) {
+            dest_ch[i] = src_ch[j] / FCONST(32768.0);
+        }
+    }
+}
+
+static void
+fmt_convert_from_s20(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
+                     const void *vsrc, const int *chmap, int nch, int n)
+{
+    int i, j, ch;
+    const int32_t *src = vsrc;
+
+    for(ch=0; ch<nch; ch++) {
+        FLOAT *dest_ch = dest[ch];
+        const int32_t *src_ch = src + chmap[ch];
+        for(i=0, j=0; i<n; i++, j+=nch) {
+            dest_ch[i] = src_ch[j] / FCONST(524288.0);
+        }
+    }
+}
+
+static void
+fmt_convert_from_s24(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
+                     const void *vsrc, const int *chmap, int nch, int n)
+{
+    int i, j, ch;
+    const int32_t *src = vsrc;
+
+    for(ch=0; ch<nch; ch++) {
+        FLOAT *dest_ch = dest[ch];
+        const int32_t *src_ch = src + chmap[ch];
+        for(i=0, j=0; i<n; i++, j+=nch) {
+            dest_ch[i] = src_ch[j] / FCONST(8388608.0);
+        }
+    }
+}
+
+static void
+fmt_convert_from_s32(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
+                     const void *vsrc, const int *chmap, int nch, int n)
+{
+    int i, j, ch;
+    const int32_t *src = vsrc;
+
+    for(ch=0; ch<nch; ch++) {
+        FLOAT *dest_ch = dest[ch];
+        const int32_t *src_ch = src + chmap[ch];
+        for(i=0, j=0; i<n; i++, j+=nch) {
+            dest_ch[i] = src_ch[j] / FCONST(2147483648.0);
+        }
+    }
+}
+
+static void
+fmt_convert_from_float(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
+                       const void *vsrc, const int *chmap, int nch, int n)
+{
+    int i, j, ch;
+    const float *src = vsrc;
+
+    for(ch=0; ch<nch; ch++) {
+        FLOAT *dest_ch = dest[ch];
+        const float *src_ch = src + chmap[ch];
+        for(i=0, j=0; i<n; i++, j+=nch) {
+            dest_ch[i] = src_ch[j];
+        }
+    }
+}
+
+static void
+fmt_convert_from_double(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
+                        const void *vsrc, const int *chmap, int nch, int n)
+{
+    int i, j, ch;
+    const double *src = vsrc;
+
+    for(ch=0; ch<nch; ch++) {
+        FLOAT *dest_ch = dest[ch];
+        const double *src_ch = src + chmap[ch];
+        for(i=0, j=0; i<n; i++, j+=nch) {
+            dest_ch[i] = (FLOAT)src_ch[j];
+        }
+    }
+}
+
+static int
+set_channel_map(A52Context *ctx, AftenContext *s)
+{
+    int ch, nch, used;
+
+    nch = s->channels;
+    for(ch=0; ch<nch; ch++)
+        ctx->chmap[ch] = ch;
+
+    switch(s->channel_order) {
+        case AFTEN_CH_ORDER_A52:
+            break;
+        case AFTEN_CH_ORDER_WAV:
+            if(nch > 2 && s->acmod != A52_ACMOD_2_1 && s->acmod != A52_ACMOD_2_2) {
+                if(nch == 6) {
+                    for(ch=0; ch<6; ch++)
+                        ctx->chmap[ch] = wav_chmap[ch];
+                } else {
+                    ctx->chmap[1] = 2;
+                    ctx->chmap[2] = 1;
+                }
+            }
+            break;
+        case AFTEN_CH_ORDER_MPEG:
+            if(nch > 2 && (s->acmod & 1)) {
+                ctx->chmap[0] = 1;
+                ctx->chmap[1] = 0;
+            }
+            break;
+        case AFTEN_CH_ORDER_CUSTOM:
+            used = 0;
+            for(ch=0; ch<nch; ch++) {
+                int src_ch = s->channel_map[ch];
+                if(src_ch < 0 || src_ch >= nch || (used & (1 << src_ch)))
+                    return -1;
+                used |= 1 << src_ch;
+                ctx->chmap[ch] = src_ch;
+            }
+            break;
+        default:
+            return -1;
+    }
+    return 0;
+}
+
+int
+fmt_convert_init(A52Context *ctx, AftenContext *s)
+{
+    A52SampleFormat fmt = s->sample_format;
+    FmtConvertFunc convert = NULL;
+
+    if(set_channel_map(ctx, s)) {
+        fprintf(stderr, "invalid channel map\n");
+        return -1;
+    }
+
+    switch(fmt) {
+        case A52_SAMPLE_FMT_U8:  convert = fmt_convert_from_u8;
+                                 ctx->sample_size = sizeof(uint8_t);
+                                 break;
+        case A52_SAMPLE_FMT_S16: convert = fmt_convert_from_s16;
+                                 ctx->sample_size = sizeof(int16_t);
+                                 break;
+        case A52_SAMPLE_FMT_S20: convert = fmt_convert_from_s20;
+                                 ctx->sample_size = sizeof(int32_t);
+                                 break;
+        case A52_SAMPLE_FMT_S24: convert = fmt_convert_from_s24;
+                                 ctx->sample_size = sizeof(int32_t);
+                                 break;
+        case A52_SAMPLE_FMT_S32: convert = fmt_convert_from_s32;
+                                 ctx->sample_size = sizeof(int32_t);
+                                 break;
+        case A52_SAMPLE_FMT_FLT: convert = fmt_convert_from_float;
+                                 ctx->sample_size = sizeof(float);
+                                 break;
+        case A52_SAMPLE_FMT_DBL: convert = fmt_convert_from_double;
+                                 ctx->sample_size = sizeof(double);
+                                 break;
+        default:
+            fprintf(stderr, "invalid sample format\n");
+            return -1;
+    }
+#ifdef CONFIG_DOUBLE
+    ctx->float_input = (fmt == A52_SAMPLE_FMT_DBL);
+#else
+    ctx->float_input = (fmt == A52_SAMPLE_FMT_FLT);
+#endif
+
+    // the SIMD versions return NULL for formats they don't handle
+#ifdef HAVE_SSE2
+    if(cpu_caps_have_sse2() && sse2_fmt_convert_select(fmt))
+        convert = sse2_fmt_convert_select(fmt);
+#endif
+#ifdef HAVE_AVX2
+    if(cpu_caps_have_avx2() && avx2_fmt_convert_select(fmt))
+        convert = avx2_fmt_convert_select(fmt);
+#endif
+    ctx->fmt_convert_from_src = convert;
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file convert.h
+ * Input sample format conversion header
+ */
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include "a52.h"
+
+/**
+ * Converts n samples of nch interleaved channels to FLOAT planes.
+ * dest[ch] is filled from input channel chmap[ch], so the input is put
+ * into A/52 order in the same pass.  n must be a multiple of 8.
+ */
+typedef void (*FmtConvertFunc)(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],
+                               const void *vsrc, const int *chmap, int nch,
+                               int n);
+
+/**
+ * Sets up the conversion function and the channel map of the context from
+ * the sample format and channel order of @p s.
+ * Returns -1 if the channel map is invalid.
+ */
+extern int fmt_convert_init(A52Context *ctx, AftenContext *s);
+
+#ifdef HAVE_SSE2
+extern FmtConvertFunc sse2_fmt_convert_select(A52SampleFormat fmt);
+#endif /* HAVE_SSE2 */
+#ifdef HAVE_AVX2
+extern FmtConvertFunc avx2_fmt_convert_select(A52SampleFormat fmt);
+#endif /* HAVE_AVX2 */
+
+#endif /* CONVERT_H */
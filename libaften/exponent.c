@@ -31,7 +31,7 @@
 
 uint16_t expstr_set_bits[6][256];
 
-static void process_exponents(A52ThreadContext *tctx);
+static void process_exponents(A52ThreadContext *tctx, int ch);
 
 /**
  * Initialize exponent group size table
@@ -67,6 +67,14 @@ exponent_init(A52Context *ctx)
         }
     }
 
+    ctx->group_exponents = group_exponents;
+#ifdef HAVE_AVX2
+    if (cpu_caps_have_avx2()) {
+        ctx->process_exponents = avx2_process_exponents;
+        ctx->group_exponents = avx2_group_exponents;
+        return;
+    }
+#endif /* HAVE_AVX2 */
 #ifdef HAVE_SSE2
     if (cpu_caps_have_sse2()) {
         ctx->process_exponents = sse2_process_exponents;
@@ -170,70 +178,85 @@ encode_exp_blk_ch(uint8_t *exp, int ncoefs, int exp_strategy)
 }
 
 
-/**
- * Determine a good exponent strategy for all blocks of a single channel.
- * A pre-defined set of strategies is chosen based on the SSE between each set
- * and the most accurate strategy set (all blocks EXP_D15).
- */
+/* sum of the squared differences between exp[i] and exp1[i] */
 static int
-compute_expstr_ch(uint8_t *exp[A52_NUM_BLOCKS], int ncoefs)
+exponent_sqerr(const uint8_t *exp, const uint8_t *exp1, int n)
 {
-    int blk, str, i, j, k;
-    int min_error, exp_error[6];
-    int err;
-    uint8_t exponents[A52_NUM_BLOCKS][256];
-
-    min_error = 1;
-    for(str=1; str<6; str++) {
-        // collect exponents
-        for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-            memcpy(exponents[blk], exp[blk], 256);
-        }
-
-        // encode exponents
-        i = 0;
-        while(i < A52_NUM_BLOCKS) {
-            j = i + 1;
-            while(j < A52_NUM_BLOCKS && str_predef[str][j]==EXP_REUSE) {
-                exponent_min(exponents[i], exponents[j], ncoefs);
-                j++;
-            }
-            encode_exp_blk_ch(exponents[i], ncoefs, str_predef[str][i]);
-            for(k=i+1; k<j; k++) {
-                memcpy(exponents[k], exponents[i], 256);
-            }
-            i = j;
-        }
+    int i, err, sum;
 
-        // select strategy based on minimum error from unencoded exponents
-        exp_error[str] = 0;
-        for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-            uint8_t *exp_blk = exp[blk];
-            uint8_t *exponents_blk = exponents[blk];
-            for(i=0; i<ncoefs; i++) {
-                err = exp_blk[i] - exponents_blk[i];
-                exp_error[str] += (err * err);
-            }
-        }
-        if(exp_error[str] < exp_error[min_error]) {
-            min_error = str;
-        }
+    sum = 0;
+    for(i=0; i<n; i++) {
+        err = exp[i] - exp1[i];
+        sum += (err * err);
     }
-    return min_error;
+    return sum;
 }
 
 
 /**
- * Runs all the processes in extracting, analyzing, and encoding exponents
+ * Runs all the processes in analyzing and encoding exponents
+ * of a single channel
  */
 static void
-process_exponents(A52ThreadContext *tctx)
+process_exponents(A52ThreadContext *tctx, int ch)
 {
-    extract_exponents(tctx);
+    compute_exponent_strategy(tctx, ch);
 
-    compute_exponent_strategy(tctx);
+    encode_exponents(tctx, ch);
 
-    encode_exponents(tctx);
+    group_exponents(tctx, ch);
+}
 
-    group_exponents(tctx);
+/**
+ * Regroups the exponents of a channel after its bandwidth was lowered.
+ * The exponents encoded for a wider bandwidth are still valid for any lower
+ * one, since the groups start at the same bins and the difference limits
+ * hold for every prefix.  Only the number of groups changes.
+ */
+void
+regroup_exponents_ch(A52ThreadContext *tctx, int ch)
+{
+    tctx->ctx->group_exponents(tctx, ch);
+}
+
+/**
+ * Counts the exponent bits of a channel for a given number of coefficients,
+ * using the exponent strategies of the current frame
+ */
+int
+exponent_bits_ch(A52Frame *frame, int ch, int ncoefs)
+{
+    int blk, expstr, bits;
+
+    if(frame->expstr_set[ch] > 0)
+        return expstr_set_bits[frame->expstr_set[ch]][ncoefs];
+
+    bits = 0;
+    for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
+        expstr = frame->blocks[blk].exp_strategy[ch];
+        if(expstr != EXP_REUSE)
+            bits += (4 + (nexpgrptab[expstr-1][ncoefs] * 7));
+    }
+    return bits;
+}
+
+/**
+ * Counts the bits used by the exponent groups of all blocks and channels
+ */
+void
+compute_exponent_bits(A52ThreadContext *tctx)
+{
+    A52Frame *frame = &tctx->frame;
+    A52Block *block;
+    int blk, ch, bits;
+
+    bits = 0;
+    for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
+        block = &frame->blocks[blk];
+        for(ch=0; ch<tctx->ctx->n_all_channels; ch++) {
+            if(block->exp_strategy[ch] != EXP_REUSE)
+                bits += (4 + (block->nexpgrps[ch] * 7));
+        }
+    }
+    frame->exp_bits = bits;
 }
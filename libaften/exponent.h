@@ -34,11 +34,21 @@ extern uint16_t expstr_set_bits[6][256];
 
 extern void exponent_init(A52Context *ctx);
 
+extern void regroup_exponents_ch(A52ThreadContext *tctx, int ch);
+
+extern int exponent_bits_ch(A52Frame *frame, int ch, int ncoefs);
+
+extern void compute_exponent_bits(A52ThreadContext *tctx);
+
+#ifdef HAVE_AVX2
+extern void avx2_process_exponents(A52ThreadContext *tctx, int ch);
+extern void avx2_group_exponents(A52ThreadContext *tctx, int ch);
+#endif /* HAVE_AVX2 */
 #ifdef HAVE_SSE2
-extern void sse2_process_exponents(A52ThreadContext *tctx);
+extern void sse2_process_exponents(A52ThreadContext *tctx, int ch);
 #endif /* HAVE_SSE2 */
 #ifdef HAVE_MMX
-extern void mmx_process_exponents(A52ThreadContext *tctx);
+extern void mmx_process_exponents(A52ThreadContext *tctx, int ch);
 #endif /* HAVE_MMX */
 
 #endif /* EXPONENT_H */
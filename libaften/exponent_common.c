@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 
 #include "exponent.h"
 #include "a52.h"
@@ -60,168 +61,497 @@ exponent_min(uint8_t *exp, uint8_t *exp1, int n);
 static void
 encode_exp_blk_ch(uint8_t *exp, int ncoefs, int exp_strategy);
 
+/* sum of the squared differences between exp[i] and exp1[i] */
+static int
+exponent_sqerr(const uint8_t *exp, const uint8_t *exp1, int n);
+
+/**
+ * Squared errors of encoded exponent runs.  A run is a block with a new
+ * exponent strategy followed by blocks which reuse its exponents.
+ * err[start block][run length - 1][exponent strategy - 1], negative if it
+ * has not been computed yet.
+ */
+typedef struct ExpRunErrors {
+    int err[A52_NUM_BLOCKS][A52_NUM_BLOCKS][3];
+} ExpRunErrors;
+
+/**
+ * Returns the error of encoding the exponents of blocks start..start+len-1
+ * as a single set with strategy expstr.  Every run is only encoded once, no
+ * matter how many strategy sets share it.
+ */
+static int
+exp_run_error(ExpRunErrors *runs, uint8_t *exp[A52_NUM_BLOCKS], int ncoefs,
+              int start, int len, int expstr)
+{
+    ALIGN16(uint8_t) exponents[256];
+    int *err = &runs->err[start][len-1][expstr-1];
+    int blk;
+
+    if(*err >= 0)
+        return *err;
+
+    memcpy(exponents, exp[start], 256);
+    for(blk=start+1; blk<start+len; blk++)
+        exponent_min(exponents, exp[blk], ncoefs);
+    encode_exp_blk_ch(exponents, ncoefs, expstr);
+
+    *err = 0;
+    for(blk=start; blk<start+len; blk++)
+        *err += exponent_sqerr(exp[blk], exponents, ncoefs);
+    return *err;
+}
+
 /**
  * Determine a good exponent strategy for all blocks of a single channel.
  * A pre-defined set of strategies is chosen based on the SSE between each set
  * and the most accurate strategy set (all blocks EXP_D15).
  */
 static int
-compute_expstr_ch(uint8_t *exp[A52_NUM_BLOCKS], int ncoefs);
+compute_expstr_ch(uint8_t *exp[A52_NUM_BLOCKS], int ncoefs)
+{
+    ExpRunErrors runs;
+    int str, i, j;
+    int min_error, exp_error[6];
+
+    memset(&runs, -1, sizeof(runs));
+
+    min_error = 1;
+    for(str=1; str<6; str++) {
+        exp_error[str] = 0;
+        i = 0;
+        while(i < A52_NUM_BLOCKS) {
+            j = i + 1;
+            while(j < A52_NUM_BLOCKS && str_predef[str][j]==EXP_REUSE)
+                j++;
+            exp_error[str] += exp_run_error(&runs, exp, ncoefs, i, j-i,
+                                            str_predef[str][i]);
+            i = j;
+        }
+        if(exp_error[str] < exp_error[min_error]) {
+            min_error = str;
+        }
+    }
+    return min_error;
+}
 
 /**
- * Runs the per-channel exponent strategy decision function for all channels
+ * Exponent statistics of a run of blocks for each group size.
+ * Index 0 is the DC exponent, index k>0 is exponent group k-1, which for
+ * EXP_D15 is just bin k.  min is the lowest exponent in the group over all
+ * blocks of the run and sum is the sum of its exponents.  The larger groups
+ * are only kept for single blocks, see compute_expstr_dp.  Exponents are at
+ * most 24, so all sums fit in 8 bits.  The groups cover the same bins
+ * whatever their size, so the sum of the squared exponents below ncoefs is a
+ * single number, sqr.  The arrays are aligned for vector access and have room
+ * for reading whole vectors past the last group.
+ */
+typedef struct ExpRunStats {
+    ALIGN32(uint8_t) min[3][256+32];
+    uint8_t sum[3][256+32];
+    int sqr;
+} ExpRunStats;
+
+/**
+ * Finds the last group of each size which is used for ncoefs.  The last
+ * groups of a strategy can reach past ncoefs, and are made from the groups
+ * of the next smaller size.
  */
 static void
-compute_exponent_strategy(A52ThreadContext *tctx)
+exp_stats_range(int last[3], int ncoefs)
 {
-    A52Context *ctx = tctx->ctx;
-    A52Frame *frame = &tctx->frame;
-    A52Block *blocks = frame->blocks;
-    int *ncoefs = frame->ncoefs;
-    uint8_t *exp[A52_MAX_CHANNELS][A52_NUM_BLOCKS];
-    int ch, blk, str;
+    last[2] = nexpgrptab[2][ncoefs] * 3;
+    last[1] = MAX(nexpgrptab[1][ncoefs] * 3, 2 * last[2]);
+    last[0] = MAX(ncoefs - 1, 2 * last[1]);
+}
 
-    if(ctx->params.expstr_fast) {
-        for(ch=0; ch<ctx->n_channels; ch++) {
-            for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-                blocks[blk].exp_strategy[ch] = str_predef[4][blk];
-            }
-            frame->expstr_set[ch] = 4;
+#ifdef CUSTOM_EXP_RUN_STATS
+/* the statistics and the error sums are done by the instruction set code */
+static void
+exp_block_stats(ExpRunStats *st, const uint8_t *exp, int ncoefs);
+
+static int
+exp_run_stats_add(ExpRunStats *run, const ExpRunStats *blk, int len,
+                  int ncoefs);
+
+static int
+exp_sqerr_dot(const uint8_t *v, const uint8_t *sum, int n, int len);
+
+static void
+exp_run_clamp(uint8_t *v, const uint8_t *min, int n);
+#else
+/**
+ * Fills in the statistics of a single block of exponents.
+ */
+static void
+exp_block_stats(ExpRunStats *st, const uint8_t *exp, int ncoefs)
+{
+    int last[3];
+    int g, k;
+
+    exp_stats_range(last, ncoefs);
+    st->sqr = 0;
+    for(k=0; k<ncoefs; k++)
+        st->sqr += exp[k] * exp[k];
+    for(k=0; k<=last[0]; k++) {
+        st->min[0][k] = exp[k];
+        st->sum[0][k] = exp[k];
+    }
+    // each group of the larger sizes is made of two groups of the next
+    // smaller size
+    for(g=1; g<3; g++) {
+        st->min[g][0] = st->min[0][0];
+        st->sum[g][0] = st->sum[0][0];
+        for(k=1; k<=last[g]; k++) {
+            st->min[g][k] = MIN(st->min[g-1][2*k-1], st->min[g-1][2*k]);
+            st->sum[g][k] = st->sum[g-1][2*k-1] + st->sum[g-1][2*k];
         }
-    } else {
-        for(ch=0; ch<ctx->n_channels; ch++) {
-            for(blk=0; blk<A52_NUM_BLOCKS; blk++)
-                exp[ch][blk] = blocks[blk].exp[ch];
+    }
+}
+
+/**
+ * Adds the statistics of one more block to a run, for single bins only.
+ * Like encode_exponents, the minimum is only taken over bins below ncoefs,
+ * the other bins keep the exponents of the first block of the run.  Returns
+ * the EXP_D15 error bound of the longer run of len blocks, see
+ * exp_run_cost_bound.
+ */
+static int
+exp_run_stats_add(ExpRunStats *run, const ExpRunStats *blk, int len,
+                  int ncoefs)
+{
+    int last[3];
+    int k, err;
+
+    exp_stats_range(last, ncoefs);
+    for(k=0; k<ncoefs; k++)
+        run->min[0][k] = MIN(run->min[0][k], blk->min[0][k]);
+    for(k=0; k<=last[0]; k++)
+        run->sum[0][k] += blk->sum[0][k];
+    run->sqr += blk->sqr;
+
+    err = run->sqr;
+    for(k=0; k<ncoefs; k++)
+        err += run->min[0][k] * (len * run->min[0][k] - 2 * run->sum[0][k]);
+    return err;
+}
+
+/**
+ * Returns sum(v[k] * (n * v[k] - 2 * sum[k])) for k < len.
+ */
+static int
+exp_sqerr_dot(const uint8_t *v, const uint8_t *sum, int n, int len)
+{
+    int k, err;
+
+    err = 0;
+    for(k=0; k<len; k++)
+        err += v[k] * (n * v[k] - 2 * sum[k]);
+    return err;
+}
+
+/**
+ * Copies min[0..n-1] to v with the DC value limited to 15 and the difference
+ * between adjacent values limited to +2/-2, the same way encode_exp_blk_ch
+ * does.
+ */
+static void
+exp_run_clamp(uint8_t *v, const uint8_t *min, int n)
+{
+    int i;
+
+    v[0] = MIN(min[0], 15);
+    for(i=1; i<n; i++)
+        v[i] = MIN(min[i], v[i-1]+2);
+    for(i=n-2; i>=0; i--)
+        v[i] = MIN(v[i], v[i+1]+2);
+}
+#endif /* CUSTOM_EXP_RUN_STATS */
+
+/**
+ * Returns the squared error of a run of len blocks when each exponent group
+ * k of strategy expstr is set to v[k].  The value is the same for the whole
+ * group, so sum((e - v)^2) over the group and blocks is computed from the
+ * sums as sqr - 2*v*sum + n*v*v.
+ */
+static int
+exp_run_sqerr(const ExpRunStats *run, const uint8_t *v, int len, int ncoefs,
+              int expstr)
+{
+    const uint8_t *sum;
+    int g, b, k, a, ngrps, nfull, err;
+
+    // groups of strategy expstr are 1 << g bins
+    g = expstr - 1;
+    ngrps = nexpgrptab[g][ncoefs] * 3;
+    sum = run->sum[g];
+
+    err = run->sqr + v[0] * (len * v[0] - 2 * sum[0]);
+    nfull = MIN(ngrps, (ncoefs - 1) >> g);
+    err += exp_sqerr_dot(&v[1], &sum[1], len << g, nfull);
+
+    // the rest is done per bin.  the error is only counted up to ncoefs, and
+    // bins after the last group keep the unencoded minimum.
+    for(b=1+(nfull<<g); b<ncoefs; b++) {
+        k = ((b - 1) >> g) + 1;
+        a = (k <= ngrps) ? v[k] : run->min[0][b];
+        err += a * (len * a - 2 * run->sum[0][b]);
+    }
+    return err;
+}
+
+/**
+ * Returns the squared error of a run of len blocks when its exponents are
+ * encoded with strategy expstr.
+ */
+static int
+exp_run_cost(const ExpRunStats *run, int len, int ncoefs, int expstr)
+{
+    ALIGN32(uint8_t) v[256+32];
+    int ngrps = nexpgrptab[expstr-1][ncoefs] * 3;
 
-            str = compute_expstr_ch(exp[ch], ncoefs[ch]);
-            for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-                blocks[blk].exp_strategy[ch] = str_predef[str][blk];
+    exp_run_clamp(v, run->min[expstr-1], ngrps+1);
+    return exp_run_sqerr(run, v, len, ncoefs, expstr);
+}
+
+/**
+ * Returns a lower bound of exp_run_cost.  The delta limits can only lower
+ * the minimum of a group, and the error grows as the group value goes down
+ * from the minimum.  The bound for EXP_D15 holds for all strategies.
+ */
+static int
+exp_run_cost_bound(const ExpRunStats *run, int len, int ncoefs, int expstr)
+{
+    return exp_run_sqerr(run, run->min[expstr-1], len, ncoefs, expstr);
+}
+
+/**
+ * Weights of the squared exponent error and of the exponent bits in the cost
+ * which is minimized by compute_expstr_dp.  With one exponent bit worth 4
+ * units of squared error, the search spends about as many bits on exponents
+ * as the pre-defined sets do.
+ */
+#define EXPSTR_ERROR_WEIGHT 1
+#define EXPSTR_BITS_WEIGHT  4
+
+/**
+ * Determine the exponent strategies for all blocks of a single channel out
+ * of the sequences of D15, D25, D45 and REUSE in which only D15 is reused,
+ * by minimizing the weighted sum of squared exponent error and exponent
+ * bits.
+ * cost[j] is the lowest cost of blocks 0..j-1, found by trying the runs
+ * which end at block j-1 after the best way to code the blocks before them.
+ * The statistics of the runs are extended by one block at a time, so the
+ * runs are evaluated without encoding any exponents.
+ * EXP_D25 and EXP_D45 are only tried for runs of a single block.  Reusing
+ * their exponents in more blocks is seldom better than one EXP_D15 set, and
+ * trying it would take longer than compute_expstr_ch does.
+ *
+ * The runs are tried in the order of a lower bound of their cost, until the
+ * bound is above the best cost, so that the exponents only have to be
+ * clamped for the few runs which can win.  Of equal costs, the first in the
+ * order of start block and strategy wins, from the last block and EXP_D45
+ * down.
+ */
+static void
+compute_expstr_dp(uint8_t *exp[A52_NUM_BLOCKS], int ncoefs,
+                  uint8_t strategy[A52_NUM_BLOCKS])
+{
+    ExpRunStats runs[A52_NUM_BLOCKS];
+    int cost[A52_NUM_BLOCKS+1];
+    int run_start[A52_NUM_BLOCKS+1];
+    int run_str[A52_NUM_BLOCKS+1];
+    int bits[3];
+    // candidates 0 and 1 are block j-1 with EXP_D45 and EXP_D25, candidate
+    // n>1 is start block j+1-n with EXP_D15
+    int cand_bound[A52_NUM_BLOCKS+2];
+    int blk, i, j, k, n, str, c, best;
+
+    for(str=EXP_D15; str<=EXP_D45; str++) {
+        bits[str-1] = EXPSTR_BITS_WEIGHT * (4 + 7 * nexpgrptab[str-1][ncoefs]);
+    }
+
+    cost[0] = 0;
+    for(j=1; j<=A52_NUM_BLOCKS; j++) {
+        // extend all runs to end at block j-1.  a single block keeps its
+        // own exponents with EXP_D15.
+        exp_block_stats(&runs[j-1], exp[j-1], ncoefs);
+        cand_bound[2] = cost[j-1] + bits[EXP_D15-1];
+        for(i=0; i<j-1; i++) {
+            cand_bound[j+1-i] = cost[i] + bits[EXP_D15-1] +
+                                EXPSTR_ERROR_WEIGHT *
+                                exp_run_stats_add(&runs[i], &runs[j-1], j-i,
+                                                  ncoefs);
+        }
+        for(n=0; n<2; n++) {
+            str = EXP_D45 - n;
+            cand_bound[n] = cost[j-1] + bits[str-1] + EXPSTR_ERROR_WEIGHT *
+                            exp_run_cost_bound(&runs[j-1], 1, ncoefs, str);
+        }
+
+        // try the candidates in the order of their bounds
+        cost[j] = INT_MAX;
+        best = 0;
+        for(;;) {
+            n = 0;
+            for(k=1; k<j+2; k++) {
+                if(cand_bound[k] < cand_bound[n])
+                    n = k;
+            }
+            if(cand_bound[n] > cost[j])
+                break;
+            cand_bound[n] = INT_MAX;
+            i = (n < 2) ? j - 1 : j + 1 - n;
+            str = (n < 2) ? EXP_D45 - n : EXP_D15;
+            c = cost[i] + bits[str-1] + EXPSTR_ERROR_WEIGHT *
+                exp_run_cost(&runs[i], j-i, ncoefs, str);
+            if(c < cost[j] || (c == cost[j] && n < best)) {
+                cost[j] = c;
+                best = n;
+                run_start[j] = i;
+                run_str[j] = str;
             }
-            frame->expstr_set[ch] = str;
         }
     }
 
+    for(j=A52_NUM_BLOCKS; j>0; j=run_start[j]) {
+        strategy[run_start[j]] = run_str[j];
+        for(blk=run_start[j]+1; blk<j; blk++)
+            strategy[blk] = EXP_REUSE;
+    }
+}
+
+/**
+ * Runs the exponent strategy decision function for a single channel
+ */
+static void
+compute_exponent_strategy(A52ThreadContext *tctx, int ch)
+{
+    A52Context *ctx = tctx->ctx;
+    A52Frame *frame = &tctx->frame;
+    A52Block *blocks = frame->blocks;
+    uint8_t *exp[A52_NUM_BLOCKS];
+    int blk, str;
+
     // lfe channel
-    if(ctx->lfe) {
+    if(ch == ctx->lfe_channel) {
+        for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
+            blocks[blk].exp_strategy[ch] = str_predef[1][blk];
+        }
+        return;
+    }
+
+    for(blk=0; blk<A52_NUM_BLOCKS; blk++)
+        exp[blk] = blocks[blk].exp[ch];
+
+    if(ctx->params.expstr_fast == 2) {
+        uint8_t strategy[A52_NUM_BLOCKS];
+
+        compute_expstr_dp(exp, frame->ncoefs[ch], strategy);
         for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-            blocks[blk].exp_strategy[ctx->lfe_channel] = str_predef[1][blk];
+            blocks[blk].exp_strategy[ch] = strategy[blk];
+        }
+        // remember the pre-defined set, if it is one
+        frame->expstr_set[ch] = -1;
+        for(str=1; str<6; str++) {
+            if(!memcmp(strategy, str_predef[str], A52_NUM_BLOCKS))
+                frame->expstr_set[ch] = str;
         }
+        return;
     }
+
+    if(ctx->params.expstr_fast) {
+        str = 4;
+    } else {
+        str = compute_expstr_ch(exp, frame->ncoefs[ch]);
+    }
+    for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
+        blocks[blk].exp_strategy[ch] = str_predef[str][blk];
+    }
+    frame->expstr_set[ch] = str;
 }
 
+#ifndef CUSTOM_GROUP_EXPONENTS
 /**
  * Encode exponent groups.  3 exponents are in per 7-bit group.  The number of
  * groups varies depending on exponent strategy and bandwidth
  */
 static void
-group_exponents(A52ThreadContext *tctx)
+group_exponents(A52ThreadContext *tctx, int ch)
 {
-    A52Context *ctx = tctx->ctx;
     A52Frame *frame = &tctx->frame;
     A52Block *block;
     uint8_t *p;
     int delta[3];
-    int blk, ch, i, gsize, bits;
+    int blk, i, gsize;
     int expstr;
     int exp0, exp1, exp2, exp3;
 
-    bits = 0;
     for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
         block = &frame->blocks[blk];
-        for(ch=0; ch<ctx->n_all_channels; ch++) {
-            expstr = block->exp_strategy[ch];
-            if(expstr == EXP_REUSE) {
-                block->nexpgrps[ch] = 0;
-                continue;
-            }
-            block->nexpgrps[ch] = nexpgrptab[expstr-1][frame->ncoefs[ch]];
-            bits += (4 + (block->nexpgrps[ch] * 7));
-            gsize = expstr + (expstr == EXP_D45);
-            p = block->exp[ch];
-
-            exp1 = *p++;
-            block->grp_exp[ch][0] = exp1;
-
-            for(i=1; i<=block->nexpgrps[ch]; i++) {
-                /* merge three delta into one code */
-                exp0 = exp1;
-                exp1 = p[0];
-                p += gsize;
-                delta[0] = exp1 - exp0 + 2;
-
-                exp2 = p[0];
-                p += gsize;
-                delta[1] = exp2 - exp1 + 2;
-
-                exp3 = p[0];
-                p += gsize;
-                delta[2] = exp3 - exp2 + 2;
-                exp1 = exp3;
-
-                block->grp_exp[ch][i] = ((delta[0]*5+delta[1])*5)+delta[2];
-            }
+        expstr = block->exp_strategy[ch];
+        if(expstr == EXP_REUSE) {
+            block->nexpgrps[ch] = 0;
+            continue;
         }
-    }
-    frame->exp_bits = bits;
-}
+        block->nexpgrps[ch] = nexpgrptab[expstr-1][frame->ncoefs[ch]];
+        gsize = expstr + (expstr == EXP_D45);
+        p = block->exp[ch];
 
-/**
- * Creates final exponents for the entire frame based on exponent strategies.
- * If the strategy for a block & channel is EXP_REUSE, exponents are copied,
- * otherwise they are encoded according to the specific exponent strategy.
- */
-static void
-encode_exponents(A52ThreadContext *tctx)
-{
-    A52Context *ctx = tctx->ctx;
-    A52Frame *frame = &tctx->frame;
-    A52Block *blocks = frame->blocks;
-    int *ncoefs = frame->ncoefs;
-    int ch, i, j, k;
+        exp1 = *p++;
+        block->grp_exp[ch][0] = exp1;
 
-    for(ch=0; ch<ctx->n_all_channels; ch++) {
-        // compute the exponents as the decoder will see them. The
-        // EXP_REUSE case must be handled carefully : we select the
-        // min of the exponents
-        i = 0;
-        while(i < A52_NUM_BLOCKS) {
-            j = i + 1;
-            while(j < A52_NUM_BLOCKS && blocks[j].exp_strategy[ch]==EXP_REUSE) {
-                exponent_min(blocks[i].exp[ch], blocks[j].exp[ch], ncoefs[ch]);
-                j++;
-            }
-            encode_exp_blk_ch(blocks[i].exp[ch], ncoefs[ch],
-                              blocks[i].exp_strategy[ch]);
-            // copy encoded exponents for reuse case
-            for(k=i+1; k<j; k++) {
-                memcpy(blocks[k].exp[ch], blocks[i].exp[ch], ncoefs[ch]);
-            }
-            i = j;
+        for(i=1; i<=block->nexpgrps[ch]; i++) {
+            /* merge three delta into one code */
+            exp0 = exp1;
+            exp1 = p[0];
+            p += gsize;
+            delta[0] = exp1 - exp0 + 2;
+
+            exp2 = p[0];
+            p += gsize;
+            delta[1] = exp2 - exp1 + 2;
+
+            exp3 = p[0];
+            p += gsize;
+            delta[2] = exp3 - exp2 + 2;
+            exp1 = exp3;
+
+            block->grp_exp[ch][i] = ((delta[0]*5+delta[1])*5)+delta[2];
         }
     }
 }
+#endif /* CUSTOM_GROUP_EXPONENTS */
 
 /**
- * Extracts the optimal exponent portion of each MDCT coefficient.
+ * Creates final exponents for a channel based on exponent strategies.
+ * If the strategy for a block is EXP_REUSE, exponents are copied,
+ * otherwise they are encoded according to the specific exponent strategy.
  */
 static void
-extract_exponents(A52ThreadContext *tctx)
+encode_exponents(A52ThreadContext *tctx, int ch)
 {
     A52Frame *frame = &tctx->frame;
-    A52Block *block;
-    int all_channels = tctx->ctx->n_all_channels;
-    int blk, ch, j;
-    uint32_t v1, v2;
+    A52Block *blocks = frame->blocks;
+    int ncoefs = frame->ncoefs[ch];
+    int i, j, k;
 
-    for(ch=0; ch<all_channels; ch++) {
-        for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-            block = &frame->blocks[blk];
-            for(j=0; j<256; j+=2) {
-                v1 = (uint32_t)AFT_FABS(block->mdct_coef[ch][j  ] * FCONST(16777216.0));
-                v2 = (uint32_t)AFT_FABS(block->mdct_coef[ch][j+1] * FCONST(16777216.0));
-                block->exp[ch][j  ] = (v1 == 0)? 24 : 23 - log2i(v1);
-                block->exp[ch][j+1] = (v2 == 0)? 24 : 23 - log2i(v2);
-            }
+    // compute the exponents as the decoder will see them. The
+    // EXP_REUSE case must be handled carefully : we select the
+    // min of the exponents
+    i = 0;
+    while(i < A52_NUM_BLOCKS) {
+        j = i + 1;
+        while(j < A52_NUM_BLOCKS && blocks[j].exp_strategy[ch]==EXP_REUSE) {
+            exponent_min(blocks[i].exp[ch], blocks[j].exp[ch], ncoefs);
+            j++;
+        }
+        encode_exp_blk_ch(blocks[i].exp[ch], ncoefs,
+                          blocks[i].exp_strategy[ch]);
+        // copy encoded exponents for reuse case
+        for(k=i+1; k<j; k++) {
+            memcpy(blocks[k].exp[ch], blocks[i].exp[ch], ncoefs);
         }
+        i = j;
     }
 }
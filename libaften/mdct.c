@@ -415,8 +415,12 @@ mdct_bitreverse(MDCTContext *mdct, FLOAT *x)
     } while(w0 < w1);
 }
 
+/**
+ * The exponents are taken from the output coefficients while they are still
+ * in registers, if exp is not NULL.
+ */
 static void
-mdct(MDCTThreadContext *tmdct, FLOAT *out, FLOAT *in)
+mdct(MDCTThreadContext *tmdct, FLOAT *out, uint8_t *exp, FLOAT *in)
 {
     MDCTContext *mdct = tmdct->mdct;
     int n = mdct->n;
@@ -469,6 +473,20 @@ mdct(MDCTThreadContext *tmdct, FLOAT *out, FLOAT *in)
 
     trig = mdct->trig+n2;
     x0 = out+n2;
+    if(exp) {
+        for(i=0; i<n4; i++) {
+            x0--;
+            r0 = ((w[0]*trig[0]+w[1]*trig[1])*mdct->scale);
+            r1 = ((w[0]*trig[1]-w[1]*trig[0])*mdct->scale);
+            out[i] = r0;
+            x0[0]  = r1;
+            exp[i]      = coef_exponent(r0);
+            exp[n2-1-i] = coef_exponent(r1);
+            w += 2;
+            trig += 2;
+        }
+        return;
+    }
     for(i=0; i<n4; i++) {
         x0--;
         out[i] = ((w[0]*trig[0]+w[1]*trig[1])*mdct->scale);
@@ -479,9 +497,9 @@ mdct(MDCTThreadContext *tmdct, FLOAT *out, FLOAT *in)
 }
 
 static void
-mdct_512(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
+mdct_512(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
 {
-    mdct(&tctx->mdct_tctx_512, out, in);
+    mdct(&tctx->mdct_tctx_512, out, exp, in);
 }
 
 #if 0
@@ -512,7 +530,7 @@ mdct_256(A52Context *ctx, FLOAT *out, FLOAT *in)
 }
 #else
 static void
-mdct_256(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
+mdct_256(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
 {
     FLOAT *coef_a = in;
     FLOAT *coef_b = in+128;
@@ -523,7 +541,7 @@ mdct_256(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
     for(i=0; i<64; i++)
         xx[i+192] = -in[i];
 
-    mdct(&tctx->mdct_tctx_256, coef_a, xx);
+    mdct(&tctx->mdct_tctx_256, coef_a, NULL, xx);
 
     for(i=0; i<64; i++)
         xx[i] = -in[i+256+192];
@@ -532,11 +550,15 @@ mdct_256(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
     for(i=0; i<64; i++)
         xx[i+192] = -in[i+256+128];
 
-    mdct(&tctx->mdct_tctx_256, coef_b, xx);
+    mdct(&tctx->mdct_tctx_256, coef_b, NULL, xx);
 
     for(i=0; i<128; i++) {
         out[2*i  ] = coef_a[i];
         out[2*i+1] = coef_b[i];
+        if(exp) {
+            exp[2*i  ] = coef_exponent(coef_a[i]);
+            exp[2*i+1] = coef_exponent(coef_b[i]);
+        }
     }
 }
 #endif
@@ -48,11 +48,22 @@
 #define AFT_PI2_8 FCONST(0.70710678118654752441)
 #define AFT_PI1_8 FCONST(0.92387953251128675613)
 
+/* maximum number of inputs of a batched transform */
+#define MDCT_BATCH_MAX 8
+/* smaller batches are not faster than transforming the inputs one by one */
+#define MDCT_BATCH_MIN 6
+
 struct A52Context;
 struct A52ThreadContext;
 
 typedef struct {
-    void (*mdct)(struct A52ThreadContext *ctx, FLOAT *out, FLOAT *in);
+    // writes the coefficients to out and, if exp is not NULL, their exponents
+    void (*mdct)(struct A52ThreadContext *ctx, FLOAT *out, uint8_t *exp,
+                 FLOAT *in);
+    // transforms 2 to MDCT_BATCH_MAX inputs at once, or is NULL if there
+    // is no batched version
+    void (*mdct_batch)(struct A52ThreadContext *ctx, FLOAT *out[],
+                       uint8_t *exp[], FLOAT *in[], int count);
     void (*mdct_close)(struct A52Context *ctx);
     FLOAT *trig;
 #ifndef CONFIG_DOUBLE
@@ -77,6 +88,7 @@ typedef struct {
     void (*mdct_thread_close)(struct A52ThreadContext *ctx);
     FLOAT *buffer;
     FLOAT *buffer1;
+    FLOAT *batch_buffer; // scratch of mdct_batch, if any
 } MDCTThreadContext;
 
 extern void mdct_init(struct A52Context *ctx);
@@ -95,10 +107,24 @@ extern void sse3_mdct_init(struct A52Context *ctx);
 extern void sse3_mdct_thread_init(struct A52ThreadContext *tctx);
 #endif
 
+#ifdef HAVE_FMA
+extern void avx2_mdct_init(struct A52Context *ctx);
+extern void avx2_mdct_thread_init(struct A52ThreadContext *tctx);
+#endif
+
 #ifdef HAVE_ALTIVEC
 extern void mdct_init_altivec(struct A52Context *ctx);
 extern void mdct_thread_init_altivec(struct A52ThreadContext *tctx);
 #endif
+#else
+/* these use the buffers of mdct_thread_init() */
+#ifdef HAVE_SSE2
+extern void sse2_mdct_init(struct A52Context *ctx);
+#endif
+
+#ifdef HAVE_FMA
+extern void avx2_mdct_init(struct A52Context *ctx);
+#endif
 #endif /* CONFIG_DOUBLE */
 
 #endif /* MDCT_H */
@@ -647,14 +647,26 @@ mdct_altivec(MDCTThreadContext *tmdct, FLOAT *out, FLOAT *in)
     }
 }
 
+/* the exponents are not fused into the AltiVec transform */
 static void
-mdct_512_altivec(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
+extract_exponents_altivec(const FLOAT *coef, uint8_t *exp)
+{
+    int i;
+
+    for(i=0; i<256; i++)
+        exp[i] = coef_exponent(coef[i]);
+}
+
+static void
+mdct_512_altivec(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
 {
     mdct_altivec(&tctx->mdct_tctx_512, out, in);
+    if(exp)
+        extract_exponents_altivec(out, exp);
 }
 
 static void
-mdct_256_altivec(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
+mdct_256_altivec(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
 {
     FLOAT *coef_a = in;
     FLOAT *coef_b = in+128;
@@ -694,6 +706,8 @@ mdct_256_altivec(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
         vec_st(v0, 0, out+2*i);
         vec_st(v1, 0, out+2*i+4);
     }
+    if(exp)
+        extract_exponents_altivec(out, exp);
 }
 
 void
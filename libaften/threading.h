@@ -25,8 +25,7 @@ typedef enum
 {
     START,
     WORK,
-    END,
-    ABORT
+    END
 } ThreadState;
 
 #ifdef HAVE_POSIX_THREADS
@@ -36,25 +35,17 @@ typedef pthread_t       THREAD;
 typedef pthread_mutex_t MUTEX;
 typedef pthread_cond_t  COND;
 
-typedef struct A52GlobalThreadSync
+/**
+ * Wakeup object for spin-then-park waiting.  The waiter only touches the
+ * mutex once it has given up spinning and announced itself as sleeping.
+ */
+typedef struct A52ThreadEvent
 {
-    int current_thread_num;
-    int threads_to_abort;
-    volatile int samples_thread_num;
-    MUTEX samples_mutex;
-} A52GlobalThreadSync;
-
-typedef struct A52ThreadSync
-{
-    THREAD thread;
-    MUTEX enter_mutex;
-    MUTEX confirm_mutex;
-    COND  enter_cond;
-    COND  confirm_cond;
-
-    COND samples_cond;
-    COND* next_samples_cond;
-} A52ThreadSync;
+    int spin_count;
+    volatile int sleeping;
+    MUTEX mutex;
+    COND  cond;
+} A52ThreadEvent;
 
 #define thread_create(threadid, threadfunc, threadparam) \
     pthread_create(threadid, NULL, (void *(*) (void *))threadfunc, threadparam)
@@ -109,22 +100,12 @@ typedef HANDLE THREAD;
 typedef HANDLE EVENT;
 typedef CRITICAL_SECTION CS;
 
-typedef struct A52GlobalThreadSync
+typedef struct A52ThreadEvent
 {
-    int current_thread_num;
-    int threads_to_abort;
-    volatile int samples_thread_num;
-    CS samples_cs;
-} A52GlobalThreadSync;
-
-typedef struct A52ThreadSync
-{
-    THREAD thread;
-    EVENT ready_event;
-    EVENT enter_event;
-    EVENT samples_event;
-    EVENT* next_samples_event;
-} A52ThreadSync;
+    int spin_count;
+    volatile int sleeping;
+    EVENT event;
+} A52ThreadEvent;
 
 static inline void
 thread_create(HANDLE *thread, int (*threadfunc)(void*), LPVOID threadparam)
@@ -195,7 +176,6 @@ windows_cs_leave(CS *cs)
     LeaveCriticalSection(cs);
 }
 
-
 static inline int
 get_ncpus()
 {
@@ -246,4 +226,115 @@ get_ncpus()
 #define windows_cs_leave(x)
 #endif /* HAVE_WINDOWS_THREADS */
 
+#ifndef NO_THREADS
+
+#if defined(__GNUC__)
+#define thread_memory_barrier() __sync_synchronize()
+#define thread_atomic_inc(x)    __sync_fetch_and_add(x, 1)
+#define thread_atomic_cas_ptr(ptr, oldval, newval) \
+    __sync_bool_compare_and_swap(ptr, oldval, newval)
+#elif defined(_MSC_VER)
+#define thread_memory_barrier() MemoryBarrier()
+#define thread_atomic_inc(x)    (InterlockedIncrement((volatile LONG *)(x)) - 1)
+#define thread_atomic_cas_ptr(ptr, oldval, newval) \
+    (InterlockedCompareExchangePointer((PVOID volatile *)(ptr), newval, oldval) == (oldval))
+#endif
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define thread_cpu_relax() __asm__ __volatile__("rep; nop" ::: "memory")
+#elif defined(_MSC_VER)
+#define thread_cpu_relax() YieldProcessor()
+#else
+#define thread_cpu_relax()
+#endif
+
+/** number of polls before a waiting thread parks itself */
+#define THREAD_SPIN_COUNT 2000
+
+/**
+ * Frame handoff between the encoding thread and one worker.
+ * head and tail are the indices of a single-producer/single-consumer ring
+ * with one slot (the worker's A52Frame).  The caller is the only writer of
+ * head and the worker is the only writer of tail; the slot is full while
+ * they differ.
+ */
+typedef struct A52ThreadSync
+{
+    THREAD thread;
+    volatile int head;
+    volatile int tail;
+    A52ThreadEvent enter_event;
+    A52ThreadEvent ready_event;
+    A52ThreadEvent rc_event;
+    A52ThreadEvent *next_rc_event;
+} A52ThreadSync;
+
+static inline void
+thread_event_init(A52ThreadEvent *ev)
+{
+    // spinning only pays off if the other side can run at the same time
+    ev->spin_count = (get_ncpus() > 1) ? THREAD_SPIN_COUNT : 0;
+    ev->sleeping = 0;
+    posix_mutex_init(&ev->mutex);
+    posix_cond_init(&ev->cond);
+    windows_event_init(&ev->event);
+}
+
+static inline void
+thread_event_destroy(A52ThreadEvent *ev)
+{
+    posix_mutex_destroy(&ev->mutex);
+    posix_cond_destroy(&ev->cond);
+    windows_event_destroy(&ev->event);
+}
+
+/**
+ * Waits until *var equals value.  Polls for a while before parking on the
+ * event, so a quick handoff never enters the kernel.
+ */
+static inline void
+thread_event_wait(A52ThreadEvent *ev, volatile int *var, int value)
+{
+    int spin;
+
+    for(spin=0; spin<ev->spin_count; spin++) {
+        if(*var == value) {
+            thread_memory_barrier();
+            return;
+        }
+        thread_cpu_relax();
+    }
+
+    posix_mutex_lock(&ev->mutex);
+    ev->sleeping = 1;
+    thread_memory_barrier();
+    while(*var != value) {
+        posix_cond_wait(&ev->cond, &ev->mutex);
+        windows_event_wait(&ev->event);
+    }
+    ev->sleeping = 0;
+    posix_mutex_unlock(&ev->mutex);
+    thread_memory_barrier();
+}
+
+/**
+ * Publishes value to *var and wakes the waiter on ev if it has parked.
+ * Everything written before the call is visible to the woken thread.
+ */
+static inline void
+thread_event_post(A52ThreadEvent *ev, volatile int *var, int value)
+{
+    thread_memory_barrier();
+    *var = value;
+    thread_memory_barrier();
+    if(ev->sleeping) {
+        posix_mutex_lock(&ev->mutex);
+        posix_cond_signal(&ev->cond);
+        posix_mutex_unlock(&ev->mutex);
+        windows_event_set(&ev->event);
+    }
+}
+
+#endif /* NO_THREADS */
+
 #endif /* THREADING_H */
@@ -0,0 +1,242 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file threadpool.c
+ * Worker pool shared by encoding contexts
+ *
+ * All contexts using a pool feed frame jobs into a single FIFO queue.  Each
+ * context has at most queue_depth frames in flight, so streams are served in
+ * turn and none of them can starve the others.
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+
+#include "threadpool.h"
+
+#ifndef NO_THREADS
+
+static AftenThreadPool *volatile global_pool = NULL;
+
+static void
+pool_lock(AftenThreadPool *pool)
+{
+    posix_mutex_lock(&pool->mutex);
+    windows_cs_enter(&pool->cs);
+}
+
+static void
+pool_unlock(AftenThreadPool *pool)
+{
+    posix_mutex_unlock(&pool->mutex);
+    windows_cs_leave(&pool->cs);
+}
+
+static int
+pool_worker(void *vpool)
+{
+    AftenThreadPool *pool;
+    ThreadPoolJob *job;
+
+#ifdef MINGW_ALIGN_STACK_HACK
+    asm volatile (
+        "movl %%esp, %%ecx\n"
+        "andl $15, %%ecx\n"
+        "subl %%ecx, %%esp\n"
+        "pushl %%ecx\n"
+        "pushl %%ecx\n"
+        "pushl %%ecx\n"
+        "pushl %%ecx\n"
+        : : : "%esp","%ecx");
+#endif
+
+    pool = vpool;
+
+    pool_lock(pool);
+    while(1) {
+        while(!pool->first && !pool->shutdown) {
+#ifdef HAVE_WINDOWS_THREADS
+            pool_unlock(pool);
+            windows_event_wait(&pool->event);
+            pool_lock(pool);
+#endif
+            posix_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if(!pool->first) {
+            // shutting down; let the next worker see it too
+            windows_event_set(&pool->event);
+            break;
+        }
+
+        job = pool->first;
+        pool->first = job->next;
+        if(!pool->first)
+            pool->last = NULL;
+#ifdef HAVE_WINDOWS_THREADS
+        // the event is auto-reset, so pass the wakeup on to the next worker
+        if(pool->first)
+            windows_event_set(&pool->event);
+#endif
+        pool_unlock(pool);
+
+        job->func(job->arg);
+
+        // the job is not touched again once it has been handed back
+        pool_lock(pool);
+        job->busy = 0;
+        if(job->done)
+            job->done(job->arg);
+        posix_cond_broadcast(&pool->done_cond);
+        windows_event_set(&pool->done_event);
+    }
+    pool_unlock(pool);
+
+#ifdef MINGW_ALIGN_STACK_HACK
+    asm volatile (
+        "popl %%ecx\n"
+        "popl %%ecx\n"
+        "popl %%ecx\n"
+        "popl %%ecx\n"
+        "addl %%ecx, %%esp\n"
+        : : : "%esp", "%ecx");
+#endif
+
+    return 0;
+}
+
+void
+thread_pool_submit(AftenThreadPool *pool, ThreadPoolJob *job)
+{
+    pool_lock(pool);
+    job->next = NULL;
+    job->busy = 1;
+    if(pool->last)
+        pool->last->next = job;
+    else
+        pool->first = job;
+    pool->last = job;
+    posix_cond_signal(&pool->cond);
+    pool_unlock(pool);
+    windows_event_set(&pool->event);
+}
+
+void
+thread_pool_wait(AftenThreadPool *pool, ThreadPoolJob *job)
+{
+    pool_lock(pool);
+    while(job->busy) {
+#ifdef HAVE_WINDOWS_THREADS
+        pool_unlock(pool);
+        windows_event_wait(&pool->done_event);
+        // auto-reset, so pass it on in case another context is waiting
+        windows_event_set(&pool->done_event);
+        pool_lock(pool);
+#endif
+        posix_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    pool_unlock(pool);
+}
+
+#endif /* NO_THREADS */
+
+AftenThreadPool *
+aften_thread_pool_create(int n_threads)
+{
+#ifndef NO_THREADS
+    AftenThreadPool *pool;
+    int i;
+
+    if(n_threads <= 0)
+        n_threads = get_ncpus();
+
+    pool = calloc(1, sizeof(AftenThreadPool));
+    if(!pool)
+        return NULL;
+    pool->threads = calloc(n_threads, sizeof(THREAD));
+    if(!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pool->n_threads = n_threads;
+
+    posix_mutex_init(&pool->mutex);
+    posix_cond_init(&pool->cond);
+    posix_cond_init(&pool->done_cond);
+    windows_cs_init(&pool->cs);
+    windows_event_init(&pool->event);
+    windows_event_init(&pool->done_event);
+
+    for(i=0; i<n_threads; i++)
+        thread_create(&pool->threads[i], pool_worker, pool);
+
+    return pool;
+#else
+    return NULL;
+#endif
+}
+
+void
+aften_thread_pool_destroy(AftenThreadPool *pool)
+{
+#ifndef NO_THREADS
+    int i;
+
+    if(!pool || pool == global_pool)
+        return;
+
+    pool_lock(pool);
+    pool->shutdown = 1;
+    posix_cond_broadcast(&pool->cond);
+    pool_unlock(pool);
+    windows_event_set(&pool->event);
+
+    for(i=0; i<pool->n_threads; i++)
+        thread_join(pool->threads[i]);
+
+    posix_mutex_destroy(&pool->mutex);
+    posix_cond_destroy(&pool->cond);
+    posix_cond_destroy(&pool->done_cond);
+    windows_cs_destroy(&pool->cs);
+    windows_event_destroy(&pool->event);
+    windows_event_destroy(&pool->done_event);
+    free(pool->threads);
+    free(pool);
+#endif
+}
+
+AftenThreadPool *
+aften_thread_pool_global(void)
+{
+#ifndef NO_THREADS
+    AftenThreadPool *pool;
+
+    if(global_pool)
+        return global_pool;
+
+    pool = aften_thread_pool_create(0);
+    if(pool && !thread_atomic_cas_ptr(&global_pool, NULL, pool)) {
+        // another thread got there first
+        aften_thread_pool_destroy(pool);
+    }
+    return global_pool;
+#else
+    return NULL;
+#endif
+}
@@ -0,0 +1,84 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file threadpool.h
+ * Worker pool shared by encoding contexts
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "common.h"
+
+#include "aften.h"
+#include "threading.h"
+
+#ifndef NO_THREADS
+
+/**
+ * A unit of work for the pool.  The job is owned by the submitter, so
+ * submitting never allocates.  done, if set, is called with the pool locked
+ * once func has returned and the job is no longer busy, so it can tell the
+ * submitter that the job may be submitted again or freed.  The job must not
+ * be submitted again before that.
+ */
+typedef struct ThreadPoolJob {
+    void (*func)(void *arg);
+    void (*done)(void *arg);
+    void *arg;
+    struct ThreadPoolJob *next;
+    // set while the job is queued or running
+    volatile int busy;
+} ThreadPoolJob;
+
+struct AftenThreadPool {
+    int n_threads;
+    THREAD *threads;
+
+    // FIFO of pending jobs from all contexts
+    ThreadPoolJob *first;
+    ThreadPoolJob *last;
+    int shutdown;
+
+#ifdef HAVE_POSIX_THREADS
+    MUTEX mutex;
+    COND cond;
+    COND done_cond;
+#else
+    CS cs;
+    EVENT event;
+    EVENT done_event;
+#endif
+};
+
+/**
+ * Appends a job to the queue of the pool.  Jobs are started in the order
+ * they were submitted.
+ */
+void thread_pool_submit(AftenThreadPool *pool, ThreadPoolJob *job);
+
+/**
+ * Waits until func of a submitted job has returned, so whatever the job
+ * refers to can be freed.  Returns at once if the job is not queued.
+ */
+void thread_pool_wait(AftenThreadPool *pool, ThreadPoolJob *job);
+
+#endif /* NO_THREADS */
+
+#endif /* THREADPOOL_H */
@@ -84,6 +84,13 @@ kbd_window_init(A52Context *ctx, FLOAT alpha, FLOAT *window, int n, int iter)
         return;
     }
 #endif /* HAVE_SSE */
+#else
+#ifdef HAVE_SSE2
+    if (cpu_caps_have_sse2()) {
+        ctx->apply_a52_window = sse2_apply_a52_window;
+        return;
+    }
+#endif /* HAVE_SSE2 */
 #endif /* CONFIG_DOUBLE */
     ctx->apply_a52_window = apply_a52_window;
 }
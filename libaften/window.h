@@ -36,6 +36,10 @@ extern void a52_window_init(A52Context *ctx);
 #ifdef HAVE_SSE
 extern void sse_apply_a52_window(FLOAT *samples);
 #endif /* HAVE_SSE */
+#else
+#ifdef HAVE_SSE2
+extern void sse2_apply_a52_window(FLOAT *samples);
+#endif /* HAVE_SSE2 */
 #endif /* CONFIG_DOUBLE */
 
 #endif /* WINDOW_H */
@@ -0,0 +1,280 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file x86_avx2_bitalloc.c
+ * A/52 avx2 optimized bit allocation functions
+ *
+ * The bap and mantissa functions are the same as the ssse3 versions, but do
+ * 32 bins at a time.  The byte shuffles work within each 128-bit lane, so the
+ * tables are repeated in both lanes.
+ *
+ * The psd and masking curve preparation handles all channels of a block at
+ * once, with one channel in each 32-bit lane.
+ */
+
+#include "common.h"
+
+#include "bitalloc.h"
+#include "x86_simd_support.h"
+
+/* looks up 32 addresses in the range 0..63 in baptab, see ssse3 version */
+static inline __m256i
+baptab_lookup(__m256i address, const __m256i lut[4])
+{
+    __m256i bap = _mm256_setzero_si256();
+    int k;
+
+    for(k=0; k<4; k++) {
+        __m256i idx = _mm256_sub_epi8(address, _mm256_set1_epi8(16*k));
+        idx = _mm256_adds_epu8(idx, _mm256_set1_epi8(0x70));
+        bap = _mm256_or_si256(bap, _mm256_shuffle_epi8(lut[k], idx));
+    }
+    return bap;
+}
+
+void
+avx2_compute_bap(uint8_t *bap, const int16_t *psd, const int16_t *thr, int n)
+{
+    __m256i lut[4];
+    __m256i vmax = _mm256_set1_epi16(63);
+    int i, k, address;
+
+    for(k=0; k<4; k++) {
+        lut[k] = _mm256_broadcastsi128_si256(
+                     _mm_loadu_si128((const __m128i *)&baptab[16*k]));
+    }
+
+    for(i=0; i<(n & ~31); i+=32) {
+        __m256i a0 = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)&psd[i]),
+                                      _mm256_loadu_si256((const __m256i *)&thr[i]));
+        __m256i a1 = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)&psd[i+16]),
+                                      _mm256_loadu_si256((const __m256i *)&thr[i+16]));
+        __m256i a;
+        a0 = _mm256_min_epi16(_mm256_srai_epi16(a0, 5), vmax);
+        a1 = _mm256_min_epi16(_mm256_srai_epi16(a1, 5), vmax);
+        // the pack works within lanes, so the quarters need to be reordered
+        a = _mm256_packus_epi16(a0, a1);
+        a = _mm256_permute4x64_epi64(a, _MM_SHUFFLE(3,1,2,0));
+        _mm256_storeu_si256((__m256i *)&bap[i], baptab_lookup(a, lut));
+    }
+    if(n - i >= 16) {
+        __m256i a0 = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)&psd[i]),
+                                      _mm256_loadu_si256((const __m256i *)&thr[i]));
+        __m128i a;
+        a0 = _mm256_min_epi16(_mm256_srai_epi16(a0, 5), vmax);
+        a = _mm_packus_epi16(_mm256_castsi256_si128(a0),
+                             _mm256_extracti128_si256(a0, 1));
+        a = _mm256_castsi256_si128(baptab_lookup(_mm256_castsi128_si256(a), lut));
+        _mm_storeu_si128((__m128i *)&bap[i], a);
+        i += 16;
+    }
+    for(; i<n; i++) {
+        address = (psd[i] - thr[i]) >> 5;
+        address = CLIP(address, 0, 63);
+        bap[i] = baptab[address];
+    }
+}
+
+/* sum of the 32 bytes of v */
+static inline int
+hsum_epu8(__m256i v)
+{
+    __m128i s;
+
+    v = _mm256_sad_epu8(v, _mm256_setzero_si256());
+    s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+}
+
+int
+avx2_compute_mantissa_size(int mant_cnt[5], const uint8_t *bap, int n)
+{
+    __m256i lut = _mm256_broadcastsi128_si256(
+                      _mm_loadu_si128((const __m128i *)bap_bits));
+    __m256i vbits = _mm256_setzero_si256();
+    __m256i cnt[5];
+    __m128i s;
+    int bits, i, b;
+
+    // byte counters can't overflow, as there are at most 8 iterations
+    for(b=1; b<5; b++)
+        cnt[b] = _mm256_setzero_si256();
+    for(i=0; i<(n & ~31); i+=32) {
+        __m256i vbap = _mm256_loadu_si256((const __m256i *)&bap[i]);
+        vbits = _mm256_add_epi64(vbits,
+                    _mm256_sad_epu8(_mm256_shuffle_epi8(lut, vbap),
+                                    _mm256_setzero_si256()));
+        for(b=1; b<5; b++) {
+            cnt[b] = _mm256_sub_epi8(cnt[b],
+                         _mm256_cmpeq_epi8(vbap, _mm256_set1_epi8(b)));
+        }
+    }
+    s = _mm_add_epi64(_mm256_castsi256_si128(vbits),
+                      _mm256_extracti128_si256(vbits, 1));
+    bits = _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+    for(b=1; b<5; b++)
+        mant_cnt[b] += hsum_epu8(cnt[b]);
+
+    for(; i<n; i++) {
+        b = bap[i];
+        if(b <= 4)
+            ++mant_cnt[b];
+        else
+            bits += bap_bits[b];
+    }
+    return bits;
+}
+
+/* loads the int16 at p + idx[lane] bytes for each lane */
+static inline __m256i
+gather_s16(const int16_t *p, __m256i idx)
+{
+    __m256i v = _mm256_i32gather_epi32((const int *)p, idx, 1);
+    return _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+}
+
+/* new lowcomp value, see calc_lowcomp */
+static inline __m256i
+lowcomp_update(__m256i a, __m256i b0, __m256i b1, int bnd)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i eq, gt;
+
+    if(bnd >= 20)
+        return _mm256_max_epi32(_mm256_sub_epi32(a, _mm256_set1_epi32(128)), zero);
+    eq = _mm256_cmpeq_epi32(_mm256_add_epi32(b0, _mm256_set1_epi32(256)), b1);
+    gt = _mm256_cmpgt_epi32(b0, b1);
+    a = _mm256_blendv_epi8(a, _mm256_max_epi32(_mm256_sub_epi32(a,
+                           _mm256_set1_epi32(64)), zero), gt);
+    return _mm256_blendv_epi8(a, _mm256_set1_epi32(bnd < 7 ? 384 : 320), eq);
+}
+
+/**
+ * Same as a52_bit_allocation_prepare for all channels of a block, with a
+ * start of 0 and no delta bit allocation.
+ */
+void
+avx2_bit_alloc_prepare_block(A52BitAllocParams *s, uint8_t exp[][256],
+                             int16_t psd[][256], int16_t mask[][50],
+                             const int *end, int n_channels)
+{
+    ALIGN16(int) tmp[8];
+    int bndend[8];
+    __m256i bndpsd[51];
+    __m256i vend, vbndend, idx;
+    __m256i v, p, adr, lowcomp, fastleak, slowleak, excite, started, guard;
+    __m256i fgain, sgain, fdecay, sdecay, dbknee;
+    int ch, i, bnd, max_bndend;
+
+    // exponent mapping to PSD
+    max_bndend = 0;
+    for(ch=0; ch<8; ch++) {
+        tmp[ch] = 0;
+        bndend[ch] = 0;
+        if(ch >= n_channels || end[ch] <= 0)
+            continue;
+        for(i=0; i<end[ch]; i+=16) {
+            __m256i e = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)&exp[ch][i]));
+            _mm256_storeu_si256((__m256i *)&psd[ch][i],
+                                _mm256_sub_epi16(_mm256_set1_epi16(3072),
+                                                 _mm256_slli_epi16(e, 7)));
+        }
+        tmp[ch] = end[ch];
+        bndend[ch] = masktab[end[ch]-1] + 1;
+        max_bndend = MAX(max_bndend, bndend[ch]);
+    }
+    if(max_bndend == 0)
+        return;
+    vend = _mm256_loadu_si256((const __m256i *)tmp);
+    vbndend = _mm256_loadu_si256((const __m256i *)bndend);
+    // byte offset of the psd of each channel, unused lanes read channel 0
+    for(ch=0; ch<8; ch++)
+        tmp[ch] = (ch < n_channels) ? ch * (int)sizeof(psd[0]) : 0;
+    idx = _mm256_loadu_si256((const __m256i *)tmp);
+
+    // use log addition to combine PSD for each critical band
+    for(bnd=0; bnd<max_bndend; bnd++) {
+        v = gather_s16(&psd[0][bndtab[bnd]], idx);
+        for(i=bndtab[bnd]+1; i<bndtab[bnd+1]; i++) {
+            __m256i active = _mm256_cmpgt_epi32(vend, _mm256_set1_epi32(i));
+            p = gather_s16(&psd[0][i], idx);
+            adr = _mm256_min_epi32(_mm256_srli_epi32(_mm256_abs_epi32(
+                                   _mm256_sub_epi32(v, p)), 1),
+                                   _mm256_set1_epi32(255));
+            adr = _mm256_and_si256(_mm256_i32gather_epi32((const int *)latab,
+                                   adr, 1), _mm256_set1_epi32(0xFF));
+            v = _mm256_blendv_epi8(v, _mm256_add_epi32(_mm256_max_epi32(v, p),
+                                   adr), active);
+        }
+        bndpsd[bnd] = v;
+    }
+    bndpsd[max_bndend] = _mm256_setzero_si256();
+
+    // excitation function and masking curve.  Until the psd rises in one of
+    // the bands 2 to 6, the leaks of a channel are restarted at each band.
+    fgain = _mm256_set1_epi32(s->fgain);
+    sgain = _mm256_set1_epi32(s->sgain);
+    fdecay = _mm256_set1_epi32(s->fdecay);
+    sdecay = _mm256_set1_epi32(s->sdecay);
+    dbknee = _mm256_set1_epi32(s->dbknee);
+    lowcomp = fastleak = slowleak = started = _mm256_setzero_si256();
+    for(bnd=0; bnd<max_bndend; bnd++) {
+        p = bndpsd[bnd];
+        guard = _mm256_cmpgt_epi32(vbndend, _mm256_set1_epi32(bnd+1));
+        if(bnd < 22) {
+            __m256i lc = lowcomp_update(lowcomp, p, bndpsd[bnd+1], bnd);
+            lowcomp = (bnd < 2) ? lc : _mm256_blendv_epi8(lowcomp, lc, guard);
+        }
+        fastleak = _mm256_max_epi32(_mm256_sub_epi32(fastleak, fdecay),
+                                    _mm256_sub_epi32(p, fgain));
+        slowleak = _mm256_max_epi32(_mm256_sub_epi32(slowleak, sdecay),
+                                    _mm256_sub_epi32(p, sgain));
+        if(bnd < 22) {
+            excite = _mm256_max_epi32(slowleak, _mm256_sub_epi32(fastleak, lowcomp));
+        } else {
+            excite = _mm256_max_epi32(slowleak, fastleak);
+        }
+        if(bnd < 7) {
+            __m256i f = _mm256_sub_epi32(p, fgain);
+            fastleak = _mm256_blendv_epi8(f, fastleak, started);
+            slowleak = _mm256_blendv_epi8(_mm256_sub_epi32(p, sgain), slowleak,
+                                          started);
+            excite = _mm256_blendv_epi8(_mm256_sub_epi32(f, lowcomp), excite,
+                                        started);
+            if(bnd >= 2) {
+                __m256i rise = _mm256_andnot_si256(
+                                   _mm256_cmpgt_epi32(p, bndpsd[bnd+1]), guard);
+                started = _mm256_or_si256(started, rise);
+            }
+        }
+
+        // apply the dB knee and the hearing threshold
+        excite = _mm256_add_epi32(excite, _mm256_and_si256(
+                     _mm256_cmpgt_epi32(dbknee, p),
+                     _mm256_srai_epi32(_mm256_sub_epi32(dbknee, p), 2)));
+        excite = _mm256_max_epi32(excite,
+                     _mm256_set1_epi32(hth[bnd >> s->halfratecod][s->fscod]));
+
+        _mm256_storeu_si256((__m256i *)tmp, excite);
+        for(ch=0; ch<n_channels; ch++) {
+            if(bnd < bndend[ch])
+                mask[ch][bnd] = tmp[ch];
+        }
+    }
+}
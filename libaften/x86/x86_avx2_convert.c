@@ -0,0 +1,267 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file x86_avx2_convert.c
+ * AVX2 optimized input sample format conversion
+ *
+ * Eight frames of interleaved input are converted at a time, or four in the
+ * double build.  The channels are then gathered from the converted frames in
+ * A/52 order.
+ */
+
+#include "common.h"
+
+#include <string.h>
+
+#include "convert.h"
+#include "x86_simd_support.h"
+
+#ifndef CONFIG_DOUBLE
+
+/* converts 8 consecutive input samples to float */
+
+static inline __m256
+load8_u8(const uint8_t *src)
+{
+    __m256i vi = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)src));
+    return _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(vi),
+                                       _mm256_set1_ps(128.0f)),
+                         _mm256_set1_ps(1.0f / 128.0f));
+}
+
+static inline __m256
+load8_s16(const int16_t *src)
+{
+    __m256i vi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)src));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(vi), _mm256_set1_ps(1.0f / 32768.0f));
+}
+
+static inline __m256
+load8_s32_scaled(const int32_t *src, float scale)
+{
+    __m256i vi = _mm256_loadu_si256((const __m256i *)src);
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(vi), _mm256_set1_ps(scale));
+}
+
+static inline __m256
+load8_s20(const int32_t *src)
+{
+    return load8_s32_scaled(src, 1.0f / 524288.0f);
+}
+
+static inline __m256
+load8_s24(const int32_t *src)
+{
+    return load8_s32_scaled(src, 1.0f / 8388608.0f);
+}
+
+static inline __m256
+load8_s32(const int32_t *src)
+{
+    return load8_s32_scaled(src, 1.0f / 2147483648.0f);
+}
+
+static inline __m256
+load8_float(const float *src)
+{
+    return _mm256_loadu_ps(src);
+}
+
+static inline __m256
+load8_double(const double *src)
+{
+    __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(src));
+    __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(src+4));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+/**
+ * Stereo is de-interleaved with in-lane shuffles and a cross-lane permute.
+ * For more channels, the converted frames are stored to a small buffer and
+ * each channel is gathered from there with a stride of nch.
+ */
+#define AVX2_FMT_CONVERT(NAME, TYPE)                                          \
+static void                                                                   \
+avx2_fmt_convert_from_##NAME(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],\
+                             const void *vsrc, const int *chmap, int nch,     \
+                             int n)                                           \
+{                                                                             \
+    const TYPE *src = vsrc;                                                   \
+    int i, j, ch;                                                             \
+                                                                              \
+    if(nch == 1) {                                                            \
+        for(i=0; i<n; i+=8)                                                   \
+            _mm256_storeu_ps(&dest[0][i], load8_##NAME(&src[i]));             \
+    } else if(nch == 2) {                                                     \
+        /* a map of two channels is its own inverse */                        \
+        FLOAT *dest0 = dest[chmap[0]];                                        \
+        FLOAT *dest1 = dest[chmap[1]];                                        \
+        for(i=0; i<n; i+=8) {                                                 \
+            __m256 v0 = load8_##NAME(&src[2*i]);                              \
+            __m256 v1 = load8_##NAME(&src[2*i+8]);                            \
+            __m256 c0 = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(2,0,2,0));      \
+            __m256 c1 = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(3,1,3,1));      \
+            c0 = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(c0), \
+                                                        _MM_SHUFFLE(3,1,2,0)));\
+            c1 = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(c1), \
+                                                        _MM_SHUFFLE(3,1,2,0)));\
+            _mm256_storeu_ps(&dest0[i], c0);                                  \
+            _mm256_storeu_ps(&dest1[i], c1);                                  \
+        }                                                                     \
+    } else {                                                                  \
+        ALIGN16(float) tmp[8*A52_MAX_CHANNELS];                               \
+        __m256i vidx = _mm256_mullo_epi32(_mm256_setr_epi32(0,1,2,3,4,5,6,7), \
+                                          _mm256_set1_epi32(nch));            \
+        for(i=0; i<n; i+=8) {                                                 \
+            for(j=0; j<nch; j++)                                              \
+                _mm256_storeu_ps(&tmp[8*j], load8_##NAME(&src[i*nch+8*j]));   \
+            for(ch=0; ch<nch; ch++) {                                         \
+                _mm256_storeu_ps(&dest[ch][i],                                \
+                    _mm256_i32gather_ps(&tmp[chmap[ch]], vidx, 4));           \
+            }                                                                 \
+        }                                                                     \
+    }                                                                         \
+}
+
+#else /* CONFIG_DOUBLE */
+
+/* converts 4 consecutive input samples to double */
+
+static inline __m256d
+load4_u8(const uint8_t *src)
+{
+    int32_t v;
+    __m128i vi;
+
+    memcpy(&v, src, 4);
+    vi = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+    return _mm256_mul_pd(_mm256_sub_pd(_mm256_cvtepi32_pd(vi),
+                                       _mm256_set1_pd(128.0)),
+                         _mm256_set1_pd(1.0 / 128.0));
+}
+
+static inline __m256d
+load4_s16(const int16_t *src)
+{
+    __m128i vi = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)src));
+    return _mm256_mul_pd(_mm256_cvtepi32_pd(vi), _mm256_set1_pd(1.0 / 32768.0));
+}
+
+static inline __m256d
+load4_s32_scaled(const int32_t *src, double scale)
+{
+    __m128i vi = _mm_loadu_si128((const __m128i *)src);
+    return _mm256_mul_pd(_mm256_cvtepi32_pd(vi), _mm256_set1_pd(scale));
+}
+
+static inline __m256d
+load4_s20(const int32_t *src)
+{
+    return load4_s32_scaled(src, 1.0 / 524288.0);
+}
+
+static inline __m256d
+load4_s24(const int32_t *src)
+{
+    return load4_s32_scaled(src, 1.0 / 8388608.0);
+}
+
+static inline __m256d
+load4_s32(const int32_t *src)
+{
+    return load4_s32_scaled(src, 1.0 / 2147483648.0);
+}
+
+static inline __m256d
+load4_float(const float *src)
+{
+    return _mm256_cvtps_pd(_mm_loadu_ps(src));
+}
+
+static inline __m256d
+load4_double(const double *src)
+{
+    return _mm256_loadu_pd(src);
+}
+
+#define AVX2_FMT_CONVERT(NAME, TYPE)                                          \
+static void                                                                   \
+avx2_fmt_convert_from_##NAME(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],\
+                             const void *vsrc, const int *chmap, int nch,     \
+                             int n)                                           \
+{                                                                             \
+    const TYPE *src = vsrc;                                                   \
+    int i, j, ch;                                                             \
+                                                                              \
+    if(nch == 1) {                                                            \
+        for(i=0; i<n; i+=4)                                                   \
+            _mm256_storeu_pd(&dest[0][i], load4_##NAME(&src[i]));             \
+    } else if(nch == 2) {                                                     \
+        /* a map of two channels is its own inverse */                        \
+        FLOAT *dest0 = dest[chmap[0]];                                        \
+        FLOAT *dest1 = dest[chmap[1]];                                        \
+        for(i=0; i<n; i+=4) {                                                 \
+            __m256d v0 = load4_##NAME(&src[2*i]);                             \
+            __m256d v1 = load4_##NAME(&src[2*i+4]);                           \
+            __m256d c0 = _mm256_unpacklo_pd(v0, v1);                          \
+            __m256d c1 = _mm256_unpackhi_pd(v0, v1);                          \
+            _mm256_storeu_pd(&dest0[i],                                       \
+                             _mm256_permute4x64_pd(c0, _MM_SHUFFLE(3,1,2,0)));\
+            _mm256_storeu_pd(&dest1[i],                                       \
+                             _mm256_permute4x64_pd(c1, _MM_SHUFFLE(3,1,2,0)));\
+        }                                                                     \
+    } else {                                                                  \
+        ALIGN16(double) tmp[4*A52_MAX_CHANNELS];                              \
+        __m128i vidx = _mm_mullo_epi32(_mm_setr_epi32(0,1,2,3),               \
+                                       _mm_set1_epi32(nch));                  \
+        for(i=0; i<n; i+=4) {                                                 \
+            for(j=0; j<nch; j++)                                              \
+                _mm256_storeu_pd(&tmp[4*j], load4_##NAME(&src[i*nch+4*j]));   \
+            for(ch=0; ch<nch; ch++) {                                         \
+                _mm256_storeu_pd(&dest[ch][i],                                \
+                    _mm256_i32gather_pd(&tmp[chmap[ch]], vidx, 8));           \
+            }                                                                 \
+        }                                                                     \
+    }                                                                         \
+}
+
+#endif /* CONFIG_DOUBLE */
+
+AVX2_FMT_CONVERT(u8,     uint8_t)
+AVX2_FMT_CONVERT(s16,    int16_t)
+AVX2_FMT_CONVERT(s20,    int32_t)
+AVX2_FMT_CONVERT(s24,    int32_t)
+AVX2_FMT_CONVERT(s32,    int32_t)
+AVX2_FMT_CONVERT(float,  float)
+AVX2_FMT_CONVERT(double, double)
+
+FmtConvertFunc
+avx2_fmt_convert_select(A52SampleFormat fmt)
+{
+    switch(fmt) {
+        case A52_SAMPLE_FMT_U8:  return avx2_fmt_convert_from_u8;
+        case A52_SAMPLE_FMT_S16: return avx2_fmt_convert_from_s16;
+        case A52_SAMPLE_FMT_S20: return avx2_fmt_convert_from_s20;
+        case A52_SAMPLE_FMT_S24: return avx2_fmt_convert_from_s24;
+        case A52_SAMPLE_FMT_S32: return avx2_fmt_convert_from_s32;
+        case A52_SAMPLE_FMT_FLT: return avx2_fmt_convert_from_float;
+        case A52_SAMPLE_FMT_DBL: return avx2_fmt_convert_from_double;
+    }
+    return NULL;
+}
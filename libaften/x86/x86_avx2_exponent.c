@@ -0,0 +1,604 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file x86_avx2_exponent.c
+ * A/52 avx2 optimized exponent functions
+ *
+ * The +2/-2 delta constraint is a chain of dependent MIN operations.  It is
+ * done here as a prefix minimum over exp[i]-2*i (and a suffix minimum over
+ * exp[i]+2*i for the backward pass), which gives the same result and can be
+ * computed with log-step shifts.
+ */
+
+/* avx2_group_exponents replaces the generic grouping */
+#define CUSTOM_GROUP_EXPONENTS
+/* the run statistics of the strategy search are done here */
+#define CUSTOM_EXP_RUN_STATS
+#include "exponent_common.c"
+#include "x86_simd_support.h"
+
+/* larger than any exponent plus offset, and still safe to add 2*256 to */
+#define EXP_BIG 0x3FFF
+
+/* set exp[i] to min(exp[i], exp1[i]) */
+static void
+exponent_min(uint8_t *exp, uint8_t *exp1, int n)
+{
+    int i;
+
+    for(i=0; i<(n & ~31); i+=32) {
+        __m256i vexp = _mm256_loadu_si256((__m256i*)&exp[i]);
+        __m256i vexp1 = _mm256_loadu_si256((__m256i*)&exp1[i]);
+        _mm256_storeu_si256((__m256i*)&exp[i], _mm256_min_epu8(vexp, vexp1));
+    }
+    for(; i<n; ++i)
+        exp[i] = MIN(exp[i], exp1[i]);
+}
+
+/* in-lane prefix minimum of 16-bit values, shifting in EXP_BIG */
+static inline __m256i
+prefix_min_epi16(__m256i v, __m256i vbig)
+{
+    v = _mm256_min_epi16(v, _mm256_alignr_epi8(v, vbig, 14));
+    v = _mm256_min_epi16(v, _mm256_alignr_epi8(v, vbig, 12));
+    v = _mm256_min_epi16(v, _mm256_alignr_epi8(v, vbig, 8));
+    return v;
+}
+
+/* in-lane suffix minimum of 16-bit values, shifting in EXP_BIG */
+static inline __m256i
+suffix_min_epi16(__m256i v, __m256i vbig)
+{
+    v = _mm256_min_epi16(v, _mm256_alignr_epi8(vbig, v, 2));
+    v = _mm256_min_epi16(v, _mm256_alignr_epi8(vbig, v, 4));
+    v = _mm256_min_epi16(v, _mm256_alignr_epi8(vbig, v, 8));
+    return v;
+}
+
+/**
+ * Limits the difference between adjacent values of a[0..n-1] to +2/-2 by
+ * lowering values, exactly like a forward and a backward MIN pass would.
+ * The DC value a[0] is limited to 15 first.  a must have room for n rounded
+ * up to a multiple of 16.
+ */
+static void
+clamp_exp_deltas(int16_t *a, int n)
+{
+    const __m256i vbig = _mm256_set1_epi16(EXP_BIG);
+    const __m256i vstep = _mm256_set1_epi16(32);
+    const __m256i vlast = _mm256_set1_epi16(0x0F0E);
+    const __m256i vfirst = _mm256_set1_epi16(0x0100);
+    __m256i vramp, vcarry, v, b;
+    int i, nv;
+
+    a[0] = MIN(a[0], 15);
+    nv = (n + 15) & ~15;
+    for(i=n; i<nv; i++)
+        a[i] = EXP_BIG;
+
+    // forward: a[i] = min over j<=i of (a[j] - 2*j) + 2*i
+    vramp = _mm256_setr_epi16(0, 2, 4, 6, 8, 10, 12, 14,
+                              16, 18, 20, 22, 24, 26, 28, 30);
+    vcarry = vbig;
+    for(i=0; i<nv; i+=16) {
+        v = _mm256_sub_epi16(_mm256_loadu_si256((__m256i*)&a[i]), vramp);
+        v = prefix_min_epi16(v, vbig);
+        b = _mm256_shuffle_epi8(v, vlast);
+        v = _mm256_min_epi16(v, _mm256_permute2x128_si256(b, vbig, 0x02));
+        v = _mm256_min_epi16(v, vcarry);
+        b = _mm256_shuffle_epi8(v, vlast);
+        vcarry = _mm256_permute2x128_si256(b, b, 0x11);
+        _mm256_storeu_si256((__m256i*)&a[i], _mm256_add_epi16(v, vramp));
+        vramp = _mm256_add_epi16(vramp, vstep);
+    }
+
+    // backward: a[i] = min over j>=i of (a[j] + 2*j) - 2*i
+    vcarry = vbig;
+    for(i=nv-16; i>=0; i-=16) {
+        vramp = _mm256_sub_epi16(vramp, vstep);
+        v = _mm256_add_epi16(_mm256_loadu_si256((__m256i*)&a[i]), vramp);
+        v = suffix_min_epi16(v, vbig);
+        b = _mm256_shuffle_epi8(v, vfirst);
+        v = _mm256_min_epi16(v, _mm256_permute2x128_si256(b, vbig, 0x31));
+        v = _mm256_min_epi16(v, vcarry);
+        b = _mm256_shuffle_epi8(v, vfirst);
+        vcarry = _mm256_permute2x128_si256(b, b, 0x00);
+        _mm256_storeu_si256((__m256i*)&a[i], _mm256_sub_epi16(v, vramp));
+    }
+}
+
+
+/**
+ * Update the exponents so that they are the ones the decoder will decode.
+ * Constrain DC exponent, group exponents based on strategy, constrain delta
+ * between adjacent exponents to +2/-2.
+ */
+static void
+encode_exp_blk_ch(uint8_t *exp, int ncoefs, int exp_strategy)
+{
+    ALIGN16(int16_t) a[256+16];
+    int grpsize, ngrps, i, k, exp_min1, exp_min2;
+    uint8_t v;
+
+    ngrps = nexpgrptab[exp_strategy-1][ncoefs] * 3;
+    grpsize = exp_strategy + (exp_strategy == EXP_D45);
+
+    // a[0] is the DC exponent, a[1..ngrps] are the group minimums
+    a[0] = exp[0];
+    switch(grpsize) {
+    case 1:
+        // for D15 strategy, there is no need to group/ungroup exponents
+        for(i=0; i<((ngrps+1) & ~15); i+=16) {
+            __m128i v1 = _mm_loadu_si128((__m128i*)&exp[i]);
+            _mm256_storeu_si256((__m256i*)&a[i], _mm256_cvtepu8_epi16(v1));
+        }
+        for(; i<=ngrps; i++)
+            a[i] = exp[i];
+        break;
+    case 2:
+        for(i=0,k=1; i<(ngrps & ~15); i+=16, k+=32) {
+            __m256i v1 = _mm256_loadu_si256((__m256i*)&exp[k]);
+            __m256i v2 = _mm256_srli_epi16(v1, 8);
+            v1 = _mm256_and_si256(v1, _mm256_set1_epi16(0xFF));
+            _mm256_storeu_si256((__m256i*)&a[i+1], _mm256_min_epi16(v1, v2));
+        }
+        for(; i<ngrps; i++, k+=2)
+            a[i+1] = MIN(exp[k], exp[k+1]);
+        break;
+    default:
+        for(i=0,k=1; i<(ngrps & ~7); i+=8, k+=32) {
+            __m256i v1 = _mm256_loadu_si256((__m256i*)&exp[k]);
+            v1 = _mm256_min_epu8(v1, _mm256_srli_epi16(v1, 8));
+            v1 = _mm256_min_epu8(v1, _mm256_srli_epi32(v1, 16));
+            v1 = _mm256_and_si256(v1, _mm256_set1_epi32(0xFF));
+            v1 = _mm256_packus_epi32(v1, v1);
+            v1 = _mm256_permute4x64_epi64(v1, _MM_SHUFFLE(3,1,2,0));
+            _mm_storeu_si128((__m128i*)&a[i+1], _mm256_castsi256_si128(v1));
+        }
+        for(; i<ngrps; i++, k+=4) {
+            exp_min1 = MIN(exp[k  ], exp[k+1]);
+            exp_min2 = MIN(exp[k+2], exp[k+3]);
+            a[i+1]   = MIN(exp_min1, exp_min2);
+        }
+        break;
+    }
+
+    // now we get the exponent values the decoder will see
+    clamp_exp_deltas(a, ngrps+1);
+
+    switch(grpsize) {
+    case 1:
+        for(i=0; i<((ngrps+1) & ~15); i+=16) {
+            __m128i v1 = _mm_loadu_si128((__m128i*)&a[i]);
+            __m128i v2 = _mm_loadu_si128((__m128i*)&a[i+8]);
+            _mm_storeu_si128((__m128i*)&exp[i], _mm_packus_epi16(v1, v2));
+        }
+        for(; i<=ngrps; i++)
+            exp[i] = a[i];
+        break;
+    case 2:
+        exp[0] = a[0];
+        for(i=0,k=1; i<(ngrps & ~15); i+=16, k+=32) {
+            __m256i v1 = _mm256_loadu_si256((__m256i*)&a[i+1]);
+            v1 = _mm256_or_si256(v1, _mm256_slli_epi16(v1, 8));
+            _mm256_storeu_si256((__m256i*)&exp[k], v1);
+        }
+        for(; i<ngrps; i++, k+=2) {
+            v = a[i+1];
+            exp[k] = v;
+            exp[k+1] = v;
+        }
+        break;
+    default:
+        exp[0] = a[0];
+        for(i=0,k=1; i<(ngrps & ~7); i+=8, k+=32) {
+            __m256i v1 = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i*)&a[i+1]));
+            v1 = _mm256_mullo_epi32(v1, _mm256_set1_epi32(0x01010101));
+            _mm256_storeu_si256((__m256i*)&exp[k], v1);
+        }
+        for(; i<ngrps; i++, k+=4) {
+            v = a[i+1];
+            exp[k] = v;
+            exp[k+1] = v;
+            exp[k+2] = v;
+            exp[k+3] = v;
+        }
+        break;
+    }
+}
+
+
+/* sum of the squared differences between exp[i] and exp1[i] */
+static int
+exponent_sqerr(const uint8_t *exp, const uint8_t *exp1, int n)
+{
+    __m256i vres = _mm256_setzero_si256();
+    __m128i vsum;
+    int i, err, sum;
+
+    // exponents are at most 24, so a squared error fits in a byte
+    // multiply and a pair of them in 16 bits
+    for(i=0; i<(n & ~31); i+=32) {
+        __m256i vexp = _mm256_loadu_si256((__m256i*)&exp[i]);
+        __m256i vexp2 = _mm256_loadu_si256((__m256i*)&exp1[i]);
+        __m256i verr = _mm256_abs_epi8(_mm256_sub_epi8(vexp, vexp2));
+        verr = _mm256_maddubs_epi16(verr, verr);
+        verr = _mm256_madd_epi16(verr, _mm256_set1_epi16(1));
+        vres = _mm256_add_epi32(vres, verr);
+    }
+    vsum = _mm_add_epi32(_mm256_castsi256_si128(vres),
+                         _mm256_extracti128_si256(vres, 1));
+    vsum = _mm_add_epi32(vsum, _mm_srli_si128(vsum, 8));
+    vsum = _mm_add_epi32(vsum, _mm_srli_si128(vsum, 4));
+    sum = _mm_cvtsi128_si32(vsum);
+    for(; i<n; i++) {
+        err = exp[i] - exp1[i];
+        sum += (err * err);
+    }
+    return sum;
+}
+
+
+/* sum of the 32-bit values of v */
+static inline int
+hsum_epi32(__m256i v)
+{
+    __m128i vsum = _mm_add_epi32(_mm256_castsi256_si128(v),
+                                 _mm256_extracti128_si256(v, 1));
+    vsum = _mm_add_epi32(vsum, _mm_srli_si128(vsum, 8));
+    vsum = _mm_add_epi32(vsum, _mm_srli_si128(vsum, 4));
+    return _mm_cvtsi128_si32(vsum);
+}
+
+/* 0..31, compared against a count to mask off the tail of a vector */
+#define VIDX_EPI8 _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, \
+                                   12, 13, 14, 15, 16, 17, 18, 19, 20, 21, \
+                                   22, 23, 24, 25, 26, 27, 28, 29, 30, 31)
+
+/* mask of the bytes of a vector which are below count */
+static inline __m256i
+tail_mask_epi8(int count)
+{
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(MIN(count, 32)), VIDX_EPI8);
+}
+
+/**
+ * Makes groups 1 to last of a size from groups 2k-1 and 2k of the next
+ * smaller size.  Loaded from 2k-1, the two groups are a 16-bit pair.
+ */
+static inline void
+exp_stats_pairs(uint8_t *min, uint8_t *sum, const uint8_t *min1,
+                const uint8_t *sum1, int last)
+{
+    const __m256i vone = _mm256_set1_epi8(1);
+    const __m256i vlow = _mm256_set1_epi16(0xFF);
+    __m256i m0, m1, s0, s1;
+    int k;
+
+    for(k=1; k<=last; k+=32) {
+        m0 = _mm256_loadu_si256((__m256i*)&min1[2*k-1]);
+        m1 = _mm256_loadu_si256((__m256i*)&min1[2*k+31]);
+        m0 = _mm256_and_si256(_mm256_min_epu8(m0, _mm256_srli_epi16(m0, 8)),
+                              vlow);
+        m1 = _mm256_and_si256(_mm256_min_epu8(m1, _mm256_srli_epi16(m1, 8)),
+                              vlow);
+        s0 = _mm256_maddubs_epi16(_mm256_loadu_si256((__m256i*)&sum1[2*k-1]),
+                                  vone);
+        s1 = _mm256_maddubs_epi16(_mm256_loadu_si256((__m256i*)&sum1[2*k+31]),
+                                  vone);
+        // packing works per lane, the permute puts the groups back in order
+        _mm256_storeu_si256((__m256i*)&min[k],
+            _mm256_permute4x64_epi64(_mm256_packus_epi16(m0, m1), 0xD8));
+        _mm256_storeu_si256((__m256i*)&sum[k],
+            _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), 0xD8));
+    }
+}
+
+/**
+ * Fills in the statistics of a single block of exponents.
+ */
+static void
+exp_block_stats(ExpRunStats *st, const uint8_t *exp, int ncoefs)
+{
+    const __m256i vone = _mm256_set1_epi16(1);
+    __m256i v, vsqr;
+    int last[3];
+    int g, k;
+
+    exp_stats_range(last, ncoefs);
+    vsqr = _mm256_setzero_si256();
+    for(k=0; k<=last[0]; k+=32) {
+        v = _mm256_loadu_si256((__m256i*)&exp[k]);
+        _mm256_storeu_si256((__m256i*)&st->min[0][k], v);
+        _mm256_storeu_si256((__m256i*)&st->sum[0][k], v);
+        // only the bins below ncoefs are in the squared sum
+        v = _mm256_and_si256(v, tail_mask_epi8(ncoefs - k));
+        vsqr = _mm256_add_epi32(vsqr, _mm256_madd_epi16(
+                _mm256_maddubs_epi16(v, v), vone));
+    }
+    st->sqr = hsum_epi32(vsqr);
+
+    for(g=1; g<3; g++) {
+        st->min[g][0] = st->min[0][0];
+        st->sum[g][0] = st->sum[0][0];
+        exp_stats_pairs(st->min[g], st->sum[g], st->min[g-1], st->sum[g-1],
+                        last[g]);
+    }
+}
+
+/**
+ * Adds the statistics of one more block to a run, for single bins only.
+ * Like encode_exponents, the minimum is only taken over bins below ncoefs,
+ * the other bins keep the exponents of the first block of the run.  Returns
+ * the EXP_D15 error bound of the longer run of len blocks, see
+ * exp_run_cost_bound, which is summed up while the bins are updated.
+ */
+static int
+exp_run_stats_add(ExpRunStats *run, const ExpRunStats *blk, int len,
+                  int ncoefs)
+{
+    const __m256i vlen = _mm256_set1_epi16(len);
+    const __m256i vone = _mm256_set1_epi16(1);
+    __m256i v, vmin, vsum, vmask, verr;
+    int last[3];
+    int k;
+
+    exp_stats_range(last, ncoefs);
+    verr = _mm256_setzero_si256();
+    for(k=0; k<=last[0]; k+=32) {
+        v = _mm256_loadu_si256((__m256i*)&run->min[0][k]);
+        vmin = _mm256_min_epu8(v,
+                _mm256_loadu_si256((__m256i*)&blk->min[0][k]));
+        vsum = _mm256_add_epi8(_mm256_loadu_si256((__m256i*)&run->sum[0][k]),
+                _mm256_loadu_si256((__m256i*)&blk->sum[0][k]));
+        if(k > ncoefs - 32) {
+            vmask = tail_mask_epi8(ncoefs - k);
+            vmin = _mm256_blendv_epi8(v, vmin, vmask);
+            v = _mm256_and_si256(vmin, vmask);
+        } else {
+            v = vmin;
+        }
+        _mm256_storeu_si256((__m256i*)&run->min[0][k], vmin);
+        _mm256_storeu_si256((__m256i*)&run->sum[0][k], vsum);
+        v = _mm256_sub_epi16(
+                _mm256_mullo_epi16(_mm256_maddubs_epi16(v, v), vlen),
+                _mm256_slli_epi16(_mm256_maddubs_epi16(vsum, v), 1));
+        verr = _mm256_add_epi32(verr, _mm256_madd_epi16(v, vone));
+    }
+    run->sqr += blk->sqr;
+    return run->sqr + hsum_epi32(verr);
+}
+
+/**
+ * Returns sum(v[k] * (n * v[k] - 2 * sum[k])) for k < len.  Reads v and sum
+ * up to len rounded up to a multiple of 32.  A pair of the terms fits in 16
+ * bits for the sums of ExpRunStats.
+ */
+static int
+exp_sqerr_dot(const uint8_t *v, const uint8_t *sum, int n, int len)
+{
+    const __m256i vn = _mm256_set1_epi16(n);
+    const __m256i vone = _mm256_set1_epi16(1);
+    __m256i vacc, vv, vs, vd;
+    int k;
+
+    vacc = _mm256_setzero_si256();
+    for(k=0; k<len; k+=32) {
+        vv = _mm256_loadu_si256((__m256i*)&v[k]);
+        vs = _mm256_loadu_si256((__m256i*)&sum[k]);
+        if(k > len - 32)
+            vv = _mm256_and_si256(vv, tail_mask_epi8(len - k));
+        vd = _mm256_sub_epi16(
+                _mm256_mullo_epi16(_mm256_maddubs_epi16(vv, vv), vn),
+                _mm256_slli_epi16(_mm256_maddubs_epi16(vs, vv), 1));
+        vacc = _mm256_add_epi32(vacc, _mm256_madd_epi16(vd, vone));
+    }
+    return hsum_epi32(vacc);
+}
+
+/* in-lane prefix minimum of bytes, shifting in 0xFF */
+static inline __m256i
+prefix_min_epu8(__m256i v, __m256i vbig)
+{
+    v = _mm256_min_epu8(v, _mm256_alignr_epi8(v, vbig, 15));
+    v = _mm256_min_epu8(v, _mm256_alignr_epi8(v, vbig, 14));
+    v = _mm256_min_epu8(v, _mm256_alignr_epi8(v, vbig, 12));
+    v = _mm256_min_epu8(v, _mm256_alignr_epi8(v, vbig, 8));
+    return v;
+}
+
+/* in-lane suffix minimum of bytes, shifting in 0xFF */
+static inline __m256i
+suffix_min_epu8(__m256i v, __m256i vbig)
+{
+    v = _mm256_min_epu8(v, _mm256_alignr_epi8(vbig, v, 1));
+    v = _mm256_min_epu8(v, _mm256_alignr_epi8(vbig, v, 2));
+    v = _mm256_min_epu8(v, _mm256_alignr_epi8(vbig, v, 4));
+    v = _mm256_min_epu8(v, _mm256_alignr_epi8(vbig, v, 8));
+    return v;
+}
+
+/**
+ * Copies min[0..n-1] to v with the DC value limited to 15 and the difference
+ * between adjacent values limited to +2/-2, the same way encode_exp_blk_ch
+ * does.  This is clamp_exp_deltas on bytes.  The ramps are taken from the
+ * end of each vector instead of from bin 0, so they fit in a byte, and the
+ * value carried to the next vector is 64 more than the one it comes from.
+ * v must have room for n rounded up to a multiple of 32.
+ */
+static void
+exp_run_clamp(uint8_t *v, const uint8_t *min, int n)
+{
+    const __m256i vbig = _mm256_set1_epi8(-1);
+    const __m256i vstep = _mm256_set1_epi8(64);
+    const __m256i vlast = _mm256_set1_epi8(15);
+    const __m256i vfirst = _mm256_setzero_si256();
+    const __m256i vdown = _mm256_setr_epi8(62, 60, 58, 56, 54, 52, 50, 48,
+                                           46, 44, 42, 40, 38, 36, 34, 32,
+                                           30, 28, 26, 24, 22, 20, 18, 16,
+                                           14, 12, 10, 8, 6, 4, 2, 0);
+    const __m256i vup = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+                                         16, 18, 20, 22, 24, 26, 28, 30,
+                                         32, 34, 36, 38, 40, 42, 44, 46,
+                                         48, 50, 52, 54, 56, 58, 60, 62);
+    __m256i vdc, vcarry, x, b;
+    int i, nv;
+
+    nv = (n + 31) & ~31;
+
+    // forward: v[i] = min over j<=i of (min[j] + 62 - 2*j) - 62 + 2*i, with
+    // j and i counted from the start of the vector
+    vdc = _mm256_setr_epi8(15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                           -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                           -1, -1, -1, -1, -1, -1, -1, -1);
+    vcarry = vbig;
+    for(i=0; i<nv; i+=32) {
+        x = _mm256_min_epu8(_mm256_loadu_si256((__m256i*)&min[i]), vdc);
+        vdc = vbig;
+        // the values past n must not lower anything in the backward pass
+        if(i > n - 32)
+            x = _mm256_or_si256(x, _mm256_xor_si256(tail_mask_epi8(n - i), vbig));
+        x = prefix_min_epu8(_mm256_adds_epu8(x, vdown), vbig);
+        b = _mm256_shuffle_epi8(x, vlast);
+        x = _mm256_min_epu8(x, _mm256_permute2x128_si256(b, vbig, 0x02));
+        x = _mm256_min_epu8(x, vcarry);
+        b = _mm256_shuffle_epi8(x, vlast);
+        vcarry = _mm256_adds_epu8(_mm256_permute2x128_si256(b, b, 0x11), vstep);
+        _mm256_storeu_si256((__m256i*)&v[i], _mm256_sub_epi8(x, vdown));
+    }
+
+    // backward: v[i] = min over j>=i of (v[j] + 2*j) - 2*i
+    vcarry = vbig;
+    for(i=nv-32; i>=0; i-=32) {
+        x = _mm256_adds_epu8(_mm256_loadu_si256((__m256i*)&v[i]), vup);
+        x = suffix_min_epu8(x, vbig);
+        b = _mm256_shuffle_epi8(x, vfirst);
+        x = _mm256_min_epu8(x, _mm256_permute2x128_si256(b, vbig, 0x31));
+        x = _mm256_min_epu8(x, vcarry);
+        b = _mm256_shuffle_epi8(x, vfirst);
+        vcarry = _mm256_adds_epu8(_mm256_permute2x128_si256(b, b, 0x00), vstep);
+        _mm256_storeu_si256((__m256i*)&v[i], _mm256_sub_epi8(x, vup));
+    }
+}
+
+/**
+ * Encode exponent groups.  Eight groups are done at a time.  The three
+ * deltas of a group combine to -25*e0 + 20*e1 + 4*e2 + e3 + 62, where e0 is
+ * the last exponent of the previous group.
+ */
+void
+avx2_group_exponents(A52ThreadContext *tctx, int ch)
+{
+    A52Frame *frame = &tctx->frame;
+    A52Block *block;
+    uint8_t *p;
+    int delta[3];
+    int blk, i, g, gsize, ngrps;
+    int expstr;
+    int exp0, exp1, exp2, exp3;
+
+    for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
+        block = &frame->blocks[blk];
+        expstr = block->exp_strategy[ch];
+        if(expstr == EXP_REUSE) {
+            block->nexpgrps[ch] = 0;
+            continue;
+        }
+        ngrps = nexpgrptab[expstr-1][frame->ncoefs[ch]];
+        block->nexpgrps[ch] = ngrps;
+        gsize = expstr + (expstr == EXP_D45);
+        p = block->exp[ch];
+
+        block->grp_exp[ch][0] = p[0];
+
+        {
+            const __m256i vbyte = _mm256_set1_epi32(0xFF);
+            __m256i vg = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            __m256i vgstep = _mm256_set1_epi32(3*gsize);
+            __m256i vgs = _mm256_set1_epi32(gsize);
+            // bin of the first exponent of each group
+            __m256i vidx = _mm256_add_epi32(_mm256_mullo_epi32(vg, vgstep),
+                                            _mm256_set1_epi32(1));
+            vgstep = _mm256_mullo_epi32(vgstep, _mm256_set1_epi32(8));
+
+            // each gather reads 3 bytes past the exponent, which stays
+            // inside the 256 bytes of the block
+            for(g=0; g<(ngrps & ~7); g+=8) {
+                __m256i i1 = vidx;
+                __m256i i2 = _mm256_add_epi32(i1, vgs);
+                __m256i i3 = _mm256_add_epi32(i2, vgs);
+                __m256i i0 = _mm256_max_epi32(_mm256_sub_epi32(i1, vgs),
+                                              _mm256_setzero_si256());
+                __m256i e0 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)p, i0, 1), vbyte);
+                __m256i e1 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)p, i1, 1), vbyte);
+                __m256i e2 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)p, i2, 1), vbyte);
+                __m256i e3 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)p, i3, 1), vbyte);
+                __m256i code = _mm256_add_epi32(e3, _mm256_set1_epi32(62));
+                __m128i c16;
+                code = _mm256_sub_epi32(code, _mm256_mullo_epi32(e0, _mm256_set1_epi32(25)));
+                code = _mm256_add_epi32(code, _mm256_mullo_epi32(e1, _mm256_set1_epi32(20)));
+                code = _mm256_add_epi32(code, _mm256_slli_epi32(e2, 2));
+                c16 = _mm_packus_epi32(_mm256_castsi256_si128(code),
+                                       _mm256_extracti128_si256(code, 1));
+                _mm_storel_epi64((__m128i*)&block->grp_exp[ch][g+1],
+                                 _mm_packus_epi16(c16, c16));
+                vidx = _mm256_add_epi32(vidx, vgstep);
+            }
+        }
+
+        // remaining groups
+        i = g + 1;
+        p += (g == 0) ? 0 : 1 + (3*g - 1) * gsize;
+        exp1 = *p;
+        p += (g == 0) ? 1 : gsize;
+        for(; i<=ngrps; i++) {
+            /* merge three delta into one code */
+            exp0 = exp1;
+            exp1 = p[0];
+            p += gsize;
+            delta[0] = exp1 - exp0 + 2;
+
+            exp2 = p[0];
+            p += gsize;
+            delta[1] = exp2 - exp1 + 2;
+
+            exp3 = p[0];
+            p += gsize;
+            delta[2] = exp3 - exp2 + 2;
+            exp1 = exp3;
+
+            block->grp_exp[ch][i] = ((delta[0]*5+delta[1])*5)+delta[2];
+        }
+    }
+}
+
+
+/**
+ * Runs all the processes in analyzing and encoding exponents
+ * of a single channel
+ */
+void
+avx2_process_exponents(A52ThreadContext *tctx, int ch)
+{
+    compute_exponent_strategy(tctx, ch);
+
+    encode_exponents(tctx, ch);
+
+    avx2_group_exponents(tctx, ch);
+}
@@ -0,0 +1,914 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file x86_avx2_mdct.c
+ * AVX2/FMA optimized MDCT
+ *
+ * This is the algorithm of x86_sse_mdct_common.c with the two 4-float halves
+ * of each SSE step in the two lanes of one ymm register, and with fused
+ * multiply-adds.  The lanes often need different twiddle factors, so the
+ * trig tables of the SSE init are reordered in 4-float blocks to have them
+ * next to each other.  There is also a batched transform of up to 8 inputs,
+ * which follows the C version instead.
+ */
+
+#include "common.h"
+
+#include <string.h>
+
+#include "a52.h"
+#include "mdct.h"
+#include "x86_simd_support.h"
+#include "x86_sse_mdct_common_init.h"
+
+static const union __m256ui PCS_RRRR_NNNN = {{0x00000000, 0x00000000, 0x00000000, 0x00000000,
+                                              0x80000000, 0x80000000, 0x80000000, 0x80000000}};
+static const union __m256ui PCS_NNNN_RRRR = {{0x80000000, 0x80000000, 0x80000000, 0x80000000,
+                                              0x00000000, 0x00000000, 0x00000000, 0x00000000}};
+static const union __m256ui PCS_RNNR_NNRR = {{0x00000000, 0x80000000, 0x80000000, 0x00000000,
+                                              0x80000000, 0x80000000, 0x00000000, 0x00000000}};
+static const union __m256ui PCS_RNRN_RNRN = {{0x00000000, 0x80000000, 0x00000000, 0x80000000,
+                                              0x00000000, 0x80000000, 0x00000000, 0x80000000}};
+
+#define PERM8(a,b,c,d,e,f,g,h) _mm256_setr_epi32(a,b,c,d,e,f,g,h)
+
+/* 8 point butterfly, on a register */
+static inline __m256
+avx2_mdct_butterfly_8(__m256 x)
+{
+    // x4-x0 in the low lane and x4+x0 in the high lane
+    __m256 v = _mm256_add_ps(_mm256_permute2f128_ps(x, x, 0x01),
+                             _mm256_xor_ps(x, PCS_NNNN_RRRR.v));
+    __m256 a = _mm256_permutevar_ps(v, PERM8(2,3,2,3, 2,3,2,3));
+    __m256 b = _mm256_permutevar_ps(v, PERM8(1,0,1,0, 0,1,0,1));
+    return _mm256_add_ps(a, _mm256_xor_ps(b, PCS_RNNR_NNRR.v));
+}
+
+/* 16 point butterfly, on 2 registers */
+static inline void
+avx2_mdct_butterfly_16(__m256 *lo, __m256 *hi)
+{
+    static const union __m256f PFV02 = {{ AFT_PI2_8,  AFT_PI2_8, 1.f, -1.f,
+                                          AFT_PI2_8,  AFT_PI2_8, 1.f,  1.f }};
+    static const union __m256f PFV13 = {{ AFT_PI2_8, -AFT_PI2_8, 0.f,  0.f,
+                                         -AFT_PI2_8,  AFT_PI2_8, 0.f,  0.f }};
+    __m256 d, a, b;
+
+    // x0-x8 in the low lane and x12-x4 in the high lane
+    d = _mm256_xor_ps(_mm256_sub_ps(*lo, *hi), PCS_RRRR_NNNN.v);
+    *hi = _mm256_add_ps(*hi, *lo);
+    a = _mm256_permutevar_ps(d, PERM8(1,1,3,2, 0,0,2,3));
+    b = _mm256_permutevar_ps(d, PERM8(0,0,3,2, 1,1,2,3));
+    *lo = _mm256_fmadd_ps(a, PFV02.v, _mm256_mul_ps(b, PFV13.v));
+
+    *lo = avx2_mdct_butterfly_8(*lo);
+    *hi = avx2_mdct_butterfly_8(*hi);
+}
+
+/* 32 point butterfly (in place) */
+static inline void
+avx2_mdct_butterfly_32(FLOAT *x)
+{
+    static const union __m256f PFV02 = {{ -AFT_PI3_8, -AFT_PI1_8, -AFT_PI2_8, -AFT_PI2_8,
+                                          -AFT_PI1_8, -AFT_PI3_8,       -1.f,        1.f }};
+    static const union __m256f PFV13 = {{ -AFT_PI1_8,  AFT_PI3_8, -AFT_PI2_8,  AFT_PI2_8,
+                                          -AFT_PI3_8,  AFT_PI1_8,        0.f,        0.f }};
+    static const union __m256f PFV46 = {{  AFT_PI3_8,  AFT_PI3_8,  AFT_PI2_8,  AFT_PI2_8,
+                                           AFT_PI1_8,  AFT_PI3_8,        1.f,        1.f }};
+    static const union __m256f PFV57 = {{ -AFT_PI1_8,  AFT_PI1_8, -AFT_PI2_8,  AFT_PI2_8,
+                                          -AFT_PI3_8,  AFT_PI1_8,        0.f,        0.f }};
+    __m256 x0 = _mm256_loadu_ps(x   );
+    __m256 x1 = _mm256_loadu_ps(x+ 8);
+    __m256 x2 = _mm256_loadu_ps(x+16);
+    __m256 x3 = _mm256_loadu_ps(x+24);
+    __m256 d0 = _mm256_sub_ps(x2, x0);
+    __m256 d1 = _mm256_sub_ps(x3, x1);
+    __m256 a, b;
+
+    x2 = _mm256_add_ps(x2, x0);
+    x3 = _mm256_add_ps(x3, x1);
+
+    a  = _mm256_permutevar_ps(d0, PERM8(1,1,3,3, 1,1,3,2));
+    b  = _mm256_permutevar_ps(d0, PERM8(0,0,2,2, 0,0,3,2));
+    x0 = _mm256_fmadd_ps(a, PFV02.v, _mm256_mul_ps(b, PFV13.v));
+    a  = _mm256_permutevar_ps(d1, PERM8(0,1,2,2, 0,0,2,3));
+    b  = _mm256_permutevar_ps(d1, PERM8(1,0,3,3, 1,1,2,3));
+    x1 = _mm256_fmadd_ps(a, PFV46.v, _mm256_mul_ps(b, PFV57.v));
+
+    avx2_mdct_butterfly_16(&x0, &x1);
+    avx2_mdct_butterfly_16(&x2, &x3);
+
+    _mm256_storeu_ps(x   , x0);
+    _mm256_storeu_ps(x+ 8, x1);
+    _mm256_storeu_ps(x+16, x2);
+    _mm256_storeu_ps(x+24, x3);
+}
+
+/* N point first stage butterfly (in place) */
+static inline void
+avx2_mdct_butterfly_first(FLOAT *trig, FLOAT *x, int points)
+{
+    float *x1 = x +  points     - 8;
+    float *x2 = x + (points>>1) - 8;
+
+    do {
+        __m256 v1 = _mm256_loadu_ps(x1);
+        __m256 v2 = _mm256_loadu_ps(x2);
+        __m256 d  = _mm256_sub_ps(v1, v2);
+        _mm256_storeu_ps(x1, _mm256_add_ps(v1, v2));
+        _mm256_storeu_ps(x2, _mm256_fmadd_ps(_mm256_movehdup_ps(d),
+                                             _mm256_loadu_ps(trig+8),
+                             _mm256_mul_ps(_mm256_moveldup_ps(d),
+                                           _mm256_loadu_ps(trig))));
+        x1   -= 8;
+        x2   -= 8;
+        trig += 16;
+    } while(x2 >= x);
+}
+
+/**
+ * N/stage point generic N stage butterfly (in place).  Only the stages with
+ * a trig table are used by the A/52 transform sizes.
+ */
+static inline void
+avx2_mdct_butterfly_generic(MDCTContext *mdct, FLOAT *x, int points,
+                            int trigint)
+{
+    float *T;
+    float *x1 = x +  points     - 8;
+    float *x2 = x + (points>>1) - 8;
+
+    switch(trigint) {
+        case  8: T = mdct->trig_butterfly_generic8;  break;
+        case 16: T = mdct->trig_butterfly_generic16; break;
+        case 32: T = mdct->trig_butterfly_generic32; break;
+        default: T = mdct->trig_butterfly_generic64; break;
+    }
+    do {
+        __m256 v1 = _mm256_loadu_ps(x1);
+        __m256 v2 = _mm256_loadu_ps(x2);
+        __m256 d  = _mm256_sub_ps(v1, v2);
+        _mm256_storeu_ps(x1, _mm256_add_ps(v1, v2));
+        _mm256_storeu_ps(x2, _mm256_fmadd_ps(_mm256_movehdup_ps(d),
+                                             _mm256_loadu_ps(T),
+                             _mm256_mul_ps(_mm256_moveldup_ps(d),
+                                           _mm256_loadu_ps(T+8))));
+        T  += 16;
+        x1 -= 8;
+        x2 -= 8;
+    } while(x2 >= x);
+}
+
+static inline void
+avx2_mdct_butterflies(MDCTContext *mdct, FLOAT *x, int points)
+{
+    FLOAT *trig = mdct->trig_butterfly_first;
+    int stages = mdct->log2n-5;
+    int i, j;
+
+    if(--stages > 0) {
+        avx2_mdct_butterfly_first(trig, x, points);
+    }
+
+    for(i=1; --stages>0; i++) {
+        for(j=0; j<(1<<i); j++)
+            avx2_mdct_butterfly_generic(mdct, x+(points>>i)*j, points>>i, 4<<i);
+    }
+
+    for(j=0; j<points; j+=32)
+        avx2_mdct_butterfly_32(x+j);
+}
+
+static inline __m256
+load2_m128(const float *lo, const float *hi)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)),
+                                _mm_loadu_ps(hi), 1);
+}
+
+/* two steps of the SSE bit-reverse at a time, one in each lane */
+static inline void
+avx2_mdct_bitreverse(MDCTContext *mdct, FLOAT *x)
+{
+    int    n   = mdct->n;
+    int   *bit = mdct->bitrev;
+    float *w0  = x;
+    float *w1  = x = w0+(n>>1);
+    float *T   = mdct->trig_bitreverse;
+
+    do {
+        __m256 a = load2_m128(x+bit[0], x+bit[4]);
+        __m256 b = load2_m128(x+bit[1], x+bit[5]);
+        __m256 c = load2_m128(x+bit[2], x+bit[6]);
+        __m256 d = load2_m128(x+bit[3], x+bit[7]);
+        __m256 r0, r1, r2, s0, s1;
+        w1 -= 8;
+
+        r0 = _mm256_add_ps(_mm256_shuffle_ps(a, c, _MM_SHUFFLE(0,1,0,1)),
+                           _mm256_xor_ps(_mm256_shuffle_ps(b, d, _MM_SHUFFLE(0,1,0,1)),
+                                         PCS_RNRN_RNRN.v));
+        s0 = _mm256_add_ps(_mm256_shuffle_ps(a, c, _MM_SHUFFLE(0,0,0,0)),
+                           _mm256_shuffle_ps(b, d, _MM_SHUFFLE(0,0,0,0)));
+        s1 = _mm256_sub_ps(_mm256_shuffle_ps(a, c, _MM_SHUFFLE(1,1,1,1)),
+                           _mm256_shuffle_ps(b, d, _MM_SHUFFLE(1,1,1,1)));
+        r2 = _mm256_fmadd_ps(s0, _mm256_loadu_ps(T),
+                             _mm256_mul_ps(s1, _mm256_loadu_ps(T+8)));
+        r0 = _mm256_mul_ps(r0, _mm256_set1_ps(0.5f));
+
+        r1 = _mm256_addsub_ps(_mm256_xor_ps(r0, PCS_RNRN_RNRN.v), r2);
+        r0 = _mm256_add_ps(r0, r2);
+
+        _mm256_storeu_ps(w0, r0);
+        // the pairs of both steps are stored in reverse order
+        _mm256_storeu_ps(w1, _mm256_castpd_ps(_mm256_permute4x64_pd(
+                                 _mm256_castps_pd(r1), _MM_SHUFFLE(0,1,2,3))));
+
+        T   += 16;
+        bit += 8;
+        w0  += 8;
+    } while(w0 < w1);
+}
+
+/**
+ * Exponents of the 8 coefficients of a and the 8 of b, as 16 bytes.
+ * They are read from the exponent fields, see coef_exponent().
+ */
+static inline __m128i
+avx2_coef_exponents(__m256 a, __m256 b)
+{
+    __m256i ea = _mm256_srli_epi32(_mm256_slli_epi32(_mm256_castps_si256(a), 1), 24);
+    __m256i eb = _mm256_srli_epi32(_mm256_slli_epi32(_mm256_castps_si256(b), 1), 24);
+    __m256i e  = _mm256_permute4x64_epi64(_mm256_packs_epi32(ea, eb),
+                                          _MM_SHUFFLE(3,1,2,0));
+    e = _mm256_sub_epi16(_mm256_set1_epi16(126), e);
+    e = _mm256_min_epi16(e, _mm256_set1_epi16(24));
+    // the unsigned saturation clips negative exponents to 0
+    return _mm_packus_epi16(_mm256_castsi256_si128(e),
+                            _mm256_extracti128_si256(e, 1));
+}
+
+/* pairs of 2 floats of r, reordered by a permute4x64 selector */
+#define PERMUTE_PAIRS(r, sel) \
+    _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), sel))
+
+/**
+ * The exponents are taken from the output coefficients while they are still
+ * in registers, if exp is not NULL.
+ */
+static void
+avx2_mdct(MDCTThreadContext *tmdct, FLOAT *out, uint8_t *exp, FLOAT *in)
+{
+    MDCTContext *mdct = tmdct->mdct;
+    int n = mdct->n;
+    int n2 = n>>1;
+    int n4 = n>>2;
+    int n8 = n>>3;
+    FLOAT *w = tmdct->buffer;
+    FLOAT *w2 = w+n2;
+    float *x0 = in+n2+n4-8;
+    float *x1;
+    float *T = mdct->trig_forward;
+    const __m256i rev = PERM8(7,6,5,4,3,2,1,0);
+    int i, j;
+
+    for(i=0,j=n2-2; i<n8; i+=4,j-=4) {
+        __m256 v = _mm256_add_ps(_mm256_permutevar8x32_ps(_mm256_loadu_ps(x0), rev),
+                                 _mm256_loadu_ps(x0+i*4+8));
+        __m256 r = _mm256_fmsub_ps(_mm256_shuffle_ps(v, v, _MM_SHUFFLE(0,0,3,3)),
+                                   _mm256_loadu_ps(T),
+                   _mm256_mul_ps(_mm256_shuffle_ps(v, v, _MM_SHUFFLE(2,2,1,1)),
+                                 _mm256_loadu_ps(T+8)));
+        r = PERMUTE_PAIRS(r, _MM_SHUFFLE(1,3,2,0));
+        _mm_storeu_ps(w2+i  , _mm256_castps256_ps128(r));
+        _mm_storeu_ps(w2+j-2, _mm256_extractf128_ps(r, 1));
+        x0 -= 8;
+        T  += 16;
+    }
+
+    x0 = in;
+    x1 = in+n2-8;
+
+    for(; i<n4; i+=4,j-=4) {
+        __m256 v = _mm256_sub_ps(_mm256_loadu_ps(x0),
+                                 _mm256_permutevar8x32_ps(_mm256_loadu_ps(x1), rev));
+        __m256 r = _mm256_fmadd_ps(_mm256_shuffle_ps(v, v, _MM_SHUFFLE(0,0,3,3)),
+                                   _mm256_loadu_ps(T),
+                   _mm256_mul_ps(_mm256_shuffle_ps(v, v, _MM_SHUFFLE(2,2,1,1)),
+                                 _mm256_loadu_ps(T+8)));
+        r = PERMUTE_PAIRS(r, _MM_SHUFFLE(1,3,2,0));
+        _mm_storeu_ps(w2+i  , _mm256_castps256_ps128(r));
+        _mm_storeu_ps(w2+j-2, _mm256_extractf128_ps(r, 1));
+        x0 += 8;
+        x1 -= 8;
+        T  += 16;
+    }
+
+    avx2_mdct_butterflies(mdct, w2, n2);
+    avx2_mdct_bitreverse(mdct, w);
+
+    /* rotate + window, two steps of the SSE version at a time */
+
+    T  = mdct->trig_forward+n;
+    x0 = out+n2;
+
+    for(i=0; i<n4; i+=8) {
+        __m256 a = _mm256_loadu_ps(w  );
+        __m256 b = _mm256_loadu_ps(w+8);
+        __m256 e = PERMUTE_PAIRS(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0,2,0,2)),
+                                 _MM_SHUFFLE(1,3,0,2));
+        __m256 o = PERMUTE_PAIRS(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1,3,1,3)),
+                                 _MM_SHUFFLE(1,3,0,2));
+        __m256 r0, r1;
+        x0 -= 8;
+
+        r0 = _mm256_fmsub_ps(e, _mm256_loadu_ps(T),
+                             _mm256_mul_ps(o, _mm256_loadu_ps(T+8)));
+        r0 = _mm256_permute2f128_ps(r0, r0, 0x01);
+        e  = _mm256_permute_ps(e, _MM_SHUFFLE(0,1,2,3));
+        o  = _mm256_permute_ps(o, _MM_SHUFFLE(0,1,2,3));
+        r1 = _mm256_fmadd_ps(e, _mm256_loadu_ps(T+16),
+                             _mm256_mul_ps(o, _mm256_loadu_ps(T+24)));
+        _mm256_storeu_ps(x0    , r0);
+        _mm256_storeu_ps(out +i, r1);
+        if(exp) {
+            __m128i ex = avx2_coef_exponents(r1, r0);
+            _mm_storel_epi64((__m128i *)(exp+i), ex);
+            _mm_storel_epi64((__m128i *)(exp+(x0-out)), _mm_srli_si128(ex, 8));
+        }
+        w += 16;
+        T += 32;
+    }
+}
+
+static void
+avx2_mdct_512(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
+{
+    avx2_mdct(&tctx->mdct_tctx_512, out, exp, in);
+}
+
+static void
+avx2_mdct_256(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
+{
+    FLOAT *coef_a = in;
+    FLOAT *coef_b = in+128;
+    FLOAT *xx = tctx->mdct_tctx_256.buffer1;
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    int i;
+
+    memcpy(xx, in+64, 192 * sizeof(FLOAT));
+    for(i=0; i<64; i+=8)
+        _mm256_storeu_ps(xx+192+i, _mm256_xor_ps(_mm256_loadu_ps(in+i), sign));
+
+    avx2_mdct(&tctx->mdct_tctx_256, coef_a, NULL, xx);
+
+    for(i=0; i<64; i+=8)
+        _mm256_storeu_ps(xx+i, _mm256_xor_ps(_mm256_loadu_ps(in+256+192+i), sign));
+    memcpy(xx+64, in+256, 128 * sizeof(FLOAT));
+    for(i=0; i<64; i+=8)
+        _mm256_storeu_ps(xx+192+i, _mm256_xor_ps(_mm256_loadu_ps(in+256+128+i), sign));
+
+    avx2_mdct(&tctx->mdct_tctx_256, coef_b, NULL, xx);
+
+    for(i=0; i<128; i+=8) {
+        __m256 a  = _mm256_loadu_ps(coef_a+i);
+        __m256 b  = _mm256_loadu_ps(coef_b+i);
+        __m256 lo = _mm256_unpacklo_ps(a, b);
+        __m256 hi = _mm256_unpackhi_ps(a, b);
+        __m256 c0 = _mm256_permute2f128_ps(lo, hi, 0x20);
+        __m256 c1 = _mm256_permute2f128_ps(lo, hi, 0x31);
+        _mm256_storeu_ps(out+2*i  , c0);
+        _mm256_storeu_ps(out+2*i+8, c1);
+        if(exp)
+            _mm_storeu_si128((__m128i *)(exp+2*i), avx2_coef_exponents(c0, c1));
+    }
+}
+
+/*
+ * Batched transform: up to 8 inputs at once, one in each float of the ymm
+ * registers.  Every step of the C version then is one vector operation, and
+ * the twiddle factors, which are the same for all inputs, are broadcast.
+ * The inputs are transposed into the scratch buffer first, and the outputs
+ * transposed back at the end.
+ */
+
+/* transposes the 4x4 matrices of floats in each lane of r[0..3] */
+static inline void
+transpose_4x4_lanes(__m256 r[4])
+{
+    __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+    __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+    __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+    __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+
+    r[0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0));
+    r[1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+    r[2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0));
+    r[3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+}
+
+/**
+ * Transposes the 8x8 matrix of floats in r.  If r[0..3] have the rows 0..3
+ * in the low lanes and the rows 4..7 in the high lanes instead, then the
+ * transpose_4x4_lanes() calls alone do it.
+ */
+static inline void
+transpose_8x8(__m256 r[8])
+{
+    __m256 t[8];
+    int k;
+
+    transpose_4x4_lanes(r);
+    transpose_4x4_lanes(r+4);
+    for(k=0; k<4; k++) {
+        t[k]   = _mm256_permute2f128_ps(r[k], r[k+4], 0x20);
+        t[k+4] = _mm256_permute2f128_ps(r[k], r[k+4], 0x31);
+    }
+    for(k=0; k<8; k++)
+        r[k] = t[k];
+}
+
+#define VADD(a,b) _mm256_add_ps(a, b)
+#define VSUB(a,b) _mm256_sub_ps(a, b)
+#define VMUL(a,b) _mm256_mul_ps(a, b)
+
+/* a*c + b*d and a*d - b*c, the rotation used by most of the steps */
+static inline void
+batch_rotate(__m256 *p, __m256 *q, __m256 a, __m256 b, __m256 c, __m256 d)
+{
+    *p = _mm256_fmadd_ps(a, c, VMUL(b, d));
+    *q = _mm256_fmsub_ps(a, d, VMUL(b, c));
+}
+
+static inline void
+batch_butterfly_8(__m256 *x)
+{
+    __m256 r0 = VADD(x[6], x[2]);
+    __m256 r1 = VSUB(x[6], x[2]);
+    __m256 r2 = VADD(x[4], x[0]);
+    __m256 r3 = VSUB(x[4], x[0]);
+
+    x[6] = VADD(r0, r2);
+    x[4] = VSUB(r0, r2);
+
+    r0   = VSUB(x[5], x[1]);
+    r2   = VSUB(x[7], x[3]);
+    x[0] = VADD(r1, r0);
+    x[2] = VSUB(r1, r0);
+
+    r0   = VADD(x[5], x[1]);
+    r1   = VADD(x[7], x[3]);
+    x[3] = VADD(r2, r3);
+    x[1] = VSUB(r2, r3);
+    x[7] = VADD(r1, r0);
+    x[5] = VSUB(r1, r0);
+}
+
+static inline void
+batch_butterfly_16(__m256 *x)
+{
+    __m256 p2 = _mm256_set1_ps(AFT_PI2_8);
+    __m256 r0 = VSUB(x[1], x[9]);
+    __m256 r1 = VSUB(x[0], x[8]);
+
+    x[8]  = VADD(x[8], x[0]);
+    x[9]  = VADD(x[9], x[1]);
+    x[0]  = VMUL(VADD(r0, r1), p2);
+    x[1]  = VMUL(VSUB(r0, r1), p2);
+
+    r0    = VSUB(x[3], x[11]);
+    r1    = VSUB(x[10], x[2]);
+    x[10] = VADD(x[10], x[2]);
+    x[11] = VADD(x[11], x[3]);
+    x[2]  = r0;
+    x[3]  = r1;
+
+    r0    = VSUB(x[12], x[4]);
+    r1    = VSUB(x[13], x[5]);
+    x[12] = VADD(x[12], x[4]);
+    x[13] = VADD(x[13], x[5]);
+    x[4]  = VMUL(VSUB(r0, r1), p2);
+    x[5]  = VMUL(VADD(r0, r1), p2);
+
+    r0    = VSUB(x[14], x[6]);
+    r1    = VSUB(x[15], x[7]);
+    x[14] = VADD(x[14], x[6]);
+    x[15] = VADD(x[15], x[7]);
+    x[6]  = r0;
+    x[7]  = r1;
+
+    batch_butterfly_8(x);
+    batch_butterfly_8(x+8);
+}
+
+static inline void
+batch_butterfly_32(__m256 *x)
+{
+    __m256 p1 = _mm256_set1_ps(AFT_PI1_8);
+    __m256 p2 = _mm256_set1_ps(AFT_PI2_8);
+    __m256 p3 = _mm256_set1_ps(AFT_PI3_8);
+    __m256 r0 = VSUB(x[30], x[14]);
+    __m256 r1 = VSUB(x[31], x[15]);
+
+    x[30] = VADD(x[30], x[14]);
+    x[31] = VADD(x[31], x[15]);
+    x[14] = r0;
+    x[15] = r1;
+
+    r0    = VSUB(x[28], x[12]);
+    r1    = VSUB(x[29], x[13]);
+    x[28] = VADD(x[28], x[12]);
+    x[29] = VADD(x[29], x[13]);
+    x[12] = _mm256_fmsub_ps(r0, p1, VMUL(r1, p3));
+    x[13] = _mm256_fmadd_ps(r0, p3, VMUL(r1, p1));
+
+    r0    = VSUB(x[26], x[10]);
+    r1    = VSUB(x[27], x[11]);
+    x[26] = VADD(x[26], x[10]);
+    x[27] = VADD(x[27], x[11]);
+    x[10] = VMUL(VSUB(r0, r1), p2);
+    x[11] = VMUL(VADD(r0, r1), p2);
+
+    r0    = VSUB(x[24], x[8]);
+    r1    = VSUB(x[25], x[9]);
+    x[24] = VADD(x[24], x[8]);
+    x[25] = VADD(x[25], x[9]);
+    x[8]  = _mm256_fmsub_ps(r0, p3, VMUL(r1, p1));
+    x[9]  = _mm256_fmadd_ps(r1, p3, VMUL(r0, p1));
+
+    r0    = VSUB(x[22], x[6]);
+    r1    = VSUB(x[7], x[23]);
+    x[22] = VADD(x[22], x[6]);
+    x[23] = VADD(x[23], x[7]);
+    x[6]  = r1;
+    x[7]  = r0;
+
+    r0    = VSUB(x[4], x[20]);
+    r1    = VSUB(x[5], x[21]);
+    x[20] = VADD(x[20], x[4]);
+    x[21] = VADD(x[21], x[5]);
+    batch_rotate(&x[4], &x[5], r1, r0, p1, p3);
+
+    r0    = VSUB(x[2], x[18]);
+    r1    = VSUB(x[3], x[19]);
+    x[18] = VADD(x[18], x[2]);
+    x[19] = VADD(x[19], x[3]);
+    x[2]  = VMUL(VADD(r1, r0), p2);
+    x[3]  = VMUL(VSUB(r1, r0), p2);
+
+    r0    = VSUB(x[0], x[16]);
+    r1    = VSUB(x[1], x[17]);
+    x[16] = VADD(x[16], x[0]);
+    x[17] = VADD(x[17], x[1]);
+    batch_rotate(&x[0], &x[1], r1, r0, p3, p1);
+
+    batch_butterfly_16(x);
+    batch_butterfly_16(x+16);
+}
+
+/* one pair of a first stage or generic butterfly, with twiddles t[0], t[1] */
+static inline void
+batch_butterfly_pair(__m256 *x1, __m256 *x2, const FLOAT *t)
+{
+    __m256 r0 = VSUB(x1[0], x2[0]);
+    __m256 r1 = VSUB(x1[1], x2[1]);
+
+    x1[0] = VADD(x1[0], x2[0]);
+    x1[1] = VADD(x1[1], x2[1]);
+    batch_rotate(&x2[0], &x2[1], r1, r0,
+                 _mm256_broadcast_ss(&t[1]), _mm256_broadcast_ss(&t[0]));
+}
+
+static inline void
+batch_butterfly_first(const FLOAT *trig, __m256 *x, int points)
+{
+    __m256 *x1 = x + points - 8;
+    __m256 *x2 = x + (points>>1) - 8;
+
+    do {
+        batch_butterfly_pair(x1+6, x2+6, trig);
+        batch_butterfly_pair(x1+4, x2+4, trig+4);
+        batch_butterfly_pair(x1+2, x2+2, trig+8);
+        batch_butterfly_pair(x1  , x2  , trig+12);
+        x1 -= 8;
+        x2 -= 8;
+        trig += 16;
+    } while(x2 >= x);
+}
+
+static inline void
+batch_butterfly_generic(const FLOAT *trig, __m256 *x, int points, int trigint)
+{
+    __m256 *x1 = x + points - 8;
+    __m256 *x2 = x + (points>>1) - 8;
+
+    do {
+        batch_butterfly_pair(x1+6, x2+6, trig);
+        batch_butterfly_pair(x1+4, x2+4, trig +   trigint);
+        batch_butterfly_pair(x1+2, x2+2, trig + 2*trigint);
+        batch_butterfly_pair(x1  , x2  , trig + 3*trigint);
+        trig += 4*trigint;
+        x1 -= 8;
+        x2 -= 8;
+    } while(x2 >= x);
+}
+
+static inline void
+batch_butterflies(MDCTContext *mdct, __m256 *x, int points)
+{
+    FLOAT *trig = mdct->trig;
+    int stages = mdct->log2n-5;
+    int i, j;
+
+    if(--stages > 0) {
+        batch_butterfly_first(trig, x, points);
+    }
+
+    for(i=1; --stages>0; i++) {
+        for(j=0; j<(1<<i); j++)
+            batch_butterfly_generic(trig, x+(points>>i)*j, points>>i, 4<<i);
+    }
+
+    for(j=0; j<points; j+=32)
+        batch_butterfly_32(x+j);
+}
+
+/* reads the n/2 vectors of x, and writes the n/2 vectors of w */
+static inline void
+batch_bitreverse(MDCTContext *mdct, __m256 *w, __m256 *x)
+{
+    int n = mdct->n;
+    int *bit = mdct->bitrev;
+    __m256 *w0 = w;
+    __m256 *w1 = w0+(n>>1);
+    FLOAT *trig = mdct->trig+n;
+    __m256 half = _mm256_set1_ps(0.5f);
+
+    do {
+        __m256 *x0 = x+bit[0];
+        __m256 *x1 = x+bit[1];
+        __m256 r0 = VSUB(x0[1], x1[1]);
+        __m256 r1 = VADD(x0[0], x1[0]);
+        __m256 r2, r3;
+
+        batch_rotate(&r2, &r3, r1, r0, _mm256_broadcast_ss(&trig[0]),
+                     _mm256_broadcast_ss(&trig[1]));
+        w1 -= 4;
+
+        r0 = VMUL(VADD(x0[1], x1[1]), half);
+        r1 = VMUL(VSUB(x0[0], x1[0]), half);
+
+        w0[0] = VADD(r0, r2);
+        w1[2] = VSUB(r0, r2);
+        w0[1] = VADD(r1, r3);
+        w1[3] = VSUB(r3, r1);
+
+        x0 = x+bit[2];
+        x1 = x+bit[3];
+
+        r0 = VSUB(x0[1], x1[1]);
+        r1 = VADD(x0[0], x1[0]);
+        batch_rotate(&r2, &r3, r1, r0, _mm256_broadcast_ss(&trig[2]),
+                     _mm256_broadcast_ss(&trig[3]));
+
+        r0 = VMUL(VADD(x0[1], x1[1]), half);
+        r1 = VMUL(VSUB(x0[0], x1[0]), half);
+
+        w0[2] = VADD(r0, r2);
+        w1[0] = VSUB(r0, r2);
+        w0[3] = VADD(r1, r3);
+        w1[1] = VSUB(r3, r1);
+
+        trig += 4;
+        bit += 4;
+        w0 += 4;
+    } while(w0 < w1);
+}
+
+/**
+ * Transforms count inputs, 2 <= count <= MDCT_BATCH_MAX.  The lanes of the
+ * missing inputs transform a copy of the first one, and are not stored.
+ */
+static void
+avx2_mdct_batch(MDCTThreadContext *tmdct, FLOAT *out[], uint8_t *exp[],
+                FLOAT *in[], int count)
+{
+    MDCTContext *mdct = tmdct->mdct;
+    int n = mdct->n;
+    int n2 = n>>1;
+    int n4 = n>>2;
+    int n8 = n>>3;
+    // the buffer has room to align it for the ymm loads and stores.  The
+    // transposed input is not needed after the first step, so w is put there.
+    __m256 *xin = (__m256 *)(((uintptr_t)tmdct->batch_buffer + 31) & ~(uintptr_t)31);
+    __m256 *w = xin;
+    __m256 *w2 = xin+n;
+    __m256 *x0, *x1;
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 scale = _mm256_set1_ps(mdct->scale);
+    __m256 r[8], r0, r1, t0, t1;
+    FLOAT *src[8];
+    FLOAT *trig;
+    int c, i, k;
+
+    for(c=0; c<8; c++)
+        src[c] = in[c < count ? c : 0];
+    // the halves of the rows are put together with inserts, which take
+    // load ports instead of the shuffle port
+    for(i=0; i<n; i+=4) {
+        for(c=0; c<4; c++)
+            r[c] = load2_m128(src[c]+i, src[c+4]+i);
+        transpose_4x4_lanes(r);
+        for(c=0; c<4; c++)
+            xin[i+c] = r[c];
+    }
+
+    x0 = xin+n2+n4;
+    x1 = x0+1;
+    trig = mdct->trig+n2;
+    for(i=0; i<n8; i+=2) {
+        x0 -= 4;
+        trig -= 2;
+        r0 = VADD(x0[2], x1[0]);
+        r1 = VADD(x0[0], x1[2]);
+        batch_rotate(&w2[i], &w2[i+1], r1, r0, _mm256_broadcast_ss(&trig[1]),
+                     _mm256_broadcast_ss(&trig[0]));
+        x1 += 4;
+    }
+
+    x1 = xin+1;
+    for(; i<n2-n8; i+=2) {
+        trig -= 2;
+        x0 -= 4;
+        r0 = VSUB(x0[2], x1[0]);
+        r1 = VSUB(x0[0], x1[2]);
+        batch_rotate(&w2[i], &w2[i+1], r1, r0, _mm256_broadcast_ss(&trig[1]),
+                     _mm256_broadcast_ss(&trig[0]));
+        x1 += 4;
+    }
+
+    x0 = xin+n;
+    for(; i<n2; i+=2) {
+        trig -= 2;
+        x0 -= 4;
+        r0 = _mm256_xor_ps(VADD(x0[2], x1[0]), sign);
+        r1 = _mm256_xor_ps(VADD(x0[0], x1[2]), sign);
+        batch_rotate(&w2[i], &w2[i+1], r1, r0, _mm256_broadcast_ss(&trig[1]),
+                     _mm256_broadcast_ss(&trig[0]));
+        x1 += 4;
+    }
+
+    batch_butterflies(mdct, w2, n2);
+    batch_bitreverse(mdct, w, w2);
+
+    // 8 steps of the rotation give 8 bins from each end, which are
+    // transposed back to the outputs while still in registers
+    trig = mdct->trig+n2;
+    for(i=0; i<n4; i+=8) {
+        __m256 s[8];
+        for(k=0; k<8; k++) {
+            t0 = _mm256_broadcast_ss(&trig[0]);
+            t1 = _mm256_broadcast_ss(&trig[1]);
+            r[k]   = VMUL(_mm256_fmadd_ps(w[0], t0, VMUL(w[1], t1)), scale);
+            s[7-k] = VMUL(_mm256_fmsub_ps(w[0], t1, VMUL(w[1], t0)), scale);
+            w += 2;
+            trig += 2;
+        }
+        transpose_8x8(r);
+        transpose_8x8(s);
+        for(c=0; c<count; c++) {
+            _mm256_storeu_ps(out[c]+i, r[c]);
+            _mm256_storeu_ps(out[c]+n2-8-i, s[c]);
+            if(exp) {
+                __m128i ex = avx2_coef_exponents(r[c], s[c]);
+                _mm_storel_epi64((__m128i *)(exp[c]+i), ex);
+                _mm_storel_epi64((__m128i *)(exp[c]+n2-8-i), _mm_srli_si128(ex, 8));
+            }
+        }
+    }
+}
+
+#undef VADD
+#undef VSUB
+#undef VMUL
+
+static void
+avx2_mdct_batch_512(A52ThreadContext *tctx, FLOAT *out[], uint8_t *exp[],
+                    FLOAT *in[], int count)
+{
+    avx2_mdct_batch(&tctx->mdct_tctx_512, out, exp, in, count);
+}
+
+/**
+ * Reorders the 4-float blocks of t in groups of nblk blocks.  Block k of
+ * each group is taken from block order[k] of the same group.
+ */
+static void
+reorder_trig(FLOAT *t, int len, const int *order, int nblk)
+{
+    FLOAT tmp[32];
+    int i, k;
+
+    for(i=0; i<len; i+=4*nblk) {
+        memcpy(tmp, &t[i], 4*nblk * sizeof(FLOAT));
+        for(k=0; k<nblk; k++)
+            memcpy(&t[i+4*k], &tmp[4*order[k]], 4 * sizeof(FLOAT));
+    }
+}
+
+/**
+ * Sets up the tables of the SSE version and reorders them for the lanes of
+ * the AVX2 steps.
+ */
+static void
+avx2_mdct_ctx_init(MDCTContext *mdct, int n)
+{
+    // the twiddles of the two lanes of a register next to each other
+    static const int lanes[4] = { 0, 2, 1, 3 };
+    // the same for the first stage, which has its lanes swapped
+    static const int first[4] = { 1, 0, 3, 2 };
+    // two SSE steps of the post-rotation, 4 twiddle blocks each
+    static const int rotate[8] = { 0, 4, 1, 5, 2, 6, 3, 7 };
+    int n2 = n >> 1;
+    int n4 = n >> 2;
+    int n8 = n >> 3;
+
+    sse_mdct_ctx_init(mdct, n);
+
+    reorder_trig(mdct->trig_bitreverse, n2, lanes, 4);
+    reorder_trig(mdct->trig_forward, n, lanes, 4);
+    reorder_trig(mdct->trig_forward+n, n, rotate, 8);
+    reorder_trig(mdct->trig_butterfly_first, n, first, 4);
+    reorder_trig(mdct->trig_butterfly_generic8, n2, lanes, 4);
+    reorder_trig(mdct->trig_butterfly_generic16, n4, lanes, 4);
+    if(mdct->trig_butterfly_generic32)
+        reorder_trig(mdct->trig_butterfly_generic32, n8, lanes, 4);
+    if(mdct->trig_butterfly_generic64)
+        reorder_trig(mdct->trig_butterfly_generic64, n8>>1, lanes, 4);
+}
+
+static void
+avx2_mdct_close(A52Context *ctx)
+{
+    sse_mdct_ctx_close(&ctx->mdct_ctx_512);
+    sse_mdct_ctx_close(&ctx->mdct_ctx_256);
+}
+
+static void
+avx2_mdct_thread_close(A52ThreadContext *tctx)
+{
+    sse_mdct_tctx_close(&tctx->mdct_tctx_512);
+    sse_mdct_tctx_close(&tctx->mdct_tctx_256);
+    aligned_free(tctx->mdct_tctx_512.batch_buffer);
+
+    aligned_free(tctx->frame.blocks[0].input_samples[0]);
+}
+
+void
+avx2_mdct_init(A52Context *ctx)
+{
+    avx2_mdct_ctx_init(&ctx->mdct_ctx_512, 512);
+    avx2_mdct_ctx_init(&ctx->mdct_ctx_256, 256);
+
+    ctx->mdct_ctx_512.mdct = avx2_mdct_512;
+    ctx->mdct_ctx_256.mdct = avx2_mdct_256;
+    ctx->mdct_ctx_512.mdct_batch = avx2_mdct_batch_512;
+
+    ctx->mdct_ctx_512.mdct_close = avx2_mdct_close;
+    ctx->mdct_ctx_256.mdct_close = avx2_mdct_close;
+}
+
+void
+avx2_mdct_thread_init(A52ThreadContext *tctx)
+{
+    sse_mdct_tctx_init(&tctx->mdct_tctx_512, 512);
+    sse_mdct_tctx_init(&tctx->mdct_tctx_256, 256);
+    // input and work vectors of the batched transform, plus alignment
+    tctx->mdct_tctx_512.batch_buffer =
+        aligned_malloc((512 + 256 + 1) * 8 * sizeof(FLOAT));
+
+    tctx->mdct_tctx_512.mdct_thread_close = avx2_mdct_thread_close;
+    tctx->mdct_tctx_256.mdct_thread_close = avx2_mdct_thread_close;
+
+    tctx->mdct_tctx_512.mdct = &tctx->ctx->mdct_ctx_512;
+    tctx->mdct_tctx_256.mdct = &tctx->ctx->mdct_ctx_256;
+
+    tctx->frame.blocks[0].input_samples[0] =
+        aligned_malloc(A52_NUM_BLOCKS * A52_MAX_CHANNELS * (256 + 512) * sizeof(FLOAT));
+    alloc_block_buffers(tctx);
+}
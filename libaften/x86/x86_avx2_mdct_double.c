@@ -0,0 +1,416 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file x86_avx2_mdct_double.c
+ * AVX2/FMA optimized MDCT for the double precision build
+ *
+ * This is the algorithm of x86_sse2_mdct_double.c with two (x[k], x[k+1])
+ * pairs in the two lanes of one ymm register, and with fused multiply-adds.
+ * The pre-twiddle and post-rotation do two and four steps of the C version
+ * at a time.  The lookup tables of the C init are used as they are.
+ */
+
+#include "common.h"
+
+#include <string.h>
+
+#include "a52.h"
+#include "mdct.h"
+#include "x86_simd_support.h"
+
+/* the sign bits of the odd elements */
+#define SIGN_ODD _mm256_setr_pd(0.0, -0.0, 0.0, -0.0)
+/* the sign bits of all elements */
+#define SIGN_ALL _mm256_set1_pd(-0.0)
+
+/** swaps the two elements of each pair */
+static inline __m256d
+swap_pd(__m256d a)
+{
+    return _mm256_permute_pd(a, 0x5);
+}
+
+/** the pairs at lo and hi in the low and high lane */
+static inline __m256d
+load_pairs(const FLOAT *lo, const FLOAT *hi)
+{
+    return _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(lo)),
+                                _mm_loadu_pd(hi), 1);
+}
+
+/** d times the complex constants (a0, b0) and (a1, b1) in the two lanes */
+static inline __m256d
+cmul_const(__m256d d, double a0, double b0, double a1, double b1)
+{
+    return _mm256_fmadd_pd(d, _mm256_setr_pd(a0, a0, a1, a1),
+                           _mm256_mul_pd(swap_pd(d),
+                                         _mm256_setr_pd(-b0, b0, -b1, b1)));
+}
+
+/** (r0*t0 + r1*t1, r1*t0 - r0*t1) for d = (r0, r1) and t = (t0, t1) */
+static inline __m256d
+rotate(__m256d d, __m256d t)
+{
+    return _mm256_fmsubadd_pd(d, _mm256_movedup_pd(t),
+                              _mm256_mul_pd(swap_pd(d), _mm256_permute_pd(t, 0xF)));
+}
+
+/** 8 point butterfly of the pairs in v0 and v1 */
+static inline void
+mdct_butterfly_8(__m256d *v0, __m256d *v1)
+{
+    // (x4+x0, x5+x1 | x6+x2, x7+x3) and the differences
+    __m256d s = _mm256_add_pd(*v1, *v0);
+    __m256d d = _mm256_sub_pd(*v1, *v0);
+    __m256d d2 = _mm256_permute4x64_pd(d, _MM_SHUFFLE(3,2,3,2));
+    __m256d e  = _mm256_permute4x64_pd(d, _MM_SHUFFLE(0,1,0,1));
+
+    e = _mm256_xor_pd(e, _mm256_setr_pd(0.0, -0.0, -0.0, 0.0));
+    *v0 = _mm256_add_pd(d2, e);
+    *v1 = _mm256_add_pd(_mm256_permute2f128_pd(s, s, 0x01),
+                        _mm256_xor_pd(s, _mm256_setr_pd(-0.0, -0.0, 0.0, 0.0)));
+}
+
+/** 16 point butterfly of the pairs in v0 to v3 */
+static inline void
+mdct_butterfly_16(__m256d *v0, __m256d *v1, __m256d *v2, __m256d *v3)
+{
+    __m256d d0 = _mm256_sub_pd(*v2, *v0);
+    __m256d d1 = _mm256_sub_pd(*v3, *v1);
+
+    *v2 = _mm256_add_pd(*v2, *v0);
+    *v3 = _mm256_add_pd(*v3, *v1);
+    *v0 = cmul_const(d0, -AFT_PI2_8, AFT_PI2_8, 0.0, 1.0);
+    *v1 = cmul_const(d1,  AFT_PI2_8, AFT_PI2_8, 1.0, 0.0);
+
+    mdct_butterfly_8(v0, v1);
+    mdct_butterfly_8(v2, v3);
+}
+
+/**
+ * 32 point butterfly (in place).  The pairs are kept in separate variables
+ * rather than an array, which gcc would bounce through the stack.
+ */
+static inline void
+mdct_butterfly_32(FLOAT *x)
+{
+    __m256d v0 = _mm256_loadu_pd(x   ), v4 = _mm256_loadu_pd(x+16);
+    __m256d v1 = _mm256_loadu_pd(x+ 4), v5 = _mm256_loadu_pd(x+20);
+    __m256d v2 = _mm256_loadu_pd(x+ 8), v6 = _mm256_loadu_pd(x+24);
+    __m256d v3 = _mm256_loadu_pd(x+12), v7 = _mm256_loadu_pd(x+28);
+    __m256d d0 = _mm256_sub_pd(v4, v0);
+    __m256d d1 = _mm256_sub_pd(v5, v1);
+    __m256d d2 = _mm256_sub_pd(v6, v2);
+    __m256d d3 = _mm256_sub_pd(v7, v3);
+
+    v4 = _mm256_add_pd(v4, v0);
+    v5 = _mm256_add_pd(v5, v1);
+    v6 = _mm256_add_pd(v6, v2);
+    v7 = _mm256_add_pd(v7, v3);
+    v0 = cmul_const(d0, -AFT_PI1_8, AFT_PI3_8, -AFT_PI2_8, AFT_PI2_8);
+    v1 = cmul_const(d1, -AFT_PI3_8, AFT_PI1_8,  0.0,       1.0);
+    v2 = cmul_const(d2,  AFT_PI3_8, AFT_PI1_8,  AFT_PI2_8, AFT_PI2_8);
+    v3 = cmul_const(d3,  AFT_PI1_8, AFT_PI3_8,  1.0,       0.0);
+
+    mdct_butterfly_16(&v0, &v1, &v2, &v3);
+    mdct_butterfly_16(&v4, &v5, &v6, &v7);
+
+    _mm256_storeu_pd(x   , v0);
+    _mm256_storeu_pd(x+ 4, v1);
+    _mm256_storeu_pd(x+ 8, v2);
+    _mm256_storeu_pd(x+12, v3);
+    _mm256_storeu_pd(x+16, v4);
+    _mm256_storeu_pd(x+20, v5);
+    _mm256_storeu_pd(x+24, v6);
+    _mm256_storeu_pd(x+28, v7);
+}
+
+/** two pair steps of the first and generic stage butterflies */
+static inline void
+butterfly_step(FLOAT *x1, FLOAT *x2, __m256d t)
+{
+    __m256d a = _mm256_loadu_pd(x1);
+    __m256d b = _mm256_loadu_pd(x2);
+
+    _mm256_storeu_pd(x1, _mm256_add_pd(a, b));
+    _mm256_storeu_pd(x2, rotate(_mm256_sub_pd(a, b), t));
+}
+
+/** N-point first stage butterfly (in place) */
+static inline void
+mdct_butterfly_first(FLOAT *trig, FLOAT *x, int points)
+{
+    FLOAT *x1 = x + points - 8;
+    FLOAT *x2 = x + (points>>1) - 8;
+
+    do {
+        butterfly_step(x1+4, x2+4, load_pairs(trig+4, trig));
+        butterfly_step(x1  , x2  , load_pairs(trig+12, trig+8));
+
+        x1 -= 8;
+        x2 -= 8;
+        trig += 16;
+    } while(x2 >= x);
+}
+
+/** N/stage point generic N stage butterfly (in place) */
+static inline void
+mdct_butterfly_generic(FLOAT *trig, FLOAT *x, int points, int trigint)
+{
+    FLOAT *x1 = x + points - 8;
+    FLOAT *x2 = x + (points>>1) - 8;
+
+    do {
+        butterfly_step(x1+4, x2+4, load_pairs(trig+trigint, trig));
+        butterfly_step(x1  , x2  , load_pairs(trig+3*trigint, trig+2*trigint));
+
+        trig += 4*trigint;
+        x1 -= 8;
+        x2 -= 8;
+    } while(x2 >= x);
+}
+
+static inline void
+mdct_butterflies(MDCTContext *mdct, FLOAT *x, int points)
+{
+    FLOAT *trig = mdct->trig;
+    int stages = mdct->log2n-5;
+    int i, j;
+
+    if(--stages > 0) {
+        mdct_butterfly_first(trig, x, points);
+    }
+
+    for(i=1; --stages>0; i++) {
+        for(j=0; j<(1<<i); j++)
+            mdct_butterfly_generic(trig, x+(points>>i)*j, points>>i, 4<<i);
+    }
+
+    for(j=0; j<points; j+=32)
+        mdct_butterfly_32(x+j);
+}
+
+static inline void
+mdct_bitreverse(MDCTContext *mdct, FLOAT *x)
+{
+    int n = mdct->n;
+    int *bit = mdct->bitrev;
+    FLOAT *w0 = x;
+    FLOAT *w1 = x = w0+(n>>1);
+    FLOAT *trig = mdct->trig+n;
+
+    do {
+        __m256d a = load_pairs(x+bit[0], x+bit[2]);
+        __m256d b = load_pairs(x+bit[1], x+bit[3]);
+        __m256d t = _mm256_loadu_pd(trig);
+        __m256d s = _mm256_add_pd(a, b);
+        __m256d d = _mm256_sub_pd(a, b);
+        // q = (x0[0] + x1[0], x0[1] - x1[1]), h = (x0[1] + x1[1], x0[0] - x1[0])
+        __m256d q = _mm256_blend_pd(s, d, 0xA);
+        __m256d h = _mm256_mul_pd(_mm256_shuffle_pd(s, d, 0x5), _mm256_set1_pd(0.5));
+        __m256d r = _mm256_fmadd_pd(q, _mm256_xor_pd(_mm256_movedup_pd(t), SIGN_ODD),
+                                    _mm256_mul_pd(swap_pd(q), _mm256_permute_pd(t, 0xF)));
+        __m256d back = _mm256_xor_pd(_mm256_sub_pd(h, r), SIGN_ODD);
+
+        w1 -= 4;
+
+        _mm256_storeu_pd(w0, _mm256_add_pd(h, r));
+        _mm256_storeu_pd(w1, _mm256_permute2f128_pd(back, back, 0x01));
+
+        trig += 4;
+        bit += 4;
+        w0 += 4;
+    } while(w0 < w1);
+}
+
+/**
+ * Exponents of the coefficients in a and b, as 8 bytes in the low half.
+ * They are read from the exponent fields, see coef_exponent().
+ */
+static inline __m128i
+avx2_coef_exponents_pd(__m256d a, __m256d b)
+{
+    // shifting out the sign bit leaves the biased exponent in the low dword
+    __m256i ea = _mm256_srli_epi64(_mm256_slli_epi64(_mm256_castpd_si256(a), 1), 53);
+    __m256i eb = _mm256_srli_epi64(_mm256_slli_epi64(_mm256_castpd_si256(b), 1), 53);
+    __m256i e  = _mm256_or_si256(ea, _mm256_slli_epi64(eb, 32));
+    __m128i e16;
+
+    e = _mm256_permutevar8x32_epi32(e, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+    e16 = _mm_packs_epi32(_mm256_castsi256_si128(e), _mm256_extracti128_si256(e, 1));
+    e16 = _mm_sub_epi16(_mm_set1_epi16(1022), e16);
+    // the unsigned saturation clips negative exponents to 0
+    e16 = _mm_min_epi16(e16, _mm_set1_epi16(24));
+    return _mm_packus_epi16(e16, e16);
+}
+
+/**
+ * inputs of two pre-twiddle steps: (x0[2], x0[0]) of the blocks at x0-4 and
+ * x0-8, and (x1[0], x1[2]) of the blocks at x1 and x1+4
+ */
+static inline void
+load_pretwiddle(const FLOAT *x0, const FLOAT *x1, __m256d *a, __m256d *b)
+{
+    *a = _mm256_unpacklo_pd(load_pairs(x0-2, x0-6), load_pairs(x0-4, x0-8));
+    *b = _mm256_unpacklo_pd(load_pairs(x1, x1+4), load_pairs(x1+2, x1+6));
+}
+
+/**
+ * The exponents are taken from the output coefficients while they are still
+ * in registers, if exp is not NULL.
+ */
+static void
+mdct(MDCTThreadContext *tmdct, FLOAT *out, uint8_t *exp, FLOAT *in)
+{
+    MDCTContext *mdct = tmdct->mdct;
+    int n = mdct->n;
+    int n2 = n>>1;
+    int n4 = n>>2;
+    int n8 = n>>3;
+    FLOAT *w = tmdct->buffer;
+    FLOAT *w2 = w+n2;
+    FLOAT *x0 = in+n2+n4;
+    FLOAT *x1 = x0+1;
+    FLOAT *trig = mdct->trig + n2;
+    __m256d scale = _mm256_set1_pd(mdct->scale);
+    __m256d a, b;
+    int i;
+
+    for(i=0; i<n8; i+=4) {
+        load_pretwiddle(x0, x1, &a, &b);
+        _mm256_storeu_pd(w2+i, rotate(_mm256_add_pd(a, b),
+                                      load_pairs(trig-2, trig-4)));
+        x0 -= 8;
+        x1 += 8;
+        trig -= 4;
+    }
+
+    x1 = in+1;
+    for(; i<n2-n8; i+=4) {
+        load_pretwiddle(x0, x1, &a, &b);
+        _mm256_storeu_pd(w2+i, rotate(_mm256_sub_pd(a, b),
+                                      load_pairs(trig-2, trig-4)));
+        x0 -= 8;
+        x1 += 8;
+        trig -= 4;
+    }
+
+    x0 = in+n;
+    for(; i<n2; i+=4) {
+        load_pretwiddle(x0, x1, &a, &b);
+        a = _mm256_xor_pd(a, SIGN_ALL);
+        _mm256_storeu_pd(w2+i, rotate(_mm256_sub_pd(a, b),
+                                      load_pairs(trig-2, trig-4)));
+        x0 -= 8;
+        x1 += 8;
+        trig -= 4;
+    }
+
+    mdct_butterflies(mdct, w2, n2);
+    mdct_bitreverse(mdct, w);
+
+    // four steps at a time: out[i..i+3] and out[n2-4-i..n2-1-i]
+    trig = mdct->trig+n2;
+    for(i=0; i<n4; i+=4) {
+        __m256d w0 = _mm256_loadu_pd(w);
+        __m256d w1 = _mm256_loadu_pd(w+4);
+        __m256d t0 = _mm256_loadu_pd(trig);
+        __m256d t1 = _mm256_loadu_pd(trig+4);
+        __m256d r0 = _mm256_fmadd_pd(_mm256_movedup_pd(w0), t0,
+                                     _mm256_mul_pd(_mm256_permute_pd(w0, 0xF),
+                                                   _mm256_xor_pd(swap_pd(t0), SIGN_ODD)));
+        __m256d r1 = _mm256_fmadd_pd(_mm256_movedup_pd(w1), t1,
+                                     _mm256_mul_pd(_mm256_permute_pd(w1, 0xF),
+                                                   _mm256_xor_pd(swap_pd(t1), SIGN_ODD)));
+        __m256d front, back;
+
+        r0 = _mm256_mul_pd(r0, scale);
+        r1 = _mm256_mul_pd(r1, scale);
+        front = _mm256_permute4x64_pd(_mm256_unpacklo_pd(r0, r1), _MM_SHUFFLE(3,1,2,0));
+        back  = _mm256_permute4x64_pd(_mm256_unpackhi_pd(r0, r1), _MM_SHUFFLE(0,2,1,3));
+        _mm256_storeu_pd(out+i, front);
+        _mm256_storeu_pd(out+n2-4-i, back);
+        if(exp) {
+            __m128i e = avx2_coef_exponents_pd(front, back);
+            int32_t v = _mm_cvtsi128_si32(e);
+            memcpy(exp+i, &v, 4);
+            v = _mm_cvtsi128_si32(_mm_srli_si128(e, 4));
+            memcpy(exp+n2-4-i, &v, 4);
+        }
+        w += 8;
+        trig += 8;
+    }
+}
+
+static void
+mdct_512(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
+{
+    mdct(&tctx->mdct_tctx_512, out, exp, in);
+}
+
+/** negated copy of 64 samples */
+static inline void
+copy_neg_64(FLOAT *dst, const FLOAT *src)
+{
+    int i;
+    for(i=0; i<64; i+=4)
+        _mm256_storeu_pd(dst+i, _mm256_xor_pd(_mm256_loadu_pd(src+i), SIGN_ALL));
+}
+
+static void
+mdct_256(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
+{
+    FLOAT *coef_a = in;
+    FLOAT *coef_b = in+128;
+    FLOAT *xx = tctx->mdct_tctx_256.buffer1;
+    int i;
+
+    memcpy(xx, in+64, 192 * sizeof(FLOAT));
+    copy_neg_64(xx+192, in);
+
+    mdct(&tctx->mdct_tctx_256, coef_a, NULL, xx);
+
+    copy_neg_64(xx, in+256+192);
+    memcpy(xx+64, in+256, 128 * sizeof(FLOAT));
+    copy_neg_64(xx+192, in+256+128);
+
+    mdct(&tctx->mdct_tctx_256, coef_b, NULL, xx);
+
+    for(i=0; i<128; i+=4) {
+        __m256d a = _mm256_loadu_pd(coef_a+i);
+        __m256d b = _mm256_loadu_pd(coef_b+i);
+        __m256d lo = _mm256_unpacklo_pd(a, b);
+        __m256d hi = _mm256_unpackhi_pd(a, b);
+        __m256d out0 = _mm256_permute2f128_pd(lo, hi, 0x20);
+        __m256d out1 = _mm256_permute2f128_pd(lo, hi, 0x31);
+        _mm256_storeu_pd(out+2*i  , out0);
+        _mm256_storeu_pd(out+2*i+4, out1);
+        if(exp)
+            _mm_storel_epi64((__m128i *)(exp+2*i), avx2_coef_exponents_pd(out0, out1));
+    }
+}
+
+void
+avx2_mdct_init(A52Context *ctx)
+{
+    mdct_init(ctx);
+
+    ctx->mdct_ctx_512.mdct = mdct_512;
+    ctx->mdct_ctx_256.mdct = mdct_256;
+}
@@ -29,6 +29,9 @@
 /* caps2 */
 #define SSE3_BIT             0
 #define SSSE3_BIT            9
+#define FMA_BIT             12
+#define OSXSAVE_BIT         27
+#define AVX_BIT             28
 
 /* caps3 */
 #define AMD_3DNOW_BIT       31
@@ -36,9 +39,15 @@
 #define AMD_SSE_MMX_BIT     22
 #define CYRIX_MMXEXT_BIT    24
 
+/* structured extended features, leaf 7 ebx */
+#define AVX2_BIT             5
+
 
 #ifdef HAVE_CPU_CAPS_DETECTION
 #include "asm_support.h"
+#if __GNUC__
+#include <cpuid.h>
+#endif
 
 // derived from loki_cpuinfo.c, 1997-98 by H. Dietz and R. Fisher
 // using infos from sandpile.org
@@ -86,11 +95,37 @@ static void cpu_caps_detect_x86(uint32_t *caps1, uint32_t *caps2, uint32_t *caps
     *caps2 = c2;
     *caps3 = c3;
 }
+
+/* AVX2 also needs the OS to save the ymm registers, so check XCR0 too */
+static int cpu_caps_detect_avx2(uint32_t caps2)
+{
+#if __GNUC__
+    unsigned int eax, ebx, ecx, edx;
+    uint32_t xcr0_lo, xcr0_hi;
+
+    if(!((caps2 >> OSXSAVE_BIT) & 1) || !((caps2 >> AVX_BIT) & 1))
+        return 0;
+
+    if(__get_cpuid_max(0, NULL) < 7)
+        return 0;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+    // xgetbv with ecx=0
+    asm volatile (".byte 0x0f, 0x01, 0xd0"
+                  : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if((xcr0_lo & 6) != 6)
+        return 0;
+
+    return (ebx >> AVX2_BIT) & 1;
+#else
+    return 0;
+#endif
+}
 #endif
 
-static struct x86cpu_caps_s x86cpu_caps_compile = { 0, 0, 0, 0, 0, 0, 0, 0, 0};
-static struct x86cpu_caps_s x86cpu_caps_detect = { 1, 1, 1, 1, 1, 1, 1, 1, 1};
-struct x86cpu_caps_s x86cpu_caps_use = { 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static struct x86cpu_caps_s x86cpu_caps_compile = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static struct x86cpu_caps_s x86cpu_caps_detect = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+struct x86cpu_caps_s x86cpu_caps_use = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
 void cpu_caps_detect(void)
 {
@@ -110,6 +145,12 @@ void cpu_caps_detect(void)
 #ifdef HAVE_SSSE3
     x86cpu_caps_compile.ssse3 = 1;
 #endif
+#ifdef HAVE_AVX2
+    x86cpu_caps_compile.avx2 = 1;
+#endif
+#ifdef HAVE_FMA
+    x86cpu_caps_compile.fma = 1;
+#endif
 #ifdef HAVE_3DNOW
     x86cpu_caps_compile.amd_3dnow = 1;
 #endif
@@ -134,6 +175,10 @@ void cpu_caps_detect(void)
 
         x86cpu_caps_detect.sse3         = (caps2 >> SSE3_BIT) & 1;
         x86cpu_caps_detect.ssse3         = (caps2 >> SSSE3_BIT) & 1;
+        x86cpu_caps_detect.avx2         = cpu_caps_detect_avx2(caps2);
+        // FMA works on ymm registers too, so it needs the same OS support
+        x86cpu_caps_detect.fma          = x86cpu_caps_detect.avx2 &
+                                          ((caps2 >> FMA_BIT) & 1);
 
         x86cpu_caps_detect.amd_3dnow    = (caps3 >> AMD_3DNOW_BIT) & 1;
         x86cpu_caps_detect.amd_3dnowext = (caps3 >> AMD_3DNOWEXT_BIT) & 1;
@@ -151,6 +196,8 @@ void cpu_caps_detect(void)
     x86cpu_caps_use.sse2         = x86cpu_caps_detect.sse2         & x86cpu_caps_compile.sse2;
     x86cpu_caps_use.sse3         = x86cpu_caps_detect.sse3         & x86cpu_caps_compile.sse3;
     x86cpu_caps_use.ssse3        = x86cpu_caps_detect.ssse3        & x86cpu_caps_compile.ssse3;
+    x86cpu_caps_use.avx2         = x86cpu_caps_detect.avx2         & x86cpu_caps_compile.avx2;
+    x86cpu_caps_use.fma          = x86cpu_caps_detect.fma          & x86cpu_caps_compile.fma;
     x86cpu_caps_use.amd_3dnow    = x86cpu_caps_detect.amd_3dnow    & x86cpu_caps_compile.amd_3dnow;
     x86cpu_caps_use.amd_3dnowext = x86cpu_caps_detect.amd_3dnowext & x86cpu_caps_compile.amd_3dnowext;
     x86cpu_caps_use.amd_sse_mmx  = x86cpu_caps_detect.amd_sse_mmx  & x86cpu_caps_compile.amd_sse_mmx;
@@ -163,6 +210,8 @@ void apply_simd_restrictions(AftenSimdInstructions *simd_instructions)
     x86cpu_caps_use.sse2         &= simd_instructions->sse2;
     x86cpu_caps_use.sse3         &= simd_instructions->sse3;
     x86cpu_caps_use.ssse3        &= simd_instructions->ssse3;
+    x86cpu_caps_use.avx2         &= simd_instructions->avx2;
+    x86cpu_caps_use.fma          &= simd_instructions->fma;
     x86cpu_caps_use.amd_3dnow    &= simd_instructions->amd_3dnow;
     x86cpu_caps_use.amd_3dnowext &= simd_instructions->amd_3dnowext;
     x86cpu_caps_use.amd_sse_mmx  &= simd_instructions->amd_sse_mmx;
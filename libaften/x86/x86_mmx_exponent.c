@@ -240,129 +240,51 @@ encode_exp_blk_ch(uint8_t *exp, int ncoefs, int exp_strategy)
 }
 
 
-/**
- * Determine a good exponent strategy for all blocks of a single channel.
- * A pre-defined set of strategies is chosen based on the SSE between each set
- * and the most accurate strategy set (all blocks EXP_D15).
- */
+/* sum of the squared differences between exp[i] and exp1[i] */
 static int
-compute_expstr_ch(uint8_t *exp[A52_NUM_BLOCKS], int ncoefs)
+exponent_sqerr(const uint8_t *exp, const uint8_t *exp1, int n)
 {
-    ALIGN16(uint8_t) exponents[A52_NUM_BLOCKS][256];
-    int blk, str, i, j, k;
-    int min_error, exp_error[6];
-    int err;
-
-    min_error = 1;
-    for(str=1; str<6; str++) {
-        // collect exponents
-        for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-            memcpy(exponents[blk], exp[blk], 256);
-        }
-
-        // encode exponents
-        i = 0;
-        while(i < A52_NUM_BLOCKS) {
-            j = i + 1;
-            while(j < A52_NUM_BLOCKS && str_predef[str][j]==EXP_REUSE) {
-                exponent_min(exponents[i], exponents[j], ncoefs);
-                j++;
-            }
-            encode_exp_blk_ch(exponents[i], ncoefs, str_predef[str][i]);
-            for(k=i+1; k<j; k++) {
-                memcpy(exponents[k], exponents[i], 256);
-            }
-            i = j;
-        }
-
-        // select strategy based on minimum error from unencoded exponents
-        exp_error[str] = 0;
-        for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-            uint8_t *exp_blk = exp[blk];
-            uint8_t *exponents_blk = exponents[blk];
-            union {
-                __m64 v;
-                int32_t res[2];
-            } ures;
-            __m64 vzero = _mm_setzero_si64();
-            __m64 vres = vzero;
+    union {
+        __m64 v;
+        int32_t res[2];
+    } ures;
+    __m64 vzero = _mm_setzero_si64();
+    __m64 vres = vzero;
+    int i, err, sum;
 
-            for(i=0; i<(ncoefs & ~7); i+=8) {
-                __m64 vexp = *(__m64*)&exp_blk[i];
-                __m64 vexp2 = *(__m64*)&exponents_blk[i];
-#if 0
-                //safer but needed?
-                __m64 vexphi = _mm_unpackhi_pi8(vexp, vzero);
-                __m64 vexp2hi = _mm_unpackhi_pi8(vexp2, vzero);
-                __m64 vexplo = _mm_unpacklo_pi8(vexp, vzero);
-                __m64 vexp2lo = _mm_unpacklo_pi8(vexp2, vzero);
-                __m64 verrhi = _mm_sub_pi16(vexphi, vexp2hi);
-                __m64 verrlo = _mm_sub_pi16(vexplo, vexp2lo);
-#else
-                __m64 verr = _mm_sub_pi8(vexp, vexp2);
-                __m64 vsign = _mm_cmpgt_pi8(vzero, verr);
-                __m64 verrhi = _mm_unpackhi_pi8(verr, vsign);
-                __m64 verrlo = _mm_unpacklo_pi8(verr, vsign);
-#endif
-                verrhi = _mm_madd_pi16(verrhi, verrhi);
-                verrlo = _mm_madd_pi16(verrlo, verrlo);
-                verrhi = _mm_add_pi32(verrhi, verrlo);
-                vres = _mm_add_pi32(vres, verrhi);
-            }
-            ures.v = vres;
-            exp_error[str] += ures.res[0]+ures.res[1];
-            switch(ncoefs & 7) {
-            case 7:
-                err = exp_blk[i] - exponents_blk[i];
-                exp_error[str] += (err * err);
-                ++i;
-            case 6:
-                err = exp_blk[i] - exponents_blk[i];
-                exp_error[str] += (err * err);
-                ++i;
-            case 5:
-                err = exp_blk[i] - exponents_blk[i];
-                exp_error[str] += (err * err);
-                ++i;
-            case 4:
-                err = exp_blk[i] - exponents_blk[i];
-                exp_error[str] += (err * err);
-                ++i;
-            case 3:
-                err = exp_blk[i] - exponents_blk[i];
-                exp_error[str] += (err * err);
-                ++i;
-            case 2:
-                err = exp_blk[i] - exponents_blk[i];
-                exp_error[str] += (err * err);
-                ++i;
-            case 1:
-                err = exp_blk[i] - exponents_blk[i];
-                exp_error[str] += (err * err);
-            case 0:
-                ;
-            }
-        }
-        if(exp_error[str] < exp_error[min_error]) {
-            min_error = str;
-        }
+    for(i=0; i<(n & ~7); i+=8) {
+        __m64 vexp = *(__m64*)&exp[i];
+        __m64 vexp2 = *(__m64*)&exp1[i];
+        __m64 verr = _mm_sub_pi8(vexp, vexp2);
+        __m64 vsign = _mm_cmpgt_pi8(vzero, verr);
+        __m64 verrhi = _mm_unpackhi_pi8(verr, vsign);
+        __m64 verrlo = _mm_unpacklo_pi8(verr, vsign);
+        verrhi = _mm_madd_pi16(verrhi, verrhi);
+        verrlo = _mm_madd_pi16(verrlo, verrlo);
+        verrhi = _mm_add_pi32(verrhi, verrlo);
+        vres = _mm_add_pi32(vres, verrhi);
+    }
+    ures.v = vres;
+    sum = ures.res[0]+ures.res[1];
+    for(; i<n; i++) {
+        err = exp[i] - exp1[i];
+        sum += (err * err);
     }
-    return min_error;
+    return sum;
 }
 
 
 /**
- * Runs all the processes in extracting, analyzing, and encoding exponents
+ * Runs all the processes in analyzing and encoding exponents
+ * of a single channel
  */
 void
-mmx_process_exponents(A52ThreadContext *tctx)
+mmx_process_exponents(A52ThreadContext *tctx, int ch)
 {
-    extract_exponents(tctx);
-
-    compute_exponent_strategy(tctx);
+    compute_exponent_strategy(tctx, ch);
 
-    encode_exponents(tctx);
+    encode_exponents(tctx, ch);
 
-    group_exponents(tctx);
+    group_exponents(tctx, ch);
     _mm_empty();
 }
@@ -62,6 +62,24 @@ union __m128iui {
 
 #undef _mm_lddqu_ps
 #define _mm_lddqu_ps(x) _mm_castsi128_ps(_mm_lddqu_si128((__m128i*)(x)))
+
+#ifdef USE_SSSE3
+#include <tmmintrin.h>
+#endif /* USE_SSSE3 */
+
+#ifdef USE_AVX2
+#include <immintrin.h>
+
+union __m256ui {
+    unsigned int ui[8];
+    __m256 v;
+};
+
+union __m256f {
+    float f[8];
+    __m256 v;
+};
+#endif /* USE_AVX2 */
 #endif /* USE_SSE3 */
 #endif /* USE_SSE2 */
 
@@ -0,0 +1,268 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file x86_sse2_convert.c
+ * SSE2 optimized input sample format conversion
+ *
+ * Four frames of interleaved input are converted at a time and then spread
+ * out to the channel planes, or two frames at a time in the double build.
+ * All scale factors are powers of two, so the results are the same as those
+ * of the C versions.
+ */
+
+#include "common.h"
+
+#include <string.h>
+
+#include "convert.h"
+#include "x86_simd_support.h"
+
+#ifndef CONFIG_DOUBLE
+
+/* converts 4 consecutive input samples to float */
+
+static inline __m128
+load4_u8(const uint8_t *src)
+{
+    int32_t v;
+    __m128i vi;
+
+    memcpy(&v, src, 4);
+    vi = _mm_cvtsi32_si128(v);
+    vi = _mm_unpacklo_epi8(vi, _mm_setzero_si128());
+    vi = _mm_unpacklo_epi16(vi, _mm_setzero_si128());
+    return _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(vi), _mm_set1_ps(128.0f)),
+                      _mm_set1_ps(1.0f / 128.0f));
+}
+
+static inline __m128
+load4_s16(const int16_t *src)
+{
+    __m128i vi = _mm_loadl_epi64((const __m128i *)src);
+    // sign-extend to 32 bits
+    vi = _mm_srai_epi32(_mm_unpacklo_epi16(vi, vi), 16);
+    return _mm_mul_ps(_mm_cvtepi32_ps(vi), _mm_set1_ps(1.0f / 32768.0f));
+}
+
+static inline __m128
+load4_s32_scaled(const int32_t *src, float scale)
+{
+    __m128i vi = _mm_loadu_si128((const __m128i *)src);
+    return _mm_mul_ps(_mm_cvtepi32_ps(vi), _mm_set1_ps(scale));
+}
+
+static inline __m128
+load4_s20(const int32_t *src)
+{
+    return load4_s32_scaled(src, 1.0f / 524288.0f);
+}
+
+static inline __m128
+load4_s24(const int32_t *src)
+{
+    return load4_s32_scaled(src, 1.0f / 8388608.0f);
+}
+
+static inline __m128
+load4_s32(const int32_t *src)
+{
+    return load4_s32_scaled(src, 1.0f / 2147483648.0f);
+}
+
+static inline __m128
+load4_float(const float *src)
+{
+    return _mm_loadu_ps(src);
+}
+
+static inline __m128
+load4_double(const double *src)
+{
+    __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src));
+    __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src+2));
+    return _mm_movelh_ps(lo, hi);
+}
+
+/**
+ * Mono and stereo are de-interleaved with shuffles.  For more channels, the
+ * converted frames are stored to a small buffer and picked up from there.
+ */
+#define SSE2_FMT_CONVERT(NAME, TYPE)                                          \
+static void                                                                   \
+sse2_fmt_convert_from_##NAME(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],\
+                             const void *vsrc, const int *chmap, int nch,     \
+                             int n)                                           \
+{                                                                             \
+    const TYPE *src = vsrc;                                                   \
+    int i, j, ch;                                                             \
+                                                                              \
+    if(nch == 1) {                                                            \
+        for(i=0; i<n; i+=4)                                                   \
+            _mm_storeu_ps(&dest[0][i], load4_##NAME(&src[i]));                \
+    } else if(nch == 2) {                                                     \
+        /* a map of two channels is its own inverse */                        \
+        FLOAT *dest0 = dest[chmap[0]];                                        \
+        FLOAT *dest1 = dest[chmap[1]];                                        \
+        for(i=0; i<n; i+=4) {                                                 \
+            __m128 v0 = load4_##NAME(&src[2*i]);                              \
+            __m128 v1 = load4_##NAME(&src[2*i+4]);                            \
+            _mm_storeu_ps(&dest0[i], _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2,0,2,0)));\
+            _mm_storeu_ps(&dest1[i], _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3,1,3,1)));\
+        }                                                                     \
+    } else {                                                                  \
+        ALIGN16(float) tmp[4*A52_MAX_CHANNELS];                               \
+        for(i=0; i<n; i+=4) {                                                 \
+            for(j=0; j<nch; j++)                                              \
+                _mm_store_ps(&tmp[4*j], load4_##NAME(&src[i*nch+4*j]));       \
+            for(ch=0; ch<nch; ch++) {                                         \
+                const float *t = &tmp[chmap[ch]];                             \
+                _mm_storeu_ps(&dest[ch][i], _mm_setr_ps(t[0], t[nch],         \
+                                                        t[2*nch], t[3*nch])); \
+            }                                                                 \
+        }                                                                     \
+    }                                                                         \
+}
+
+#else /* CONFIG_DOUBLE */
+
+/* converts 2 consecutive input samples to double */
+
+static inline __m128d
+load2_u8(const uint8_t *src)
+{
+    uint16_t v;
+    __m128i vi;
+
+    memcpy(&v, src, 2);
+    vi = _mm_cvtsi32_si128(v);
+    vi = _mm_unpacklo_epi8(vi, _mm_setzero_si128());
+    vi = _mm_unpacklo_epi16(vi, _mm_setzero_si128());
+    return _mm_mul_pd(_mm_sub_pd(_mm_cvtepi32_pd(vi), _mm_set1_pd(128.0)),
+                      _mm_set1_pd(1.0 / 128.0));
+}
+
+static inline __m128d
+load2_s16(const int16_t *src)
+{
+    int32_t v;
+    __m128i vi;
+
+    memcpy(&v, src, 4);
+    vi = _mm_cvtsi32_si128(v);
+    // sign-extend to 32 bits
+    vi = _mm_srai_epi32(_mm_unpacklo_epi16(vi, vi), 16);
+    return _mm_mul_pd(_mm_cvtepi32_pd(vi), _mm_set1_pd(1.0 / 32768.0));
+}
+
+static inline __m128d
+load2_s32_scaled(const int32_t *src, double scale)
+{
+    __m128i vi = _mm_loadl_epi64((const __m128i *)src);
+    return _mm_mul_pd(_mm_cvtepi32_pd(vi), _mm_set1_pd(scale));
+}
+
+static inline __m128d
+load2_s20(const int32_t *src)
+{
+    return load2_s32_scaled(src, 1.0 / 524288.0);
+}
+
+static inline __m128d
+load2_s24(const int32_t *src)
+{
+    return load2_s32_scaled(src, 1.0 / 8388608.0);
+}
+
+static inline __m128d
+load2_s32(const int32_t *src)
+{
+    return load2_s32_scaled(src, 1.0 / 2147483648.0);
+}
+
+static inline __m128d
+load2_float(const float *src)
+{
+    return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)src)));
+}
+
+static inline __m128d
+load2_double(const double *src)
+{
+    return _mm_loadu_pd(src);
+}
+
+#define SSE2_FMT_CONVERT(NAME, TYPE)                                          \
+static void                                                                   \
+sse2_fmt_convert_from_##NAME(FLOAT dest[A52_MAX_CHANNELS][A52_SAMPLES_PER_FRAME],\
+                             const void *vsrc, const int *chmap, int nch,     \
+                             int n)                                           \
+{                                                                             \
+    const TYPE *src = vsrc;                                                   \
+    int i, j, ch;                                                             \
+                                                                              \
+    if(nch == 1) {                                                            \
+        for(i=0; i<n; i+=2)                                                   \
+            _mm_storeu_pd(&dest[0][i], load2_##NAME(&src[i]));                \
+    } else if(nch == 2) {                                                     \
+        /* a map of two channels is its own inverse */                        \
+        FLOAT *dest0 = dest[chmap[0]];                                        \
+        FLOAT *dest1 = dest[chmap[1]];                                        \
+        for(i=0; i<n; i+=2) {                                                 \
+            __m128d v0 = load2_##NAME(&src[2*i]);                             \
+            __m128d v1 = load2_##NAME(&src[2*i+2]);                           \
+            _mm_storeu_pd(&dest0[i], _mm_unpacklo_pd(v0, v1));                \
+            _mm_storeu_pd(&dest1[i], _mm_unpackhi_pd(v0, v1));                \
+        }                                                                     \
+    } else {                                                                  \
+        ALIGN16(double) tmp[2*A52_MAX_CHANNELS];                              \
+        for(i=0; i<n; i+=2) {                                                 \
+            for(j=0; j<nch; j++)                                              \
+                _mm_store_pd(&tmp[2*j], load2_##NAME(&src[i*nch+2*j]));       \
+            for(ch=0; ch<nch; ch++) {                                         \
+                const double *t = &tmp[chmap[ch]];                            \
+                _mm_storeu_pd(&dest[ch][i], _mm_setr_pd(t[0], t[nch]));       \
+            }                                                                 \
+        }                                                                     \
+    }                                                                         \
+}
+
+#endif /* CONFIG_DOUBLE */
+
+SSE2_FMT_CONVERT(u8,     uint8_t)
+SSE2_FMT_CONVERT(s16,    int16_t)
+SSE2_FMT_CONVERT(s20,    int32_t)
+SSE2_FMT_CONVERT(s24,    int32_t)
+SSE2_FMT_CONVERT(s32,    int32_t)
+SSE2_FMT_CONVERT(float,  float)
+SSE2_FMT_CONVERT(double, double)
+
+FmtConvertFunc
+sse2_fmt_convert_select(A52SampleFormat fmt)
+{
+    switch(fmt) {
+        case A52_SAMPLE_FMT_U8:  return sse2_fmt_convert_from_u8;
+        case A52_SAMPLE_FMT_S16: return sse2_fmt_convert_from_s16;
+        case A52_SAMPLE_FMT_S20: return sse2_fmt_convert_from_s20;
+        case A52_SAMPLE_FMT_S24: return sse2_fmt_convert_from_s24;
+        case A52_SAMPLE_FMT_S32: return sse2_fmt_convert_from_s32;
+        case A52_SAMPLE_FMT_FLT: return sse2_fmt_convert_from_float;
+        case A52_SAMPLE_FMT_DBL: return sse2_fmt_convert_from_double;
+    }
+    return NULL;
+}
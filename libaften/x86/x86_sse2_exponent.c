@@ -273,103 +273,50 @@ encode_exp_blk_ch(uint8_t *exp, int ncoefs, int exp_strategy)
 }
 
 
-/**
- * Determine a good exponent strategy for all blocks of a single channel.
- * A pre-defined set of strategies is chosen based on the SSE between each set
- * and the most accurate strategy set (all blocks EXP_D15).
- */
+/* sum of the squared differences between exp[i] and exp1[i] */
 static int
-compute_expstr_ch(uint8_t *exp[A52_NUM_BLOCKS], int ncoefs)
+exponent_sqerr(const uint8_t *exp, const uint8_t *exp1, int n)
 {
-    ALIGN16(uint8_t) exponents[A52_NUM_BLOCKS][256];
-    int blk, str, i, j, k;
-    int min_error, exp_error[6];
-    int err;
-
-    min_error = 1;
-    for(str=1; str<6; str++) {
-        // collect exponents
-        for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-            memcpy(exponents[blk], exp[blk], 256);
-        }
-
-        // encode exponents
-        i = 0;
-        while(i < A52_NUM_BLOCKS) {
-            j = i + 1;
-            while(j < A52_NUM_BLOCKS && str_predef[str][j]==EXP_REUSE) {
-                exponent_min(exponents[i], exponents[j], ncoefs);
-                j++;
-            }
-            encode_exp_blk_ch(exponents[i], ncoefs, str_predef[str][i]);
-            for(k=i+1; k<j; k++) {
-                memcpy(exponents[k], exponents[i], 256);
-            }
-            i = j;
-        }
-
-        // select strategy based on minimum error from unencoded exponents
-        exp_error[str] = 0;
-        for(blk=0; blk<A52_NUM_BLOCKS; blk++) {
-            uint8_t *exp_blk = exp[blk];
-            uint8_t *exponents_blk = exponents[blk];
-            union {
-                __m128i v;
-                int32_t res[4];
-            } ures;
-            __m128i vzero = _mm_setzero_si128();
-            __m128i vres = vzero;
+    union {
+        __m128i v;
+        int32_t res[4];
+    } ures;
+    __m128i vzero = _mm_setzero_si128();
+    __m128i vres = vzero;
+    int i, err, sum;
 
-            for(i=0; i<(ncoefs & ~15); i+=16) {
-                __m128i vexp = _mm_loadu_si128((__m128i*)&exp_blk[i]);
-                __m128i vexp2 = _mm_load_si128((__m128i*)&exponents_blk[i]);
-#if 0
-                //safer but needed?
-                __m128i vexphi = _mm_unpackhi_epi8(vexp, vzero);
-                __m128i vexp2hi = _mm_unpackhi_epi8(vexp2, vzero);
-                __m128i vexplo = _mm_unpacklo_epi8(vexp, vzero);
-                __m128i vexp2lo = _mm_unpacklo_epi8(vexp2, vzero);
-                __m128i verrhi = _mm_sub_epi16(vexphi, vexp2hi);
-                __m128i verrlo = _mm_sub_epi16(vexplo, vexp2lo);
-#else
-                __m128i verr = _mm_sub_epi8(vexp, vexp2);
-                __m128i vsign = _mm_cmplt_epi8(verr, vzero);
-                __m128i verrhi = _mm_unpackhi_epi8(verr, vsign);
-                __m128i verrlo = _mm_unpacklo_epi8(verr, vsign);
-#endif
-                verrhi = _mm_madd_epi16(verrhi, verrhi);
-                verrlo = _mm_madd_epi16(verrlo, verrlo);
-                verrhi = _mm_add_epi32(verrhi, verrlo);
-                vres = _mm_add_epi32(vres, verrhi);
-            }
-            _mm_store_si128(&ures.v, vres);
-            ures.res[0]+=ures.res[1];
-            ures.res[2]+=ures.res[3];
-            exp_error[str] += ures.res[0]+ures.res[2];
-            for(; i<ncoefs; ++i) {
-                err = exp_blk[i] - exponents_blk[i];
-                exp_error[str] += (err * err);
-            }
-        }
-        if(exp_error[str] < exp_error[min_error]) {
-            min_error = str;
-        }
+    for(i=0; i<(n & ~15); i+=16) {
+        __m128i vexp = _mm_loadu_si128((__m128i*)&exp[i]);
+        __m128i vexp2 = _mm_loadu_si128((__m128i*)&exp1[i]);
+        __m128i verr = _mm_sub_epi8(vexp, vexp2);
+        __m128i vsign = _mm_cmplt_epi8(verr, vzero);
+        __m128i verrhi = _mm_unpackhi_epi8(verr, vsign);
+        __m128i verrlo = _mm_unpacklo_epi8(verr, vsign);
+        verrhi = _mm_madd_epi16(verrhi, verrhi);
+        verrlo = _mm_madd_epi16(verrlo, verrlo);
+        verrhi = _mm_add_epi32(verrhi, verrlo);
+        vres = _mm_add_epi32(vres, verrhi);
+    }
+    _mm_store_si128(&ures.v, vres);
+    sum = ures.res[0]+ures.res[1]+ures.res[2]+ures.res[3];
+    for(; i<n; i++) {
+        err = exp[i] - exp1[i];
+        sum += (err * err);
     }
-    return min_error;
+    return sum;
 }
 
 
 /**
- * Runs all the processes in extracting, analyzing, and encoding exponents
+ * Runs all the processes in analyzing and encoding exponents
+ * of a single channel
  */
 void
-sse2_process_exponents(A52ThreadContext *tctx)
+sse2_process_exponents(A52ThreadContext *tctx, int ch)
 {
-    extract_exponents(tctx);
-
-    compute_exponent_strategy(tctx);
+    compute_exponent_strategy(tctx, ch);
 
-    encode_exponents(tctx);
+    encode_exponents(tctx, ch);
 
-    group_exponents(tctx);
+    group_exponents(tctx, ch);
 }
@@ -0,0 +1,419 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file x86_sse2_mdct_double.c
+ * SSE2 optimized MDCT for the double precision build
+ *
+ * This follows the C version in mdct.c.  Its steps work on (x[k], x[k+1])
+ * pairs, which are kept in one register each and treated as complex
+ * numbers.  The lookup tables of the C init are used as they are.
+ */
+
+#include "common.h"
+
+#include <string.h>
+
+#include "a52.h"
+#include "mdct.h"
+#include "x86_simd_support.h"
+
+/* the sign bit of the high element */
+#define SIGN_HI _mm_castsi128_pd(_mm_set_epi32(0x80000000, 0, 0, 0))
+/* the sign bits of both elements */
+#define SIGN_BOTH _mm_set1_pd(-0.0)
+
+static inline __m128d
+swap_pd(__m128d a)
+{
+    return _mm_shuffle_pd(a, a, 1);
+}
+
+/** d times the complex constant (a, b) */
+static inline __m128d
+cmul_const(__m128d d, double a, double b)
+{
+    return _mm_add_pd(_mm_mul_pd(d, _mm_set1_pd(a)),
+                      _mm_mul_pd(swap_pd(d), _mm_setr_pd(-b, b)));
+}
+
+/** (r0*t0 + r1*t1, r1*t0 - r0*t1) for d = (r0, r1) and t = (t0, t1) */
+static inline __m128d
+rotate(__m128d d, __m128d t)
+{
+    __m128d t1 = _mm_xor_pd(_mm_unpackhi_pd(t, t), SIGN_HI);
+    return _mm_add_pd(_mm_mul_pd(d, _mm_unpacklo_pd(t, t)),
+                      _mm_mul_pd(swap_pd(d), t1));
+}
+
+/** 8 point butterfly of the pairs in v[0..3] */
+static inline void
+mdct_butterfly_8(__m128d *v)
+{
+    __m128d s1 = _mm_add_pd(v[2], v[0]);
+    __m128d d1 = _mm_sub_pd(v[2], v[0]);
+    __m128d s2 = _mm_add_pd(v[3], v[1]);
+    __m128d d2 = _mm_sub_pd(v[3], v[1]);
+    __m128d e  = _mm_xor_pd(swap_pd(d1), SIGN_HI);
+
+    v[0] = _mm_add_pd(d2, e);
+    v[1] = _mm_sub_pd(d2, e);
+    v[2] = _mm_sub_pd(s2, s1);
+    v[3] = _mm_add_pd(s2, s1);
+}
+
+/** 16 point butterfly of the pairs in v[0..7] */
+static inline void
+mdct_butterfly_16(__m128d *v)
+{
+    __m128d d0 = _mm_sub_pd(v[4], v[0]);
+    __m128d d1 = _mm_sub_pd(v[5], v[1]);
+    __m128d d2 = _mm_sub_pd(v[6], v[2]);
+    __m128d d3 = _mm_sub_pd(v[7], v[3]);
+
+    v[4] = _mm_add_pd(v[4], v[0]);
+    v[5] = _mm_add_pd(v[5], v[1]);
+    v[6] = _mm_add_pd(v[6], v[2]);
+    v[7] = _mm_add_pd(v[7], v[3]);
+    v[0] = cmul_const(d0, -AFT_PI2_8, AFT_PI2_8);
+    v[1] = _mm_xor_pd(swap_pd(d1), _mm_setr_pd(-0.0, 0.0));
+    v[2] = cmul_const(d2, AFT_PI2_8, AFT_PI2_8);
+    v[3] = d3;
+
+    mdct_butterfly_8(v);
+    mdct_butterfly_8(v+4);
+}
+
+/** 32 point butterfly (in place) */
+static inline void
+mdct_butterfly_32(FLOAT *x)
+{
+    __m128d v[16];
+    __m128d d[8];
+    int i;
+
+    for(i=0; i<16; i++)
+        v[i] = _mm_loadu_pd(x+2*i);
+
+    for(i=0; i<8; i++) {
+        d[i] = _mm_sub_pd(v[i+8], v[i]);
+        v[i+8] = _mm_add_pd(v[i+8], v[i]);
+    }
+    v[0] = cmul_const(d[0], -AFT_PI1_8, AFT_PI3_8);
+    v[1] = cmul_const(d[1], -AFT_PI2_8, AFT_PI2_8);
+    v[2] = cmul_const(d[2], -AFT_PI3_8, AFT_PI1_8);
+    v[3] = _mm_xor_pd(swap_pd(d[3]), _mm_setr_pd(-0.0, 0.0));
+    v[4] = cmul_const(d[4], AFT_PI3_8, AFT_PI1_8);
+    v[5] = cmul_const(d[5], AFT_PI2_8, AFT_PI2_8);
+    v[6] = cmul_const(d[6], AFT_PI1_8, AFT_PI3_8);
+    v[7] = d[7];
+
+    mdct_butterfly_16(v);
+    mdct_butterfly_16(v+8);
+
+    for(i=0; i<16; i++)
+        _mm_storeu_pd(x+2*i, v[i]);
+}
+
+/** one pair step of the first and generic stage butterflies */
+static inline void
+butterfly_step(FLOAT *x1, FLOAT *x2, const FLOAT *trig)
+{
+    __m128d a = _mm_loadu_pd(x1);
+    __m128d b = _mm_loadu_pd(x2);
+
+    _mm_storeu_pd(x1, _mm_add_pd(a, b));
+    _mm_storeu_pd(x2, rotate(_mm_sub_pd(a, b), _mm_loadu_pd(trig)));
+}
+
+/** N-point first stage butterfly (in place) */
+static inline void
+mdct_butterfly_first(FLOAT *trig, FLOAT *x, int points)
+{
+    FLOAT *x1 = x + points - 8;
+    FLOAT *x2 = x + (points>>1) - 8;
+
+    do {
+        butterfly_step(x1+6, x2+6, trig);
+        butterfly_step(x1+4, x2+4, trig+4);
+        butterfly_step(x1+2, x2+2, trig+8);
+        butterfly_step(x1  , x2  , trig+12);
+
+        x1 -= 8;
+        x2 -= 8;
+        trig += 16;
+    } while(x2 >= x);
+}
+
+/** N/stage point generic N stage butterfly (in place) */
+static inline void
+mdct_butterfly_generic(FLOAT *trig, FLOAT *x, int points, int trigint)
+{
+    FLOAT *x1 = x + points - 8;
+    FLOAT *x2 = x + (points>>1) - 8;
+
+    do {
+        butterfly_step(x1+6, x2+6, trig);
+        butterfly_step(x1+4, x2+4, trig+trigint);
+        butterfly_step(x1+2, x2+2, trig+2*trigint);
+        butterfly_step(x1  , x2  , trig+3*trigint);
+
+        trig += 4*trigint;
+        x1 -= 8;
+        x2 -= 8;
+    } while(x2 >= x);
+}
+
+static inline void
+mdct_butterflies(MDCTContext *mdct, FLOAT *x, int points)
+{
+    FLOAT *trig = mdct->trig;
+    int stages = mdct->log2n-5;
+    int i, j;
+
+    if(--stages > 0) {
+        mdct_butterfly_first(trig, x, points);
+    }
+
+    for(i=1; --stages>0; i++) {
+        for(j=0; j<(1<<i); j++)
+            mdct_butterfly_generic(trig, x+(points>>i)*j, points>>i, 4<<i);
+    }
+
+    for(j=0; j<points; j+=32)
+        mdct_butterfly_32(x+j);
+}
+
+/**
+ * One step of the bit-reversal: returns the pair for w0, and the pair for
+ * w1 in *back.
+ */
+static inline __m128d
+bitreverse_step(const FLOAT *x0, const FLOAT *x1, __m128d t, __m128d *back)
+{
+    __m128d a = _mm_loadu_pd(x0);
+    __m128d b = _mm_loadu_pd(x1);
+    __m128d s = _mm_add_pd(a, b);
+    __m128d d = _mm_sub_pd(a, b);
+    // q = (x0[0] + x1[0], x0[1] - x1[1]), h = (x0[1] + x1[1], x0[0] - x1[0])
+    __m128d q = _mm_move_sd(d, s);
+    __m128d h = _mm_mul_pd(_mm_shuffle_pd(s, d, 1), _mm_set1_pd(0.5));
+    __m128d r = _mm_add_pd(_mm_mul_pd(q, _mm_xor_pd(_mm_unpacklo_pd(t, t), SIGN_HI)),
+                           _mm_mul_pd(swap_pd(q), _mm_unpackhi_pd(t, t)));
+
+    *back = _mm_xor_pd(_mm_sub_pd(h, r), SIGN_HI);
+    return _mm_add_pd(h, r);
+}
+
+static inline void
+mdct_bitreverse(MDCTContext *mdct, FLOAT *x)
+{
+    int n = mdct->n;
+    int *bit = mdct->bitrev;
+    FLOAT *w0 = x;
+    FLOAT *w1 = x = w0+(n>>1);
+    FLOAT *trig = mdct->trig+n;
+    __m128d back;
+
+    do {
+        w1 -= 4;
+
+        _mm_storeu_pd(w0, bitreverse_step(x+bit[0], x+bit[1],
+                                          _mm_loadu_pd(trig), &back));
+        _mm_storeu_pd(w1+2, back);
+        _mm_storeu_pd(w0+2, bitreverse_step(x+bit[2], x+bit[3],
+                                            _mm_loadu_pd(trig+2), &back));
+        _mm_storeu_pd(w1, back);
+
+        trig += 4;
+        bit += 4;
+        w0 += 4;
+    } while(w0 < w1);
+}
+
+/**
+ * Exponents of the coefficients in a and b, as 4 bytes in the low dword.
+ * They are read from the exponent fields, see coef_exponent().
+ */
+static inline __m128i
+sse2_coef_exponents_pd(__m128d a, __m128d b)
+{
+    // shifting out the sign bit leaves the biased exponent in the low dword
+    __m128i ea = _mm_srli_epi64(_mm_slli_epi64(_mm_castpd_si128(a), 1), 53);
+    __m128i eb = _mm_srli_epi64(_mm_slli_epi64(_mm_castpd_si128(b), 1), 53);
+    __m128i e  = _mm_or_si128(ea, _mm_slli_epi64(eb, 32));
+    e = _mm_shuffle_epi32(e, _MM_SHUFFLE(3,1,2,0));
+    e = _mm_sub_epi16(_mm_set1_epi16(1022), _mm_packs_epi32(e, e));
+    // the unsigned saturation clips negative exponents to 0
+    e = _mm_min_epi16(e, _mm_set1_epi16(24));
+    return _mm_packus_epi16(e, e);
+}
+
+static inline void
+store2_exp(uint8_t *exp, int v)
+{
+    uint16_t e = v;
+    memcpy(exp, &e, 2);
+}
+
+/** inputs of one pre-twiddle step: (x0[2], x0[0]) and (x1[0], x1[2]) */
+static inline void
+load_pretwiddle(const FLOAT *x0, const FLOAT *x1, __m128d *a, __m128d *b)
+{
+    *a = _mm_shuffle_pd(_mm_loadu_pd(x0+2), _mm_loadu_pd(x0), 0);
+    *b = _mm_unpacklo_pd(_mm_loadu_pd(x1), _mm_loadu_pd(x1+2));
+}
+
+/**
+ * The exponents are taken from the output coefficients while they are still
+ * in registers, if exp is not NULL.
+ */
+static void
+mdct(MDCTThreadContext *tmdct, FLOAT *out, uint8_t *exp, FLOAT *in)
+{
+    MDCTContext *mdct = tmdct->mdct;
+    int n = mdct->n;
+    int n2 = n>>1;
+    int n4 = n>>2;
+    int n8 = n>>3;
+    FLOAT *w = tmdct->buffer;
+    FLOAT *w2 = w+n2;
+    FLOAT *x0 = in+n2+n4;
+    FLOAT *x1 = x0+1;
+    FLOAT *trig = mdct->trig + n2;
+    __m128d scale = _mm_set1_pd(mdct->scale);
+    __m128d a, b;
+    int i;
+
+    for(i=0; i<n8; i+=2) {
+        x0 -= 4;
+        trig -= 2;
+        load_pretwiddle(x0, x1, &a, &b);
+        _mm_storeu_pd(w2+i, rotate(_mm_add_pd(a, b), _mm_loadu_pd(trig)));
+        x1 += 4;
+    }
+
+    x1 = in+1;
+    for(; i<n2-n8; i+=2) {
+        trig -= 2;
+        x0 -= 4;
+        load_pretwiddle(x0, x1, &a, &b);
+        _mm_storeu_pd(w2+i, rotate(_mm_sub_pd(a, b), _mm_loadu_pd(trig)));
+        x1 += 4;
+    }
+
+    x0 = in+n;
+    for(; i<n2; i+=2) {
+        trig -= 2;
+        x0 -= 4;
+        load_pretwiddle(x0, x1, &a, &b);
+        a = _mm_xor_pd(a, SIGN_BOTH);
+        _mm_storeu_pd(w2+i, rotate(_mm_sub_pd(a, b), _mm_loadu_pd(trig)));
+        x1 += 4;
+    }
+
+    mdct_butterflies(mdct, w2, n2);
+    mdct_bitreverse(mdct, w);
+
+    // two steps at a time: out[i], out[i+1] and out[n2-2-i], out[n2-1-i]
+    trig = mdct->trig+n2;
+    for(i=0; i<n4; i+=2) {
+        __m128d w0 = _mm_loadu_pd(w);
+        __m128d w1 = _mm_loadu_pd(w+2);
+        __m128d t0 = _mm_loadu_pd(trig);
+        __m128d t1 = _mm_loadu_pd(trig+2);
+        __m128d r0 = _mm_add_pd(_mm_mul_pd(_mm_unpacklo_pd(w0, w0), t0),
+                                _mm_mul_pd(_mm_unpackhi_pd(w0, w0),
+                                           _mm_xor_pd(swap_pd(t0), SIGN_HI)));
+        __m128d r1 = _mm_add_pd(_mm_mul_pd(_mm_unpacklo_pd(w1, w1), t1),
+                                _mm_mul_pd(_mm_unpackhi_pd(w1, w1),
+                                           _mm_xor_pd(swap_pd(t1), SIGN_HI)));
+        __m128d front, back;
+
+        r0 = _mm_mul_pd(r0, scale);
+        r1 = _mm_mul_pd(r1, scale);
+        front = _mm_unpacklo_pd(r0, r1);
+        back  = _mm_unpackhi_pd(r1, r0);
+        _mm_storeu_pd(out+i, front);
+        _mm_storeu_pd(out+n2-2-i, back);
+        if(exp) {
+            int e = _mm_cvtsi128_si32(sse2_coef_exponents_pd(front, back));
+            store2_exp(exp+i, e);
+            store2_exp(exp+n2-2-i, e >> 16);
+        }
+        w += 4;
+        trig += 4;
+    }
+}
+
+static void
+mdct_512(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
+{
+    mdct(&tctx->mdct_tctx_512, out, exp, in);
+}
+
+/** negated copy of 64 samples */
+static inline void
+copy_neg_64(FLOAT *dst, const FLOAT *src)
+{
+    int i;
+    for(i=0; i<64; i+=2)
+        _mm_storeu_pd(dst+i, _mm_xor_pd(_mm_loadu_pd(src+i), SIGN_BOTH));
+}
+
+static void
+mdct_256(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
+{
+    FLOAT *coef_a = in;
+    FLOAT *coef_b = in+128;
+    FLOAT *xx = tctx->mdct_tctx_256.buffer1;
+    int i;
+
+    memcpy(xx, in+64, 192 * sizeof(FLOAT));
+    copy_neg_64(xx+192, in);
+
+    mdct(&tctx->mdct_tctx_256, coef_a, NULL, xx);
+
+    copy_neg_64(xx, in+256+192);
+    memcpy(xx+64, in+256, 128 * sizeof(FLOAT));
+    copy_neg_64(xx+192, in+256+128);
+
+    mdct(&tctx->mdct_tctx_256, coef_b, NULL, xx);
+
+    for(i=0; i<128; i+=2) {
+        __m128d a = _mm_loadu_pd(coef_a+i);
+        __m128d b = _mm_loadu_pd(coef_b+i);
+        __m128d lo = _mm_unpacklo_pd(a, b);
+        __m128d hi = _mm_unpackhi_pd(a, b);
+        _mm_storeu_pd(out+2*i  , lo);
+        _mm_storeu_pd(out+2*i+2, hi);
+        if(exp) {
+            int32_t e = _mm_cvtsi128_si32(sse2_coef_exponents_pd(lo, hi));
+            memcpy(exp+2*i, &e, 4);
+        }
+    }
+}
+
+void
+sse2_mdct_init(A52Context *ctx)
+{
+    mdct_init(ctx);
+
+    ctx->mdct_ctx_512.mdct = mdct_512;
+    ctx->mdct_ctx_256.mdct = mdct_256;
+}
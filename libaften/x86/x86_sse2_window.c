@@ -0,0 +1,41 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file x86_sse2_window.c
+ * SSE2 optimized windowing for the double precision build
+ */
+
+#include "window.h"
+
+#include <emmintrin.h>
+
+void
+sse2_apply_a52_window(FLOAT *samples)
+{
+    int i;
+
+    for(i=0; i<512; i+=4) {
+        __m128d in0 = _mm_loadu_pd(samples+i);
+        __m128d in1 = _mm_loadu_pd(samples+i+2);
+        in0 = _mm_mul_pd(in0, _mm_load_pd(a52_window+i));
+        in1 = _mm_mul_pd(in1, _mm_load_pd(a52_window+i+2));
+        _mm_storeu_pd(samples+i, in0);
+        _mm_storeu_pd(samples+i+2, in1);
+    }
+}
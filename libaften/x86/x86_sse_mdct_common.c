@@ -492,8 +492,37 @@ mdct_bitreverse(MDCTContext *mdct, FLOAT *x)
     while(w0<w1);
 }
 
+#ifdef USE_SSE2
+/**
+ * Exponents of the coefficients in a and b, as 8 bytes in the low half.
+ * They are read from the exponent fields, see coef_exponent().
+ */
+static inline __m128i
+sse2_coef_exponents(__m128 a, __m128 b)
+{
+    // shifting out the sign bit leaves the biased exponent in the low byte
+    __m128i ea = _mm_srli_epi32(_mm_slli_epi32(_mm_castps_si128(a), 1), 24);
+    __m128i eb = _mm_srli_epi32(_mm_slli_epi32(_mm_castps_si128(b), 1), 24);
+    __m128i e  = _mm_sub_epi16(_mm_set1_epi16(126), _mm_packs_epi32(ea, eb));
+    // the unsigned saturation clips negative exponents to 0
+    e = _mm_min_epi16(e, _mm_set1_epi16(24));
+    return _mm_packus_epi16(e, e);
+}
+
+static inline void
+store4_exp(uint8_t *exp, __m128i e)
+{
+    int32_t v = _mm_cvtsi128_si32(e);
+    memcpy(exp, &v, 4);
+}
+#endif
+
+/**
+ * The exponents are taken from the output coefficients while they are still
+ * in registers, if exp is not NULL.
+ */
 static void
-mdct(MDCTThreadContext *tmdct, FLOAT *out, FLOAT *in)
+mdct(MDCTThreadContext *tmdct, FLOAT *out, uint8_t *exp, FLOAT *in)
 {
     MDCTContext *mdct = tmdct->mdct;
     int n = mdct->n;
@@ -621,19 +650,31 @@ mdct(MDCTThreadContext *tmdct, FLOAT *out, FLOAT *in)
         XMM4     = _mm_add_ps(XMM4, XMM5);
         _mm_store_ps(x0    , XMM0);
         _mm_store_ps(out +i, XMM4);
+        if(exp) {
+#ifdef USE_SSE2
+            __m128i e = sse2_coef_exponents(XMM4, XMM0);
+            store4_exp(exp+i, e);
+            store4_exp(exp+(x0-out), _mm_srli_si128(e, 4));
+#else
+            for(j=0; j<4; j++) {
+                exp[i+j]        = coef_exponent(out[i+j]);
+                exp[(x0-out)+j] = coef_exponent(x0[j]);
+            }
+#endif
+        }
         w   += 8;
         T   += 16;
     }
 }
 
 static void
-mdct_512(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
+mdct_512(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
 {
-    mdct(&tctx->mdct_tctx_512, out, in);
+    mdct(&tctx->mdct_tctx_512, out, exp, in);
 }
 
 static void
-mdct_256(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
+mdct_256(A52ThreadContext *tctx, FLOAT *out, uint8_t *exp, FLOAT *in)
 {
     FLOAT *coef_a, *coef_b, *xx;
     int i, j;
@@ -651,7 +692,7 @@ mdct_256(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
     }
     xx -= 192;
 
-    mdct(&tctx->mdct_tctx_256, coef_a, xx);
+    mdct(&tctx->mdct_tctx_256, coef_a, NULL, xx);
 
     in += 256 + 192;
     for(i=0; i<64; i+=4) {
@@ -672,7 +713,7 @@ mdct_256(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
     xx -= 192;
     in -= 256 + 128;
 
-    mdct(&tctx->mdct_tctx_256, coef_b, xx);
+    mdct(&tctx->mdct_tctx_256, coef_b, NULL, xx);
 
     for(i=0, j=0; i<128; i+=4, j+=8) {
         __m128 XMM0 = _mm_load_ps(coef_a + i);
@@ -681,5 +722,14 @@ mdct_256(A52ThreadContext *tctx, FLOAT *out, FLOAT *in)
         __m128 XMM3 = _mm_unpackhi_ps(XMM0, XMM1);
         _mm_store_ps(out + j  , XMM2);
         _mm_store_ps(out + j+4, XMM3);
+        if(exp) {
+#ifdef USE_SSE2
+            _mm_storel_epi64((__m128i *)(exp + j), sse2_coef_exponents(XMM2, XMM3));
+#else
+            int k;
+            for(k=0; k<8; k++)
+                exp[j+k] = coef_exponent(out[j+k]);
+#endif
+        }
     }
 }
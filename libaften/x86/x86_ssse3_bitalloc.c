@@ -0,0 +1,117 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file x86_ssse3_bitalloc.c
+ * A/52 ssse3 optimized bit allocation functions
+ *
+ * The table lookups are done with byte shuffles.  baptab has 64 entries, so
+ * it is split into 4 shuffles of 16 entries each.
+ */
+
+#include "common.h"
+
+#include "bitalloc.h"
+#include "x86_simd_support.h"
+
+/**
+ * Looks up 16 addresses in the range 0..63 in baptab.  Each part of the
+ * table only gets the indices which fall into it, the others have the sign
+ * bit set after the saturating add, which makes the shuffle return zero.
+ */
+static inline __m128i
+baptab_lookup(__m128i address, const __m128i lut[4])
+{
+    __m128i bap = _mm_setzero_si128();
+    int k;
+
+    for(k=0; k<4; k++) {
+        __m128i idx = _mm_sub_epi8(address, _mm_set1_epi8(16*k));
+        idx = _mm_adds_epu8(idx, _mm_set1_epi8(0x70));
+        bap = _mm_or_si128(bap, _mm_shuffle_epi8(lut[k], idx));
+    }
+    return bap;
+}
+
+void
+ssse3_compute_bap(uint8_t *bap, const int16_t *psd, const int16_t *thr, int n)
+{
+    __m128i lut[4];
+    __m128i vmax = _mm_set1_epi16(63);
+    int i, k, address;
+
+    for(k=0; k<4; k++)
+        lut[k] = _mm_loadu_si128((const __m128i *)&baptab[16*k]);
+
+    for(i=0; i<(n & ~15); i+=16) {
+        __m128i a0 = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)&psd[i]),
+                                   _mm_loadu_si128((const __m128i *)&thr[i]));
+        __m128i a1 = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)&psd[i+8]),
+                                   _mm_loadu_si128((const __m128i *)&thr[i+8]));
+        a0 = _mm_min_epi16(_mm_srai_epi16(a0, 5), vmax);
+        a1 = _mm_min_epi16(_mm_srai_epi16(a1, 5), vmax);
+        // the unsigned saturation clips negative addresses to 0
+        _mm_storeu_si128((__m128i *)&bap[i],
+                         baptab_lookup(_mm_packus_epi16(a0, a1), lut));
+    }
+    for(; i<n; i++) {
+        address = (psd[i] - thr[i]) >> 5;
+        address = CLIP(address, 0, 63);
+        bap[i] = baptab[address];
+    }
+}
+
+/* sum of the 16 bytes of v */
+static inline int
+hsum_epu8(__m128i v)
+{
+    v = _mm_sad_epu8(v, _mm_setzero_si128());
+    return _mm_cvtsi128_si32(v) + _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+}
+
+int
+ssse3_compute_mantissa_size(int mant_cnt[5], const uint8_t *bap, int n)
+{
+    __m128i lut = _mm_loadu_si128((const __m128i *)bap_bits);
+    __m128i vbits = _mm_setzero_si128();
+    __m128i cnt[5];
+    int bits, i, b;
+
+    // byte counters can't overflow, as there are at most 16 iterations
+    for(b=1; b<5; b++)
+        cnt[b] = _mm_setzero_si128();
+    for(i=0; i<(n & ~15); i+=16) {
+        __m128i vbap = _mm_loadu_si128((const __m128i *)&bap[i]);
+        vbits = _mm_add_epi64(vbits, _mm_sad_epu8(_mm_shuffle_epi8(lut, vbap),
+                                                  _mm_setzero_si128()));
+        for(b=1; b<5; b++)
+            cnt[b] = _mm_sub_epi8(cnt[b], _mm_cmpeq_epi8(vbap, _mm_set1_epi8(b)));
+    }
+    bits = _mm_cvtsi128_si32(vbits) + _mm_cvtsi128_si32(_mm_srli_si128(vbits, 8));
+    for(b=1; b<5; b++)
+        mant_cnt[b] += hsum_epu8(cnt[b]);
+
+    for(; i<n; i++) {
+        b = bap[i];
+        if(b <= 4)
+            ++mant_cnt[b];
+        else
+            bits += bap_bits[b];
+    }
+    return bits;
+}
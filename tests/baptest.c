@@ -0,0 +1,153 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file baptest.c
+ * Checks that the SIMD bap and mantissa size kernels are bit-exact
+ *
+ * The kernels are run on random psd and masking values, which include
+ * differences far outside the baptab range, at all lengths and at unaligned
+ * start positions like those of the bit allocation.  The bap values, the
+ * mantissa bits and the counts of grouped mantissas must equal those of the
+ * C versions.
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "a52.h"
+#include "bitalloc.h"
+#include "cpu_caps.h"
+
+#define N_RUNS 20000
+
+/* returned when the CPU has none of the tested instruction sets */
+#define SKIP_TEST 77
+
+typedef struct {
+    const char *name;
+    int supported;
+    void (*compute_bap)(uint8_t *bap, const int16_t *psd, const int16_t *thr,
+                        int n);
+    int (*compute_mantissa_size)(int mant_cnt[5], const uint8_t *bap, int n);
+} BapVersion;
+
+static A52Context ref_ctx;
+
+static int
+test_version(const BapVersion *v)
+{
+    int16_t psd[256], thr[256];
+    uint8_t ref_bap[256+32], test_bap[256+32];
+    int ref_cnt[5], test_cnt[5];
+    int ref_bits, test_bits;
+    int run, i, k, n, start, errors = 0;
+
+    srand(1);
+    for(run=0; run<N_RUNS; run++) {
+        start = rand() % 32;
+        n = rand() % (257 - start);
+
+        for(i=0; i<256; i++) {
+            // psd of an exponent, threshold anywhere from far below to
+            // far above it
+            psd[i] = 3072 - 128 * (rand() % 25);
+            if(rand() % 4)
+                thr[i] = psd[i] - 2200 + rand() % 2400;
+            else
+                thr[i] = -2048 + rand() % 8192;
+        }
+
+        memset(ref_bap, 0xAA, sizeof(ref_bap));
+        memset(test_bap, 0xAA, sizeof(test_bap));
+        ref_ctx.compute_bap(&ref_bap[start], &psd[start], &thr[start], n);
+        v->compute_bap(&test_bap[start], &psd[start], &thr[start], n);
+        if(memcmp(ref_bap, test_bap, sizeof(ref_bap))) {
+            if(!errors)
+                fprintf(stderr, "%s compute_bap: mismatch at start %d, n %d\n",
+                        v->name, start, n);
+            errors++;
+        }
+
+        for(i=0; i<256; i++)
+            ref_bap[i] = rand() % 16;
+        for(k=0; k<5; k++)
+            ref_cnt[k] = test_cnt[k] = k;
+        ref_bits = ref_ctx.compute_mantissa_size(ref_cnt, &ref_bap[start], n);
+        test_bits = v->compute_mantissa_size(test_cnt, &ref_bap[start], n);
+        if(ref_bits != test_bits ||
+                memcmp(&ref_cnt[1], &test_cnt[1], 4 * sizeof(int))) {
+            if(!errors)
+                fprintf(stderr, "%s compute_mantissa_size: mismatch at start %d, "
+                        "n %d: %d bits, C gives %d\n", v->name, start, n,
+                        test_bits, ref_bits);
+            errors++;
+        }
+    }
+    printf("%s: %d errors\n", v->name, errors);
+    return errors;
+}
+
+int
+main(void)
+{
+    BapVersion versions[3];
+    int n_versions = 0;
+    int errors = 0, tested = 0;
+    int i;
+
+    cpu_caps_detect();
+
+#ifdef HAVE_SSSE3
+    versions[n_versions].name = "ssse3";
+    versions[n_versions].supported = cpu_caps_have_ssse3();
+    versions[n_versions].compute_bap = ssse3_compute_bap;
+    versions[n_versions].compute_mantissa_size = ssse3_compute_mantissa_size;
+    n_versions++;
+#endif
+#ifdef HAVE_AVX2
+    versions[n_versions].name = "avx2";
+    versions[n_versions].supported = cpu_caps_have_avx2();
+    versions[n_versions].compute_bap = avx2_compute_bap;
+    versions[n_versions].compute_mantissa_size = avx2_compute_mantissa_size;
+    n_versions++;
+#endif
+
+#ifdef HAVE_MMX
+    // bitalloc_init selects the C versions when there is nothing better
+    x86cpu_caps_use.ssse3 = 0;
+    x86cpu_caps_use.avx2 = 0;
+#endif
+    bitalloc_init(&ref_ctx);
+
+    for(i=0; i<n_versions; i++) {
+        if(!versions[i].supported) {
+            printf("%s: not supported by this CPU\n", versions[i].name);
+            continue;
+        }
+        errors += test_version(&versions[i]);
+        tested++;
+    }
+
+    if(!tested)
+        return SKIP_TEST;
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file batchtest.c
+ * Compares the batched MDCTs with transforming the inputs one by one
+ *
+ * Every batch size is run with unaligned outputs.  Each output of a batch
+ * must match the single transform of the same input to within a few rounding
+ * steps, with exponents that are those of the coefficients.  Nothing may be
+ * written past the outputs, to the slots of a smaller batch, or to the input.
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "a52.h"
+#include "mdct.h"
+#include "cpu_caps.h"
+
+#define N_RUNS 500
+
+/* returned when the CPU has none of the tested instruction sets */
+#define SKIP_TEST 77
+
+#define MAX_REL_ERROR 4e-6
+
+/* marks the samples and exponents that must not be written */
+#define GUARD_COEF FCONST(12345.0)
+#define GUARD_EXP 99
+
+typedef struct {
+    const char *name;
+    int (*supported)(void);
+    void (*init)(A52Context *ctx);
+    void (*thread_init)(A52ThreadContext *tctx);
+} MDCTVersion;
+
+#ifndef CONFIG_DOUBLE
+#ifdef HAVE_FMA
+static int
+have_avx2_fma(void)
+{
+    return cpu_caps_have_avx2() && cpu_caps_have_fma();
+}
+#endif
+#endif /* CONFIG_DOUBLE */
+
+static const MDCTVersion versions[] = {
+#ifndef CONFIG_DOUBLE
+#ifdef HAVE_FMA
+    { "avx2", have_avx2_fma, avx2_mdct_init, avx2_mdct_thread_init },
+#endif
+#endif /* CONFIG_DOUBLE */
+    { NULL, NULL, NULL, NULL }
+};
+
+static A52Context ctx;
+static A52ThreadContext tctx;
+
+static FLOAT in[MDCT_BATCH_MAX][512], in_copy[MDCT_BATCH_MAX][512];
+static FLOAT out[MDCT_BATCH_MAX][256+2];
+static uint8_t exp_out[MDCT_BATCH_MAX][256+1];
+static FLOAT ref_out[256];
+static uint8_t ref_exp[256];
+
+static int
+is_guard(const FLOAT *coef)
+{
+    FLOAT guard = GUARD_COEF;
+    return !memcmp(coef, &guard, sizeof(guard));
+}
+
+/* runs one batch and the single transforms, returns the number of errors */
+static int
+compare_batch(const char *name, int count, int with_exp, double *max_err)
+{
+    FLOAT *pin[MDCT_BATCH_MAX], *pout[MDCT_BATCH_MAX];
+    uint8_t *pexp[MDCT_BATCH_MAX];
+    FLOAT *src = tctx.frame.blocks[0].input_samples[0];
+    double peak, err;
+    int c, i, errors = 0;
+
+    for(c=0; c<MDCT_BATCH_MAX; c++) {
+        // every other output starts one sample off the vector alignment
+        pout[c] = out[c] + (c & 1);
+        pexp[c] = exp_out[c];
+        pin[c] = in[c];
+        for(i=0; i<256+2; i++)
+            out[c][i] = GUARD_COEF;
+        memset(exp_out[c], GUARD_EXP, sizeof(exp_out[c]));
+    }
+    memcpy(in_copy, in, sizeof(in));
+
+    ctx.mdct_ctx_512.mdct_batch(&tctx, pout, with_exp ? pexp : NULL, pin,
+                                count);
+
+    if(memcmp(in_copy, in, sizeof(in))) {
+        fprintf(stderr, "%s batch of %d: input was changed\n", name, count);
+        errors++;
+    }
+    for(c=0; c<MDCT_BATCH_MAX; c++) {
+        if(c >= count || !with_exp) {
+            for(i=0; i<256+1; i++)
+                if(exp_out[c][i] != GUARD_EXP)
+                    break;
+            if(i < 256+1) {
+                fprintf(stderr, "%s batch of %d: exponents of input %d were "
+                        "written\n", name, count, c);
+                errors++;
+            }
+        }
+        if(c >= count) {
+            for(i=0; i<256+2; i++)
+                if(!is_guard(&out[c][i]))
+                    break;
+            if(i < 256+2) {
+                fprintf(stderr, "%s batch of %d: unused output %d was "
+                        "written\n", name, count, c);
+                errors++;
+            }
+            continue;
+        }
+        if(((c & 1) && !is_guard(&out[c][0])) || !is_guard(&pout[c][256]) ||
+                (with_exp && exp_out[c][256] != GUARD_EXP)) {
+            fprintf(stderr, "%s batch of %d: output %d was overrun\n", name,
+                    count, c);
+            errors++;
+        }
+
+        // the single transforms may use their input as scratch space
+        memcpy(src, in[c], 512 * sizeof(FLOAT));
+        ctx.mdct_ctx_512.mdct(&tctx, ref_out, ref_exp, src);
+
+        peak = 0.0;
+        for(i=0; i<256; i++)
+            peak = MAX(peak, AFT_FABS(ref_out[i]));
+        for(i=0; i<256; i++) {
+            err = AFT_FABS(pout[c][i] - ref_out[i]);
+            if(peak > 0.0)
+                *max_err = MAX(*max_err, err / peak);
+            if(err > MAX_REL_ERROR * peak || (with_exp &&
+                    (pexp[c][i] != coef_exponent(pout[c][i]) ||
+                     abs(pexp[c][i] - ref_exp[i]) > 1))) {
+                if(!errors) {
+                    fprintf(stderr, "%s batch of %d: coef %d of input %d is "
+                            "%g (exp %d), single transform gives %g (exp %d)\n",
+                            name, count, i, c, pout[c][i],
+                            with_exp ? pexp[c][i] : -1, ref_out[i], ref_exp[i]);
+                }
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+int
+main(void)
+{
+    const MDCTVersion *v;
+    int errors = 0, tested = 0;
+    int run, i, c, count;
+
+    cpu_caps_detect();
+
+    for(v=versions; v->name; v++) {
+        if(!v->supported()) {
+            printf("%s: not supported by this CPU\n", v->name);
+            continue;
+        }
+        memset(&ctx, 0, sizeof(ctx));
+        memset(&tctx, 0, sizeof(tctx));
+        v->init(&ctx);
+        tctx.ctx = &ctx;
+        v->thread_init(&tctx);
+
+        srand(1);
+        for(count=2; count<=MDCT_BATCH_MAX; count++) {
+            double max_err = 0.0;
+            int n_errors = 0;
+
+            for(run=0; run<N_RUNS; run++) {
+                // full scale, quiet and silent input
+                FLOAT level = (run % 3 == 0) ? FCONST(1e-4) : FCONST(1.0);
+                for(c=0; c<MDCT_BATCH_MAX; c++) {
+                    for(i=0; i<512; i++) {
+                        in[c][i] = (run % 50 == 49 && c == 1) ? 0 : level *
+                                   (FLOAT)(rand() / (RAND_MAX / 2.0) - 1.0);
+                    }
+                }
+                n_errors += compare_batch(v->name, count, run % 10, &max_err);
+            }
+            printf("%s batch of %d: max error %g of peak, %d errors\n", v->name,
+                   count, max_err, n_errors);
+            errors += n_errors;
+        }
+
+        tctx.mdct_tctx_512.mdct_thread_close(&tctx);
+        ctx.mdct_ctx_512.mdct_close(&ctx);
+        tested++;
+    }
+
+    if(!tested)
+        return SKIP_TEST;
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file mdcttest.c
+ * Compares the SIMD MDCTs with the C reference
+ *
+ * Both transform sizes are run on random input at several levels.  The
+ * coefficients must match to within a few rounding steps of the largest
+ * one, and the exponents written along with them must be those of the
+ * coefficients and differ by at most one from the C ones.
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "a52.h"
+#include "mdct.h"
+#include "cpu_caps.h"
+
+#define N_RUNS 2000
+
+/* returned when the CPU has none of the tested instruction sets */
+#define SKIP_TEST 77
+
+#ifdef CONFIG_DOUBLE
+#define MAX_REL_ERROR 1e-12
+#else
+#define MAX_REL_ERROR 4e-6
+#endif
+
+typedef struct {
+    const char *name;
+    int (*supported)(void);
+    void (*init)(A52Context *ctx);
+    void (*thread_init)(A52ThreadContext *tctx);
+} MDCTVersion;
+
+#ifdef HAVE_FMA
+static int
+have_avx2_fma(void)
+{
+    return cpu_caps_have_avx2() && cpu_caps_have_fma();
+}
+#endif
+
+static const MDCTVersion versions[] = {
+#ifndef CONFIG_DOUBLE
+#ifdef HAVE_SSE
+    { "sse", cpu_caps_have_sse, sse_mdct_init, sse_mdct_thread_init },
+#endif
+#ifdef HAVE_SSE3
+    { "sse3", cpu_caps_have_sse3, sse3_mdct_init, sse3_mdct_thread_init },
+#endif
+#ifdef HAVE_FMA
+    { "avx2", have_avx2_fma, avx2_mdct_init, avx2_mdct_thread_init },
+#endif
+#else
+#ifdef HAVE_SSE2
+    { "sse2", cpu_caps_have_sse2, sse2_mdct_init, mdct_thread_init },
+#endif
+#ifdef HAVE_FMA
+    { "avx2", have_avx2_fma, avx2_mdct_init, mdct_thread_init },
+#endif
+#endif /* CONFIG_DOUBLE */
+    { NULL, NULL, NULL, NULL }
+};
+
+static A52Context ref_ctx, test_ctx;
+static A52ThreadContext ref_tctx, test_tctx;
+
+/* runs one transform of both versions, returns the number of errors */
+static int
+compare_mdct(const char *name, int n, const FLOAT *src, double *max_err)
+{
+    FLOAT *ref_in = ref_tctx.frame.blocks[0].input_samples[0];
+    FLOAT *ref_out = ref_tctx.frame.blocks[0].mdct_coef[0];
+    FLOAT *test_in = test_tctx.frame.blocks[0].input_samples[0];
+    FLOAT *test_out = test_tctx.frame.blocks[0].mdct_coef[0];
+    uint8_t ref_exp[256], test_exp[256];
+    double peak, err;
+    int i, errors;
+
+    // the transforms may use their input as scratch space
+    memcpy(ref_in, src, 512 * sizeof(FLOAT));
+    memcpy(test_in, src, 512 * sizeof(FLOAT));
+    if(n == 512) {
+        ref_ctx.mdct_ctx_512.mdct(&ref_tctx, ref_out, ref_exp, ref_in);
+        test_ctx.mdct_ctx_512.mdct(&test_tctx, test_out, test_exp, test_in);
+    } else {
+        ref_ctx.mdct_ctx_256.mdct(&ref_tctx, ref_out, ref_exp, ref_in);
+        test_ctx.mdct_ctx_256.mdct(&test_tctx, test_out, test_exp, test_in);
+    }
+
+    peak = 0.0;
+    for(i=0; i<256; i++)
+        peak = MAX(peak, AFT_FABS(ref_out[i]));
+
+    errors = 0;
+    for(i=0; i<256; i++) {
+        err = AFT_FABS(test_out[i] - ref_out[i]);
+        if(peak > 0.0)
+            *max_err = MAX(*max_err, err / peak);
+        if(err > MAX_REL_ERROR * peak ||
+                test_exp[i] != coef_exponent(test_out[i]) ||
+                abs(test_exp[i] - ref_exp[i]) > 1) {
+            if(!errors) {
+                fprintf(stderr, "%s mdct_%d: coef %d is %g (exp %d), "
+                        "C gives %g (exp %d)\n", name, n, i, test_out[i],
+                        test_exp[i], ref_out[i], ref_exp[i]);
+            }
+            errors++;
+        }
+    }
+    return errors;
+}
+
+int
+main(void)
+{
+    static FLOAT src[512];
+    const MDCTVersion *v;
+    int errors = 0, tested = 0;
+    int run, i, n;
+
+    cpu_caps_detect();
+
+    mdct_init(&ref_ctx);
+    ref_tctx.ctx = &ref_ctx;
+    mdct_thread_init(&ref_tctx);
+
+    for(v=versions; v->name; v++) {
+        if(!v->supported()) {
+            printf("%s: not supported by this CPU\n", v->name);
+            continue;
+        }
+        memset(&test_ctx, 0, sizeof(test_ctx));
+        memset(&test_tctx, 0, sizeof(test_tctx));
+        v->init(&test_ctx);
+        test_tctx.ctx = &test_ctx;
+        v->thread_init(&test_tctx);
+
+        srand(1);
+        for(n=512; n>=256; n>>=1) {
+            double max_err = 0.0;
+            int n_errors = 0;
+
+            for(run=0; run<N_RUNS; run++) {
+                // full scale, quiet and silent input
+                FLOAT level = (run % 3 == 0) ? FCONST(1e-4) : FCONST(1.0);
+                for(i=0; i<512; i++) {
+                    src[i] = (run % 50 == 49) ? 0 :
+                             level * (FLOAT)(rand() / (RAND_MAX / 2.0) - 1.0);
+                }
+                n_errors += compare_mdct(v->name, n, src, &max_err);
+            }
+            printf("%s mdct_%d: max error %g of peak, %d errors\n", v->name, n,
+                   max_err, n_errors);
+            errors += n_errors;
+        }
+
+        test_tctx.mdct_tctx_512.mdct_thread_close(&test_tctx);
+        test_ctx.mdct_ctx_512.mdct_close(&test_ctx);
+        tested++;
+    }
+
+    ref_tctx.mdct_tctx_512.mdct_thread_close(&ref_tctx);
+    ref_ctx.mdct_ctx_512.mdct_close(&ref_ctx);
+
+    if(!tested)
+        return SKIP_TEST;
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file testwav.c
+ * Writes a reproducible 16-bit WAV file for the tests
+ *
+ * Each channel is a tone sweep plus noise whose level changes every few
+ * frames, with short bursts to trigger block switching.  The rate control
+ * has to move around a lot on such input, which is what the threading tests
+ * need to catch differences.
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "aften.h"
+
+static void
+put_le16(FILE *f, int v)
+{
+    fputc(v & 0xFF, f);
+    fputc((v >> 8) & 0xFF, f);
+}
+
+static void
+put_le32(FILE *f, uint32_t v)
+{
+    put_le16(f, v & 0xFFFF);
+    put_le16(f, v >> 16);
+}
+
+int
+main(int argc, char **argv)
+{
+    FILE *f;
+    uint32_t seed = 1;
+    int sr, ch, n_frames, n, i, c;
+    uint32_t data_size;
+
+    if(argc < 5) {
+        fprintf(stderr, "usage: testwav <out.wav> <sample rate> <channels> <frames>\n");
+        return 1;
+    }
+    sr = atoi(argv[2]);
+    ch = atoi(argv[3]);
+    n_frames = atoi(argv[4]);
+    if(sr <= 0 || ch <= 0 || ch > 6 || n_frames <= 0) {
+        fprintf(stderr, "invalid parameters\n");
+        return 1;
+    }
+    f = fopen(argv[1], "wb");
+    if(!f) {
+        fprintf(stderr, "error opening output file: %s\n", argv[1]);
+        return 1;
+    }
+
+    n = n_frames * A52_SAMPLES_PER_FRAME;
+    data_size = n * ch * 2;
+    fwrite("RIFF", 1, 4, f);
+    put_le32(f, 36 + data_size);
+    fwrite("WAVEfmt ", 1, 8, f);
+    put_le32(f, 16);
+    put_le16(f, 1);
+    put_le16(f, ch);
+    put_le32(f, sr);
+    put_le32(f, sr * ch * 2);
+    put_le16(f, ch * 2);
+    put_le16(f, 16);
+    fwrite("data", 1, 4, f);
+    put_le32(f, data_size);
+
+    for(i=0; i<n; i++) {
+        int seg = i / (A52_SAMPLES_PER_FRAME * 3);
+        for(c=0; c<ch; c++) {
+            double t = (double)i / sr;
+            double freq = 100.0 * (c + 1) + 4000.0 * ((i + c * 7919) % n) / n;
+            double level = 0.05 + 0.9 * (((seg + c) * 37) % 16) / 16.0;
+            double noise;
+            int v;
+
+            seed = seed * 1664525 + 1013904223;
+            noise = ((int)(seed >> 16) - 32768) / 32768.0;
+            v = (int)(32767.0 * level * (0.6 * sin(2.0 * AFT_PI * freq * t) +
+                                         0.3 * noise));
+            // a click now and then for the transient detection
+            if((i + c * 512) % (A52_SAMPLES_PER_FRAME * 11) < 64)
+                v = (i & 1) ? 30000 : -30000;
+            put_le16(f, CLIP(v, -32768, 32767));
+        }
+    }
+
+    if(ferror(f)) {
+        fprintf(stderr, "error writing output file\n");
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,185 @@
+/**
+ * Aften: A/52 audio encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file threadbench.c
+ * Measures how the encoding speed scales with the number of threads
+ *
+ * The same 5.1 input, generated in memory so that no file I/O is timed, is
+ * encoded with 1, 2, 4, ... threads up to the given maximum.  Frames per
+ * second and the speedup over one thread are printed for each run.  The
+ * library caps the thread count at MAX_NUM_THREADS; the count actually used
+ * is what gets printed.
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "aften.h"
+
+#define CHANNELS 6
+
+static double
+get_time(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / freq.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+/* a tone sweep plus noise at a level that changes every few frames */
+static void
+generate_input(FLOAT *samples, int n_frames)
+{
+    uint32_t seed = 1;
+    int n = n_frames * A52_SAMPLES_PER_FRAME;
+    int i, c;
+
+    for(i=0; i<n; i++) {
+        int seg = i / (A52_SAMPLES_PER_FRAME * 3);
+        for(c=0; c<CHANNELS; c++) {
+            double t = i / 48000.0;
+            double freq = 100.0 * (c + 1) + 4000.0 * ((i + c * 7919) % n) / n;
+            double level = 0.05 + 0.9 * (((seg + c) * 37) % 16) / 16.0;
+            seed = seed * 1664525 + 1013904223;
+            samples[i*CHANNELS+c] = (FLOAT)(level *
+                    (0.6 * sin(2.0 * AFT_PI * freq * t) +
+                     0.3 * (((int)(seed >> 16) - 32768) / 32768.0)));
+        }
+    }
+}
+
+/* encodes all frames, returns the elapsed time or a negative value on error */
+static double
+encode(const FLOAT *samples, int n_frames, int n_threads, int mode,
+       int *used_threads)
+{
+    AftenContext s;
+    uint8_t *frame;
+    double start, end;
+    int i, fs;
+
+    frame = malloc(A52_MAX_CODED_FRAME_SIZE);
+    if(!frame)
+        return -1.0;
+
+    aften_set_defaults(&s);
+    s.verbose = 0;
+    s.channels = CHANNELS;
+    s.samplerate = 48000;
+    s.acmod = 7;
+    s.lfe = 1;
+#ifdef CONFIG_DOUBLE
+    s.sample_format = A52_SAMPLE_FMT_DBL;
+#else
+    s.sample_format = A52_SAMPLE_FMT_FLT;
+#endif
+    s.system.n_threads = n_threads;
+    s.system.thread_mode = mode;
+    if(aften_encode_init(&s)) {
+        free(frame);
+        return -1.0;
+    }
+    *used_threads = s.system.n_threads;
+
+    start = get_time();
+    for(i=0; i<n_frames; i++) {
+        if(aften_encode_frame(&s, frame,
+                              &samples[i*A52_SAMPLES_PER_FRAME*CHANNELS]) < 0)
+            break;
+    }
+    // collect the frames still in flight
+    if(i == n_frames) {
+        do {
+            fs = aften_encode_frame(&s, frame, NULL);
+        } while(fs > 0);
+        if(fs < 0)
+            i = -1;
+    }
+    end = get_time();
+
+    aften_encode_close(&s);
+    free(frame);
+    return (i == n_frames) ? end - start : -1.0;
+}
+
+int
+main(int argc, char **argv)
+{
+    FLOAT *samples;
+    double elapsed, base = 0.0;
+    int n_frames = 1000;
+    int max_threads = 64;
+    int mode = AFTEN_THREAD_MODE_FRAME;
+    int n_threads, used_threads, last_threads = 0;
+
+    if(argc > 1)
+        n_frames = atoi(argv[1]);
+    if(argc > 2)
+        max_threads = atoi(argv[2]);
+    if(argc > 3)
+        mode = atoi(argv[3]);
+    if(n_frames <= 0 || max_threads <= 0 || mode < 0 || mode > 2) {
+        fprintf(stderr, "usage: threadbench [frames] [max threads] [thread mode]\n");
+        return 1;
+    }
+
+    samples = malloc(n_frames * A52_SAMPLES_PER_FRAME * CHANNELS * sizeof(FLOAT));
+    if(!samples) {
+        fprintf(stderr, "error allocating input\n");
+        return 1;
+    }
+    generate_input(samples, n_frames);
+
+    printf("%d frames of 48 kHz 5.1, thread mode %d\n", n_frames, mode);
+    for(n_threads=1; n_threads<=max_threads; n_threads*=2) {
+        elapsed = encode(samples, n_frames, n_threads, mode, &used_threads);
+        if(elapsed < 0.0) {
+            fprintf(stderr, "error encoding with %d threads\n", n_threads);
+            free(samples);
+            return 1;
+        }
+        // more threads than the library allows only repeat the last run
+        if(used_threads == last_threads)
+            break;
+        last_threads = used_threads;
+        if(n_threads == 1)
+            base = elapsed;
+        printf("%2d threads: %8.1f frames/s, speedup %5.2f\n", used_threads,
+               n_frames / elapsed, base / elapsed);
+    }
+
+    free(samples);
+    return 0;
+}
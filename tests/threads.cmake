@@ -0,0 +1,41 @@
+# Encodes the same input at 1, 2, 4 and 8 threads in each threading mode and
+# checks that the output is byte for byte the same as single-threaded
+# encoding.  44.1 kHz CBR is used so that the frame padding is covered too.
+#
+# usage: cmake -DAFTEN=<aften> -DTESTWAV=<testwav> -DWORK_DIR=<dir> -P threads.cmake
+
+SET(INPUT ${WORK_DIR}/threads.wav)
+SET(REFERENCE ${WORK_DIR}/threads-ref.ac3)
+SET(OUTPUT ${WORK_DIR}/threads-out.ac3)
+
+EXECUTE_PROCESS(COMMAND ${TESTWAV} ${INPUT} 44100 6 150
+                RESULT_VARIABLE RESULT)
+IF(RESULT)
+  MESSAGE(FATAL_ERROR "error creating ${INPUT}")
+ENDIF(RESULT)
+
+EXECUTE_PROCESS(COMMAND ${AFTEN} -v 0 -threads 1 ${INPUT} ${REFERENCE}
+                RESULT_VARIABLE RESULT OUTPUT_QUIET ERROR_QUIET)
+IF(RESULT)
+  MESSAGE(FATAL_ERROR "error encoding ${REFERENCE}")
+ENDIF(RESULT)
+
+SET(FAILED "")
+FOREACH(MODE 0 1 2)
+  FOREACH(THREADS 1 2 4 8)
+    EXECUTE_PROCESS(COMMAND ${AFTEN} -v 0 -threads ${THREADS} -threadmode ${MODE}
+                            ${INPUT} ${OUTPUT}
+                    RESULT_VARIABLE RESULT OUTPUT_QUIET ERROR_QUIET)
+    IF(NOT RESULT)
+      EXECUTE_PROCESS(COMMAND ${CMAKE_COMMAND} -E compare_files ${REFERENCE} ${OUTPUT}
+                      RESULT_VARIABLE RESULT)
+    ENDIF(NOT RESULT)
+    IF(RESULT)
+      SET(FAILED "${FAILED} mode=${MODE}/threads=${THREADS}")
+    ENDIF(RESULT)
+  ENDFOREACH(THREADS)
+ENDFOREACH(MODE)
+
+IF(FAILED)
+  MESSAGE(FATAL_ERROR "output differs from single-threaded encoding:${FAILED}")
+ENDIF(FAILED)